@@ -54,5 +54,106 @@
  * * Build the release version ("make") and execute it.
  * * Benchmark output will be displayed on stdout, one may redirect it to a file using
  *   shell redirections or the tee command.
+ * * To know where the time goes inside swarm, build with "make profile" and
+ *   execute bin/fourierscope_profile instead: swarm then prints the count,
+ *   total and mean time of each stage (extract, backward, project, forward,
+ *   writeback) and of each led and lap when it returns.
+ *   The hot kernels are compiled for AVX-512, AVX2 and SSE2 and the best one
+ *   for the processor is chosen at startup, the isa line of the report tells
+ *   which one ran.
+ * * To get a timeline of a run, set FOURIERSCOPE_TRACE to the path of a JSON file
+ *   before executing bin/fourierscope: the laps, leds, FFTs and TIFF reads and
+ *   writes are exported in Chrome trace-event format (open it in chrome://tracing).
+ * * To look at the intermediate states, set FOURIERSCOPE_SNAPSHOT to n: the modulus
+ *   and argument of the spectrum are written in build/ every n leds and after each
+ *   lap, by a background thread. Debug builds ("make debug") write every state.
+ * * To follow a long reconstruction, set FOURIERSCOPE_PREVIEW to n: an n x n
+ *   preview of the image is written in build/preview_nnnn.tiff after each lap.
+ *   Only the n x n lowest frequencies of the spectrum are copied and transformed,
+ *   in the background, so a preview takes a fraction of a second.
+ *
+ * @section tuning Tuned plans
+ *
+ * * Set FOURIERSCOPE_WISDOM to a path before executing bin/fourierscope: the
+ *   number of threads and the planner rigor of the thumbnail and final FFTs are
+ *   measured once, then saved with the fftw wisdom (the settings go in the same
+ *   path followed by .tune). The next runs with the same path reuse them.
+ *
+ * @section numa Memory placement
+ *
+ * * The final spectrum is zeroed in parallel before planning, so that on a
+ *   multi-socket machine its pages are spread on the memory nodes of the threads
+ *   which later work on them.
+ * * Set FOURIERSCOPE_AFFINITY to compact or spread to pin the threads (also the
+ *   ones of fftw) on the processors, filling one socket after the other or
+ *   spreading them on every socket. The background threads (snapshots,
+ *   previews, frames, watched directories) keep every processor.
+ * * Set FOURIERSCOPE_HUGEPAGES to get the memory pool from transparent huge pages.
+ *   The pool_bench test prints the cost of the final stages for each placement.
+ *
+ * @section stacks Thumbnail stacks
+ *
+ * * stack_fromtiff converts a directory of thumbnails (xxxxxyyyyy.tiff) in a single
+ *   stack file, which is mapped in memory and given to swarm without any copy.
+ *   Set FOURIERSCOPE_STACK to its path before executing bin/fourierscope to use it.
+ *
+ * @section frames Sequences of frames
+ *
+ * * Set FOURIERSCOPE_STREAM to the printf format of the directories of the frames
+ *   (for example images/frame%.4d, each with its xxxxxyyyyy.tiff thumbnails):
+ *   the next frame is loaded and the previous one written while a frame is
+ *   reconstructed, and the frames per second and the time of each stage are
+ *   printed at the end. The images are build/frame_nnnn.tiff.
+ * * With FOURIERSCOPE_TOLERANCE too, each frame starts from the spectrum of the
+ *   previous one.
+ *
+ * @section acquisition During the acquisition
+ *
+ * * Set FOURIERSCOPE_WATCH to the directory in which the acquisition writes the
+ *   thumbnails (xxxxxyyyyy.tiff, preferably written under another name then
+ *   renamed): each led of the first lap is updated as soon as its thumbnail
+ *   is there, in the order of the acquisition, and the next laps start with
+ *   the last thumbnail. Programs driving the camera can do the same with
+ *   struct feed (feed_arrive).
+ *
+ * @section channels Several wavelengths
+ *
+ * * swarm_channels reconstructs the thumbnails of several wavelengths, each with
+ *   its own delta and radius, at the same time. The channels with the same
+ *   thumbnail dimension share their fftw plans.
+ *
+ * @section checkpoints Checkpoints
+ *
+ * * Set FOURIERSCOPE_CHECKPOINT to a path before executing bin/fourierscope: the
+ *   spectrum is saved there after every lap, and an interrupted run started again
+ *   with the same path resumes from the last saved lap.
+ * * For time-lapses and z-stacks, set FOURIERSCOPE_WARM to the checkpoint of the
+ *   previous frame: the reconstruction starts from its spectrum instead of zero.
+ *   Set FOURIERSCOPE_TOLERANCE too, so that the laps stop once the residual (the
+ *   relative distance between the thumbnails and the modules of the spectrum)
+ *   of a lap is below it, usually after a few laps for a close frame.
+ * * For a fixed time per sample, set FOURIERSCOPE_BUDGET to a time in ms (or use
+ *   swarm_within): the time of a led update is followed while running, a lap is
+ *   only started if it is expected to end in time, and a lap is cut at the led
+ *   which would exceed the budget. The number of laps and leds done is printed.
+ * * Another thread can follow a reconstruction with swarm_poll (lap, led and
+ *   residual, read without lock) and stop it with swarm_cancel: swarm_run then
+ *   returns 5 before its next led. Interrupting bin/fourierscope (SIGINT or
+ *   SIGTERM) does the same, and the image of the updates done is written.
+ *
+ * @section tiles Out-of-core spectrum
+ *
+ * * Set FOURIERSCOPE_TILES to a path before executing bin/fourierscope: the
+ *   spectrum is kept in 64x64 tiles in this file and only a few of them are in
+ *   memory, so that the final image can be bigger than the memory. Snapshots
+ *   and checkpoints are disabled in this mode.
+ * * Set FOURIERSCOPE_SPARSE instead to keep the spectrum in memory but only
+ *   allocate the tiles under the disks of the leds during the reconstruction,
+ *   which is much less than the whole spectrum when jorga*delta+radius is small
+ *   compared to the image.
+ * * Set FOURIERSCOPE_BLOCKED to keep the spectrum in memory in 64x64 tiles
+ *   during the reconstruction, so that each led touches a few contiguous tiles
+ *   instead of lines out_dim apart. The tiles_bench test prints the cost of a
+ *   led update for both layouts.
  *
  */
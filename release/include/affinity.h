@@ -0,0 +1,30 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Thread placement header
+ *
+ */
+
+#ifndef RELEASE_INCLUDE_AFFINITY_H_
+#define RELEASE_INCLUDE_AFFINITY_H_
+
+#include <pthread.h>
+
+/**
+ *  @brief How the OpenMP threads (also used by fftw) are placed
+ *
+ *  The processors allowed to the process are ordered by socket, then
+ *  AFFINITY_COMPACT fills them in order, one thread per processor,
+ *  while AFFINITY_SPREAD puts the threads as far as possible from
+ *  each other, so that every socket and memory node gets some.
+ *
+ */
+enum affinity_policy {AFFINITY_NONE, AFFINITY_COMPACT, AFFINITY_SPREAD};
+
+int affinity_parse(const char *name);
+int affinity_cpu(int policy, int thread, int threads, int cpus);
+int affinity_pin(int policy);
+int affinity_create(pthread_t *thread, void *(*start)(void*), void *arg);
+
+#endif /* RELEASE_INCLUDE_AFFINITY_H_ */
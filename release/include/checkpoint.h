@@ -0,0 +1,63 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Checkpoint functions header
+ *
+ */
+
+#ifndef RELEASE_INCLUDE_CHECKPOINT_H_
+#define RELEASE_INCLUDE_CHECKPOINT_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <fftw3.h>
+
+/** @brief The first bytes of a checkpoint file */
+#define CHECKPOINT_MAGIC "FSCKPT01"
+
+/**
+ *  @brief Alignment of the spectrum in a checkpoint file
+ *
+ *  A page, so that the spectrum can be mapped in memory.
+ *
+ */
+#define CHECKPOINT_ALIGN 4096
+
+/** @brief Written in the header to detect a different endianness */
+#define CHECKPOINT_ENDIAN 0x01020304
+
+/**
+ *  @brief The header of a checkpoint file
+ *
+ *  The spectrum follows at offset, as out_dim*out_dim fftw_complex
+ *  in the native representation.
+ *
+ */
+struct checkpoint_header {
+  char magic[8]; /**< CHECKPOINT_MAGIC without the final '\0' */
+  uint32_t endian; /**< CHECKPOINT_ENDIAN */
+  int32_t th_dim; /**< The dimension of each thumbnail */
+  int32_t out_dim; /**< The dimension of the spectrum */
+  int32_t delta; /**< The distance between two thumbnail centers */
+  int32_t radius; /**< The radius of the extracted circle */
+  int32_t jorga; /**< The dimension of thumbnails is (2*jorga+1)^2 */
+  int32_t lap; /**< The number of laps done */
+  int32_t pos_x; /**< The led of the next update (x index in thumbnails) */
+  int32_t pos_y; /**< The led of the next update (y index in thumbnails) */
+  uint64_t offset; /**< Offset of the spectrum from the start of the file */
+};
+
+int checkpoint_write(const char *name, struct checkpoint_header *header,
+                     fftw_complex *out);
+int checkpoint_read_header(const char *name, struct checkpoint_header *header);
+int checkpoint_load(const char *name, struct checkpoint_header *header,
+                    fftw_complex *out);
+fftw_complex *checkpoint_map(const char *name,
+                             struct checkpoint_header *header);
+void checkpoint_unmap(fftw_complex *out, struct checkpoint_header *header);
+
+#endif /* RELEASE_INCLUDE_CHECKPOINT_H_ */
@@ -0,0 +1,33 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Instruction set dispatch header
+ *
+ */
+
+#ifndef RELEASE_INCLUDE_CPU_H_
+#define RELEASE_INCLUDE_CPU_H_
+
+/**
+ *  @brief Compile a kernel for several instruction sets
+ *
+ *  The kernel is compiled for AVX-512, AVX2 and the baseline (SSE2 on
+ *  x86-64); the variant matching the processor is chosen by the loader
+ *  from CPUID, once, before main. Defining CPU_NO_DISPATCH, or building
+ *  for another architecture, compiles only the baseline.
+ *
+ *  The makefile turns off the contraction into fused multiply-adds, so
+ *  that every variant gives the same results to the last bit.
+ *
+ */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(CPU_NO_DISPATCH)
+#define CPU_DISPATCH __attribute__((target_clones("avx512f", "avx2", \
+                                                  "default")))
+#else
+#define CPU_DISPATCH
+#endif
+
+const char *cpu_isa(void);
+
+#endif /* RELEASE_INCLUDE_CPU_H_ */
@@ -0,0 +1,54 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Thumbnail arrival header
+ *
+ */
+
+#ifndef RELEASE_INCLUDE_FEED_H_
+#define RELEASE_INCLUDE_FEED_H_
+
+#include <pthread.h>
+#include "include/tiffio.h"
+#include "include/pool.h"
+
+/** @brief The default time between two scans of a watched directory */
+#define FEED_INTERVAL_MS 20
+
+/**
+ *  @brief The thumbnails of an acquisition, as they arrive
+ *
+ *  The acquisition (or feed_watch) calls feed_arrive once a thumbnail
+ *  is written in its buffer, and the reconstruction calls feed_wait
+ *  before using it, so that the first lap runs during the acquisition.
+ *
+ */
+struct feed {
+  int side; /**< The number of thumbnails is side*side */
+  int *arrived; /**< Non-zero for each thumbnail already there */
+  int count; /**< The number of thumbnails already there */
+  int closed; /**< Non-zero if no more thumbnail will arrive */
+  pthread_mutex_t lock; /**< Protects count and closed */
+  pthread_cond_t cond; /**< Signals an arrival or the closing */
+
+  const char *dir; /**< The directory watched, or NULL */
+  double **thumbnails; /**< Where the watched thumbnails are read */
+  int th_dim; /**< The dimension of the watched thumbnails */
+  int timeout_ms; /**< Close after this time without arrival */
+  pthread_t watcher; /**< The thread scanning dir */
+};
+
+size_t feed_pool_size(int jorga);
+int feed_init(struct feed *feed, struct pool *pool, int jorga);
+void feed_arrive(struct feed *feed, int index);
+int feed_wait(struct feed *feed, int index);
+int feed_wait_cancel(struct feed *feed, int index, const int *cancel);
+int feed_complete(struct feed *feed);
+void feed_close(struct feed *feed);
+void feed_destroy(struct feed *feed);
+int feed_watch(struct feed *feed, const char *dir, double **thumbnails,
+               int th_dim, int timeout_ms);
+void feed_unwatch(struct feed *feed);
+
+#endif /* RELEASE_INCLUDE_FEED_H_ */
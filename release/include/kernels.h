@@ -0,0 +1,43 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Per-led kernels header
+ *
+ */
+
+#ifndef RELEASE_INCLUDE_KERNELS_H_
+#define RELEASE_INCLUDE_KERNELS_H_
+
+#include "include/matrix.h"
+
+/**
+ *  @brief The kernels applied to a thumbnail for each led
+ *
+ *  They are chosen once by kernels_select. For the dimensions given by
+ *  the cameras (64, 100, 128 and 256) the dimension is a constant in the
+ *  kernels, other dimensions use generic kernels. Every kernel takes
+ *  the dimension anyway, the specialized ones ignore it.
+ *
+ */
+struct kernels {
+  int dim; /**< The dimension of the thumbnails */
+  int specialized; /**< 1 If the kernels are made for dim, 0 if generic */
+
+  /** Set every element of a thumbnail to 0 */
+  void (*clear)(int dim, fftw_complex *mat);
+  /** Divide every element of a thumbnail by dim, see div_dim */
+  void (*normalize)(int dim, fftw_complex *mat);
+  /** Replace the modules of a thumbnail, see matrix_project */
+  void (*project)(int dim, double *mod, fftw_complex *mat);
+  /** Copy a disk of a big matrix to [0;0] of a thumbnail */
+  int (*extract)(int dim, fftw_complex *big, int bigDim, int bigX, int bigY,
+                 int radius, fftw_complex *small);
+  /** Copy a disk at [0;0] of a thumbnail to a big matrix */
+  int (*writeback)(int dim, fftw_complex *small, fftw_complex *big,
+                   int bigDim, int bigX, int bigY, int radius);
+};
+
+void kernels_select(struct kernels *kernels, int dim);
+
+#endif /* RELEASE_INCLUDE_KERNELS_H_ */
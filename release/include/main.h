@@ -8,6 +8,194 @@
 
 #ifndef RELEASE_INCLUDE_MAIN_H_
 #define RELEASE_INCLUDE_MAIN_H_
+#include <signal.h>
 #include "include/swarm.h"
+#include "include/trace.h"
+#include "include/stack.h"
+#include "include/tune.h"
+#include "include/affinity.h"
+#include "include/stream.h"
+
+/**
+ *  @brief Environment variable giving the path of the trace to export
+ *
+ *  When set, the events of the whole run are recorded and exported
+ *  in Chrome trace-event JSON at this path.
+ *
+ */
+#define TRACE_ENV "FOURIERSCOPE_TRACE"
+
+/** @brief The number of events kept per thread when tracing */
+#define TRACE_CAPACITY 1000000
+
+/**
+ *  @brief The threads traced besides the OpenMP ones
+ *
+ *  The snapshot and preview workers, the frame loader and writer, and
+ *  the watcher of a feed.
+ *
+ */
+#define TRACE_BACKGROUND 5
+
+/**
+ *  @brief Environment variable enabling the snapshots
+ *
+ *  When set to n > 0, the state is written in build/ every n leds
+ *  and at the end of every lap, see struct snapshot.
+ *
+ */
+#define SNAPSHOT_ENV "FOURIERSCOPE_SNAPSHOT"
+
+/** @brief The number of snapshots which can wait to be written */
+#define SNAPSHOT_SLOTS 4
+
+/**
+ *  @brief Environment variable enabling the previews
+ *
+ *  When set to n > 0, an n x n preview of the image is written in
+ *  build/preview_nnnn.tiff after every lap, see snapshot_preview.
+ *  Ignored with an out-of-core, sparse or blocked spectrum.
+ *
+ */
+#define PREVIEW_ENV "FOURIERSCOPE_PREVIEW"
+
+/** @brief The number of previews which can wait to be written */
+#define PREVIEW_SLOTS 2
+
+/**
+ *  @brief Environment variable giving the path of the checkpoint
+ *
+ *  When set, a checkpoint is written at this path after every lap,
+ *  and the reconstruction is resumed from it if it already exists.
+ *
+ */
+#define CHECKPOINT_ENV "FOURIERSCOPE_CHECKPOINT"
+
+/**
+ *  @brief Environment variable giving the path of a thumbnail stack
+ *
+ *  When set, the thumbnails are mapped from this stack file (see
+ *  stack_fromtiff) instead of being blank.
+ *
+ */
+#define STACK_ENV "FOURIERSCOPE_STACK"
+
+/**
+ *  @brief Environment variable giving the path of an out-of-core spectrum
+ *
+ *  When set, the spectrum is kept in tiles in this file instead of
+ *  memory, see struct tiles. Snapshots and checkpoints are disabled.
+ *
+ */
+#define TILES_ENV "FOURIERSCOPE_TILES"
+
+/** @brief The number of tiles of the spectrum kept in memory */
+#define TILES_RESIDENT 256
+
+/**
+ *  @brief Environment variable enabling the sparse spectrum
+ *
+ *  When set, only the tiles under the disks of the leds are allocated
+ *  during the reconstruction, the spectrum is densified for the final
+ *  transform. Snapshots and checkpoints are disabled.
+ *
+ */
+#define SPARSE_ENV "FOURIERSCOPE_SPARSE"
+
+/**
+ *  @brief Environment variable enabling the blocked spectrum
+ *
+ *  When set, the spectrum is kept in memory in tiles during the
+ *  reconstruction, so that the disks of the leds are contiguous, and
+ *  converted to a matrix for the final transform.
+ *  Snapshots and checkpoints are disabled.
+ *
+ */
+#define BLOCKED_ENV "FOURIERSCOPE_BLOCKED"
+
+/**
+ *  @brief Environment variable giving the path of the fftw wisdom
+ *
+ *  When set, the wisdom and the tuned settings of the plans (see
+ *  struct tune) are loaded from this path. The dimensions without
+ *  settings are measured first, then everything is saved back.
+ *
+ */
+#define WISDOM_ENV "FOURIERSCOPE_WISDOM"
+
+/**
+ *  @brief Environment variable giving the placement of the threads
+ *
+ *  "compact" or "spread", see enum affinity_policy. When unset, the
+ *  threads are placed by the OpenMP runtime (see OMP_PROC_BIND).
+ *
+ */
+#define AFFINITY_ENV "FOURIERSCOPE_AFFINITY"
+
+/**
+ *  @brief Environment variable enabling huge pages
+ *
+ *  When set, the pool is backed by transparent huge pages, see
+ *  pool_init_huge.
+ *
+ */
+#define HUGEPAGES_ENV "FOURIERSCOPE_HUGEPAGES"
+
+/**
+ *  @brief Environment variable giving the path of an initial spectrum
+ *
+ *  When set, the reconstruction starts from the spectrum of this
+ *  checkpoint (usually the one of the previous frame) instead of zero,
+ *  see swarm_warm. Ignored when resuming from FOURIERSCOPE_CHECKPOINT.
+ *
+ */
+#define WARM_ENV "FOURIERSCOPE_WARM"
+
+/**
+ *  @brief Environment variable giving the tolerance of the reconstruction
+ *
+ *  When set, the laps stop once the residual of a lap is below it,
+ *  see swarm_run.
+ *
+ */
+#define TOLERANCE_ENV "FOURIERSCOPE_TOLERANCE"
+
+/**
+ *  @brief Environment variable giving the time budget of a reconstruction
+ *
+ *  When set, in milliseconds, the laps stop before the reconstruction
+ *  (or each frame of a sequence) exceeds it, see swarm_run.
+ *
+ */
+#define BUDGET_ENV "FOURIERSCOPE_BUDGET"
+
+/**
+ *  @brief Environment variable giving the directories of a sequence
+ *
+ *  When set, it is the printf format of the directory of each frame
+ *  (for example images/frame%.4d), and the frames are reconstructed
+ *  until one is missing, see struct stream. The images are written in
+ *  build/frame_nnnn.tiff. With FOURIERSCOPE_TOLERANCE, each frame
+ *  starts from the spectrum of the previous one.
+ *  Ignored with an out-of-core, sparse or blocked spectrum.
+ *
+ */
+#define STREAM_ENV "FOURIERSCOPE_STREAM"
+
+/** @brief The number of frames in flight: loading, reconstructing, writing */
+#define STREAM_SLOTS 3
+
+/**
+ *  @brief Environment variable giving a directory to watch
+ *
+ *  When set, the thumbnails are read from this directory as the
+ *  acquisition writes them (see feed_watch), and the first lap starts
+ *  with the first thumbnail instead of the last one.
+ *
+ */
+#define WATCH_ENV "FOURIERSCOPE_WATCH"
+
+/** @brief The acquisition is aborted after this time without thumbnail */
+#define WATCH_TIMEOUT_MS 60000
 
 #endif /* RELEASE_INCLUDE_MAIN_H_ */
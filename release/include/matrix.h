@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <time.h>
+#include <string.h>
 
 #include <fftw3.h>
 
@@ -22,6 +23,26 @@
  */
 #define PI acos(-1.0)
 
+/**
+ *  @brief Below this dimension, the kernels run on one thread
+ *
+ */
+#define MATRIX_PARALLEL_DIM 128
+
+/**
+ *  @brief Maximal error in radians of matrix_phase_fast
+ *
+ */
+#define MATRIX_PHASE_ERROR 2e-5
+
+/**
+ *  @brief Maximal error of matrix_polar_fast, relative to the module
+ *
+ */
+#define MATRIX_POLAR_ERROR 1e-11
+
+int matrix_size(int diml, int dimw, size_t elem, size_t *size);
+
 void matrix_copy(fftw_complex *in, fftw_complex *out, int dim);
 
 void div_dim(fftw_complex *in, fftw_complex *out, int dim);
@@ -34,6 +55,15 @@ void alg2exp(fftw_complex in, fftw_complex out);
 void exp2alg(fftw_complex in, fftw_complex out);
 
 void matrix_realpart(int dim, fftw_complex *in, double *out);
+void matrix_magnitude(int dim, fftw_complex *in, double *out);
+void matrix_phase(int dim, fftw_complex *in, double *out);
+void matrix_phase_fast(int dim, fftw_complex *in, double *out);
+void matrix_polar(int dim, double *mod, double *arg, fftw_complex *out);
+void matrix_polar_fast(int dim, double *mod, double *arg,
+                       fftw_complex *out);
+void matrix_project(int dim, double *mod, fftw_complex *mat);
+double matrix_residual(int dim, double *mod, fftw_complex *mat,
+                       double *norm);
 
 double matrix_max(int diml, int dimw, double *matrix);
 double matrix_min(int diml, int dimw, double *matrix);
@@ -48,13 +78,15 @@ int copy_disk_ultimate(fftw_complex* in, fftw_complex* out,
                        int dimIn, int dimOut,
                        int inX, int inY, int outX, int outY,
                        int radius);
-void von_neumann(int x, int y, int radius, int *mat, int dim,
+void von_neumann(int x, int y, int radius, int dim,
                  fftw_complex *in, fftw_complex *out);
 void von_neumann_ultimate(fftw_complex* in, fftw_complex* out,
                           int dimIn, int dimOut,
                           int inX, int inY, int outX, int outY,
-                          int *ref, int refX, int refY,
-                          int radius, int radius_max);
+                          int radius);
 void matrix_recenter(fftw_complex *in, fftw_complex *out, int dim, int offset);
+void matrix_shift(fftw_complex *mat, int dim, int offset);
+void matrix_fftshift(fftw_complex *mat, int dim);
+void matrix_ifftshift(fftw_complex *mat, int dim);
 
 #endif /* RELEASE_INCLUDE_MATRIX_H_ */
@@ -0,0 +1,54 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Buffer pool header
+ *
+ */
+
+#ifndef RELEASE_INCLUDE_POOL_H_
+#define RELEASE_INCLUDE_POOL_H_
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include <fftw3.h>
+
+/**
+ *  @brief Alignment of every block given by a pool
+ *
+ *  It is enough for fftw (SIMD) and matches a cache line.
+ *
+ */
+#define POOL_ALIGN 64
+
+/**
+ *  @brief Size of a huge page, see pool_init_huge
+ *
+ */
+#define POOL_HUGE_PAGE (2 << 20)
+
+/**
+ *  @brief An arena of aligned memory allocated once
+ *
+ */
+struct pool {
+  char *mem; /**< The memory given by fftw_malloc */
+  char *base; /**< The first aligned byte of mem */
+  size_t size; /**< The number of usable bytes from base */
+  size_t used; /**< The number of bytes already given */
+  size_t mapped; /**< The length of mem if mapped by pool_init_huge, or 0 */
+};
+
+size_t pool_round(size_t size);
+int pool_init(struct pool *pool, size_t size);
+int pool_init_huge(struct pool *pool, size_t size);
+void *pool_alloc(struct pool *pool, size_t size);
+void pool_reset(struct pool *pool);
+void pool_destroy(struct pool *pool);
+
+void *pool_heap_alloc(size_t size);
+void pool_heap_free(void *ptr);
+uint64_t pool_heap_count(void);
+
+#endif /* RELEASE_INCLUDE_POOL_H_ */
@@ -0,0 +1,50 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Stage counters and timers header
+ *
+ *  The PROF_* macros only expand to something when the sources are
+ *  compiled with -D PROFILE (see the profile target of the makefile),
+ *  otherwise they cost nothing.
+ *
+ */
+
+#ifndef RELEASE_INCLUDE_PROFILE_H_
+#define RELEASE_INCLUDE_PROFILE_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <time.h>
+
+/**
+ *  @brief The stages timed inside swarm
+ *
+ */
+enum prof_stage {PROF_EXTRACT, PROF_BACKWARD, PROF_PROJECT, PROF_FORWARD,
+                 PROF_WRITEBACK, PROF_LED, PROF_LAP, PROF_STAGES};
+
+uint64_t prof_now(void);
+void prof_reset(void);
+void prof_add(int stage, uint64_t ns);
+uint64_t prof_count(int stage);
+uint64_t prof_total(int stage);
+void prof_report(FILE *stream);
+
+#ifdef PROFILE
+/** Start a timer named var */
+#define PROF_START(var) uint64_t var = prof_now()
+/** Stop the timer var and account it to stage */
+#define PROF_STOP(stage, var) prof_add(stage, prof_now() - var)
+/** Clear all the counters */
+#define PROF_RESET() prof_reset()
+/** Print the summary on stdout */
+#define PROF_REPORT() prof_report(stdout)
+#else
+#define PROF_START(var)
+#define PROF_STOP(stage, var)
+#define PROF_RESET()
+#define PROF_REPORT()
+#endif
+
+#endif /* RELEASE_INCLUDE_PROFILE_H_ */
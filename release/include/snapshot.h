@@ -0,0 +1,81 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Asynchronous snapshot writer header
+ *
+ */
+
+#ifndef RELEASE_INCLUDE_SNAPSHOT_H_
+#define RELEASE_INCLUDE_SNAPSHOT_H_
+
+#include <pthread.h>
+#include "include/matrix.h"
+#include "include/tiffio.h"
+#include "include/pool.h"
+
+/**
+ *  @brief A copy of the state waiting to be written
+ *
+ */
+struct snapshot_slot {
+  fftw_complex *out; /**< Copy of the spectrum */
+  fftw_complex *freq; /**< Copy of the last updated disk */
+  int with_freq; /**< Non-zero if freq must be written too */
+  int step; /**< The number of the first image of this slot */
+};
+
+/**
+ *  @brief Writer of the intermediate states of a reconstruction
+ *
+ *  The states are copied in a ring of slots by the reconstruction
+ *  thread, then converted and written in tiff images by a background
+ *  thread. When the ring is full, the state is dropped rather than
+ *  slowing down the reconstruction.
+ *
+ *  A writer of previews (see snapshot_preview) gets the low
+ *  frequencies of the spectrum instead, and writes the image they
+ *  give at the resolution out_dim.
+ *
+ */
+struct snapshot {
+  int out_dim; /**< The dimension of the spectrum */
+  int th_dim; /**< The dimension of the thumbnails */
+  int every_leds; /**< Take a snapshot every every_leds leds (0: never) */
+  int every_laps; /**< Take a snapshot every every_laps laps (0: never) */
+
+  int leds; /**< The number of leds seen */
+  int laps; /**< The number of laps seen */
+  int step; /**< The number of the next image */
+  int written; /**< The number of snapshots written */
+  int dropped; /**< The number of snapshots dropped (ring full) */
+
+  int slot_nbr; /**< The number of slots in the ring */
+  struct snapshot_slot *slots; /**< The ring */
+  int head; /**< The next slot to fill */
+  int count; /**< The number of filled slots */
+
+  double *io0; /**< Modulus of the slot being written */
+  double *io1; /**< Argument of the slot being written */
+  fftw_plan backward; /**< The transform of the previews, or NULL */
+
+  int stop; /**< Non-zero when the worker must exit */
+  pthread_mutex_t lock; /**< Protects the ring and the counters */
+  pthread_cond_t cond; /**< Signals a change of the ring */
+  pthread_t worker; /**< The background thread */
+};
+
+size_t snapshot_pool_size(int out_dim, int th_dim, int slot_nbr);
+int snapshot_init(struct snapshot *snap, struct pool *pool,
+                  int out_dim, int th_dim, int slot_nbr,
+                  int every_leds, int every_laps);
+int snapshot_push(struct snapshot *snap, fftw_complex *out,
+                  fftw_complex *freq);
+int snapshot_preview(struct snapshot *snap);
+int snapshot_crop(struct snapshot *snap, fftw_complex *out, int out_dim);
+int snapshot_led(struct snapshot *snap, fftw_complex *out,
+                 fftw_complex *freq);
+int snapshot_lap(struct snapshot *snap, fftw_complex *out);
+void snapshot_destroy(struct snapshot *snap);
+
+#endif /* RELEASE_INCLUDE_SNAPSHOT_H_ */
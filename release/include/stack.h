@@ -0,0 +1,87 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Thumbnail stack container header
+ *
+ */
+
+#ifndef RELEASE_INCLUDE_STACK_H_
+#define RELEASE_INCLUDE_STACK_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "include/tiffio.h"
+
+/** @brief The first bytes of a stack file */
+#define STACK_MAGIC "FSSTACK1"
+
+/** @brief Written in the header to detect a different endianness */
+#define STACK_ENDIAN 0x01020304
+
+/**
+ *  @brief Alignment of the first plane of a stack file (a page)
+ *
+ */
+#define STACK_ALIGN 4096
+
+/**
+ *  @brief Alignment of the following planes (a cache line)
+ *
+ */
+#define STACK_PLANE_ALIGN 64
+
+/**
+ *  @brief The header of a stack file
+ *
+ *  It is followed by nbr struct stack_entry, then by the planes,
+ *  diml*dimw doubles each (row-major), the first one at a page
+ *  boundary and the next ones every plane_size bytes.
+ *
+ */
+struct stack_header {
+  char magic[8]; /**< STACK_MAGIC without the final '\0' */
+  uint32_t endian; /**< STACK_ENDIAN */
+  int32_t diml; /**< The number of lines of a thumbnail */
+  int32_t dimw; /**< The number of columns of a thumbnail */
+  int32_t bits; /**< Bits per sample of the planes (64, doubles) */
+  int32_t source_bits; /**< Bits per sample of the acquired images */
+  int32_t jorga; /**< The number of leds is (2*jorga+1)^2 */
+  int32_t nbr; /**< The number of planes */
+  int32_t pad; /**< Unused, 0 */
+  uint64_t plane_size; /**< The distance in bytes between two planes */
+  uint64_t data; /**< Offset of the first plane from the start of the file */
+};
+
+/**
+ *  @brief The index entry of one plane
+ *
+ */
+struct stack_entry {
+  int32_t x; /**< Coordinate of the led on the grid, from -jorga to jorga */
+  int32_t y; /**< Coordinate of the led on the grid, from -jorga to jorga */
+  uint64_t offset; /**< Offset of the plane from the start of the file */
+};
+
+/**
+ *  @brief A stack file mapped in memory
+ *
+ */
+struct stack {
+  struct stack_header header; /**< The header of the file */
+  struct stack_entry *entries; /**< The index, inside the mapping */
+  double **planes; /**< The planes in the order expected by swarm */
+  void *map; /**< The mapping */
+  size_t length; /**< The length of the mapping */
+};
+
+int stack_write(const char *name, double **thumbnails, int jorga,
+                int diml, int dimw, int source_bits);
+int stack_fromtiff(const char *dir, int jorga, const char *name);
+int stack_map(const char *name, struct stack *stack);
+void stack_unmap(struct stack *stack);
+
+#endif /* RELEASE_INCLUDE_STACK_H_ */
@@ -0,0 +1,110 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Frame pipeline header
+ *
+ */
+
+#ifndef RELEASE_INCLUDE_STREAM_H_
+#define RELEASE_INCLUDE_STREAM_H_
+
+#include <pthread.h>
+#include <inttypes.h>
+#include "include/swarm.h"
+
+/** @brief The maximal number of frames in flight in a pipeline */
+#define STREAM_SLOTS_MAX 8
+
+/**
+ *  @brief Read the thumbnails of one frame
+ *  @param[in] arg The argument given to stream_init
+ *  @param[in] frame The number of the frame, from 0
+ *  @param[in] th_dim The dimension of each thumbnail
+ *  @param[out] thumbnails The thumbnails, in the order of swarm_run
+ *  @return int 0 If the frame was read, non-zero at the end of the stream
+ *
+ */
+typedef int (*stream_load_fn)(void *arg, int frame, int th_dim,
+                              double **thumbnails);
+
+/**
+ *  @brief The frames of stream_load_tiff
+ *
+ */
+struct stream_tiff {
+  const char *pattern; /**< printf format of the directory of a frame */
+  int jorga; /**< The number of thumbnails is (2*jorga+1)^2 */
+};
+
+/**
+ *  @brief One frame going through the pipeline
+ *
+ */
+struct stream_frame {
+  int index; /**< The number of the frame */
+  double **thumbnails; /**< The thumbnails of the frame */
+  fftw_complex *out; /**< The spectrum of the frame */
+};
+
+/**
+ *  @brief A bounded FIFO of frame slots between two stages
+ *
+ */
+struct stream_queue {
+  int items[STREAM_SLOTS_MAX]; /**< The slots, in a ring */
+  int head; /**< The next item to pop */
+  int count; /**< The number of items */
+  int closed; /**< Non-zero when nothing will be pushed any more */
+  pthread_mutex_t lock; /**< Protects the queue */
+  pthread_cond_t cond; /**< Signals a change of the queue */
+};
+
+/**
+ *  @brief A pipeline reconstructing a sequence of frames
+ *
+ *  A loader thread reads frame n+1 while the calling thread
+ *  reconstructs frame n and a writer thread computes and writes the
+ *  image of frame n-1. The frames go through a fixed number of slots:
+ *  when every slot is busy, the loader waits for the writer, so that a
+ *  slow stage slows down the others instead of filling the memory.
+ *
+ */
+struct stream {
+  struct swarm_ctx *ctx; /**< The context of the reconstructions */
+  int lap_nbr; /**< The number of laps of each frame */
+  int warm; /**< Non-zero to start each frame from the previous one */
+
+  stream_load_fn load; /**< Reads the thumbnails of a frame */
+  void *load_arg; /**< Given to load */
+  const char *pattern; /**< printf format of the images, with the frame */
+
+  int slot_nbr; /**< The number of frames in flight */
+  struct stream_frame *frames; /**< The slots */
+  struct stream_queue empty; /**< The slots ready to be loaded */
+  struct stream_queue loaded; /**< The slots ready to be reconstructed */
+  struct stream_queue done; /**< The slots ready to be written */
+
+  fftw_complex *image; /**< The inverse transform of the frame written */
+  double *io; /**< The module of image */
+  fftw_plan backward; /**< From the spectrum of a slot to image */
+
+  int frame_nbr; /**< The number of frames to load, <= 0 for all */
+  int error; /**< Non-zero if a stage failed */
+  int cancelled; /**< Non-zero if a reconstruction was cancelled */
+  int written; /**< The number of images written */
+  uint64_t stage_ns[3]; /**< Time spent loading, reconstructing, writing */
+  uint64_t elapsed; /**< The duration of the last stream_run, in ns */
+};
+
+size_t stream_pool_size(int th_dim, int out_dim, int jorga, int slot_nbr);
+int stream_init(struct stream *stream, struct pool *pool,
+                struct swarm_ctx *ctx, int slot_nbr, int lap_nbr,
+                stream_load_fn load, void *load_arg, const char *pattern);
+int stream_run(struct stream *stream, int frame_nbr);
+double stream_fps(struct stream *stream);
+void stream_report(struct stream *stream, FILE *file);
+void stream_destroy(struct stream *stream);
+int stream_load_tiff(void *arg, int frame, int th_dim, double **thumbnails);
+
+#endif /* RELEASE_INCLUDE_STREAM_H_ */
@@ -11,6 +11,12 @@
 
 #include "include/matrix.h"
 #include "include/tiffio.h"
+#include "include/pool.h"
+#include "include/snapshot.h"
+#include "include/checkpoint.h"
+#include "include/tiles.h"
+#include "include/kernels.h"
+#include "include/feed.h"
 #include <omp.h>
 
 /**
@@ -19,18 +25,141 @@
  */
 enum direction {DOWN, LEFT, UP, RIGHT};
 
-void update_spectrum(double *thumb, int th_dim, fftw_plan forward,
-                     fftw_plan backward, fftw_complex *time,
-                     fftw_complex *freq);
+/**
+ *  @brief The number of snapshots waiting to be written in debug builds
+ *
+ *  Debug builds (-D DEBUG) write the state after every led and lap.
+ *
+ */
+#define SNAPSHOT_DEBUG_SLOTS 4
+
+/**
+ *  @brief The weight of the past in the running mean of the led time
+ *
+ *  Each led update moves the mean by 1/SWARM_LED_SMOOTHING of the
+ *  difference, see swarm_ctx.led_ms.
+ *
+ */
+#define SWARM_LED_SMOOTHING 8
+
+/**
+ *  @brief Where a reconstruction is, for other threads
+ *
+ *  Every field is written with atomics by swarm_run, and read without
+ *  lock by swarm_poll.
+ *
+ */
+struct swarm_progress {
+  int lap; /**< The lap being done */
+  int led; /**< The number of leds updated (written back) in this lap */
+  double residual; /**< The residual of the last lap, -1 if not computed */
+};
+
+/**
+ *  @brief Everything a reconstruction needs besides its inputs and output
+ *
+ *  It is set up once by swarm_init, then swarm_run can be called
+ *  many times without allocating anything.
+ *
+ */
+struct swarm_ctx {
+  int th_dim; /**< The dimension of each thumbnail */
+  int out_dim; /**< The dimension of the final image */
+  int delta; /**< The distance between two thumbnail centers */
+  int radius; /**< The radius of the extracted circle */
+  int jorga; /**< The dimension of thumbnails is (2*jorga+1)^2 */
+
+  fftw_complex *time; /**< The source for FT and destination for IFT */
+  fftw_complex *freq; /**< The source for IFT and destination for FT */
+
+  fftw_plan forward; /**< The plan used for fourier transforms */
+  fftw_plan backward; /**< The plan used for inverse transforms */
+  int own_plans; /**< 0 if the plans belong to another context */
+
+  struct kernels kernels; /**< The kernels for th_dim */
+
+  struct tiles *tiles; /**< The spectrum if not in memory, or NULL */
+
+  struct snapshot *snap; /**< Writer of the intermediate states, or NULL */
+  struct snapshot *preview; /**< Writer of a preview every lap, or NULL */
+
+  const char *checkpoint; /**< Path of the checkpoints, or NULL */
+  int checkpoint_every; /**< Write a checkpoint every checkpoint_every laps */
+  int first_lap; /**< The lap from which swarm_run starts */
+
+  /** swarm_run stops after a lap with a smaller residual, 0 to do them all */
+  double tolerance;
+  double residual; /**< The residual of the last lap, -1 if not computed */
+  int laps; /**< The number of laps done by the last swarm_run */
+  double error; /**< The residual of the current lap, not normalized */
+  double norm; /**< The energy of the thumbnails of the current lap */
+
+  struct feed *feed; /**< The arrival of the thumbnails, or NULL */
+  int missing; /**< The leds skipped by the last swarm_run */
+
+  /** swarm_run stops before exceeding this time, 0 for no limit */
+  double budget_ms;
+  double led_ms; /**< Running mean of the time of a led update */
+  uint64_t start; /**< When the last swarm_run started (see clock) */
+  /** The time in ns of the budget, NULL for prof_now (tests drive it) */
+  uint64_t (*clock)(struct swarm_ctx *ctx);
+  int leds; /**< The number of leds updated by the last swarm_run */
+  int expired; /**< Non-zero once the next led would exceed the budget */
+
+  struct swarm_progress progress; /**< Read it with swarm_poll */
+  int cancel; /**< Set by swarm_cancel, checked before each led */
+};
+
+/**
+ *  @brief One channel (wavelength) of a multi-channel reconstruction
+ *
+ *  Every channel has its own thumbnails and geometry, but the final
+ *  images of all the channels have the same dimension.
+ *
+ */
+struct swarm_channel {
+  double **thumbnails; /**< The thumbnails of this channel */
+  int th_dim; /**< The dimension of each thumbnail */
+  int delta; /**< The distance between two thumbnail centers */
+  int radius; /**< The radius of the extracted circle */
+  fftw_complex *out; /**< The spectrum of this channel */
+  int error; /**< Set by swarm_channels, see update_led */
+};
+
+void update_spectrum(double *thumb, struct kernels *kernels,
+                     fftw_plan forward, fftw_plan backward,
+                     fftw_complex *time, fftw_complex *freq,
+                     double *error, double *norm);
+
+size_t swarm_pool_size(int th_dim, int out_dim, int radius);
+int swarm_init(struct swarm_ctx *ctx, struct pool *pool,
+               int th_dim, int out_dim, int delta, int radius, int jorga);
+int swarm_share(struct swarm_ctx *ctx, struct pool *pool,
+                struct swarm_ctx *model, int delta, int radius);
+int swarm_replan(struct swarm_ctx *ctx, unsigned flags);
+void swarm_destroy(struct swarm_ctx *ctx);
+int swarm_checkpoint(struct swarm_ctx *ctx, fftw_complex *out, int lap);
+int swarm_resume(struct swarm_ctx *ctx, const char *name, fftw_complex *out);
+int swarm_warm(struct swarm_ctx *ctx, const char *name, fftw_complex *out);
+void swarm_cancel(struct swarm_ctx *ctx);
+void swarm_poll(struct swarm_ctx *ctx, struct swarm_progress *progress);
 
+int update_led(struct swarm_ctx *ctx, double *thumb, fftw_complex *out,
+               int centerX, int centerY);
 int move_one(int* index_x, int* index_y, int direction);
-int move_streak(double **thumbnails, fftw_complex *time,
-                fftw_complex *freq, fftw_complex *out,
-                fftw_plan forward, fftw_plan backward,
-                int th_dim, int out_dim, int radius, int delta, int side,
-                int *pos_x, int *pos_y, int side_leds,
-                int direction);
+int move_streak(struct swarm_ctx *ctx, double **thumbnails, fftw_complex *out,
+                int *pos_x, int *pos_y, int side_leds, int direction);
+int swarm_run(struct swarm_ctx *ctx, double **thumbnails, const int lap_nbr,
+              fftw_complex *out);
 int swarm(double **thumbnails, int th_dim, int out_dim, int delta,
           const int lap_nbr, int radius, int jorga, fftw_complex *out);
+int swarm_until(double **thumbnails, int th_dim, int out_dim, int delta,
+                const int lap_nbr, int radius, int jorga, double tolerance,
+                int *laps, fftw_complex *out);
+int swarm_within(double **thumbnails, int th_dim, int out_dim, int delta,
+                 const int lap_nbr, int radius, int jorga, double budget_ms,
+                 int *laps, int *leds, fftw_complex *out);
+int swarm_channels(struct swarm_channel *channels, int nbr, int out_dim,
+                   const int lap_nbr, int jorga);
 
 #endif /* RELEASE_INCLUDE_SWARM_H_ */
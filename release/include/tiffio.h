@@ -19,9 +19,15 @@
 int tiff_getsize(const char *name, uint32 *diml, uint32 *dimw);
 int tiff_fullscale(double min, double max, double tosample);
 int tiff_maxnormalized(double max, double tosample);
+void tiff_quantize(double min, double max, double *line,
+                   unsigned char *data, uint32 dimw);
 
 int tiff_tomatrix(const char *name, double *matrix, uint32 diml, uint32 dimw);
 int tiff_frommatrix(const char *name, double *matrix, uint32 diml, uint32 dimw);
+int tiff_fromrows(const char *name, uint32 diml, uint32 dimw,
+                  double min, double max,
+                  int (*get_row)(void *arg, uint32 row, double *line),
+                  void *arg, double *line);
 char* tiff_getname(int x, int y, char* name);
 
 #endif /* RELEASE_INCLUDE_TIFFIO_H_ */
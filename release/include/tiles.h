@@ -0,0 +1,85 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Tiled spectrum store header
+ *
+ */
+
+#ifndef RELEASE_INCLUDE_TILES_H_
+#define RELEASE_INCLUDE_TILES_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "include/matrix.h"
+#include "include/tiffio.h"
+#include "include/pool.h"
+
+/** @brief The default side of a tile */
+#define TILES_SIDE 64
+
+/**
+ *  @brief A dim*dim spectrum split in side*side tiles
+ *
+ *  Either the tiles are stored in a file and only resident_max of them
+ *  are kept in memory: a tile is read when touched and, if modified,
+ *  written back when evicted (least recently used first).
+ *  Each tile is row-major, the tiles of the file are row-major too.
+ *
+ *  Or the tiles are sparse (fd < 0): a tile is allocated when first
+ *  written, up to resident_max tiles, and the others read as zeros.
+ *
+ *  Or the tiles are blocked (fd < 0): all of them are in memory, so that
+ *  the elements of a disk are close to each other.
+ *
+ */
+struct tiles {
+  int dim; /**< The dimension of the spectrum */
+  int side; /**< The side of a tile */
+  int nbr; /**< The number of tiles on a side of the spectrum */
+  int fd; /**< The backing file */
+
+  fftw_complex **data; /**< For each tile, its memory or NULL */
+
+  int resident_max; /**< The number of tiles which can be in memory */
+  fftw_complex *cache; /**< The memory of the resident tiles */
+  int *owner; /**< For each slot of the cache, its tile or -1 */
+  uint64_t *last_use; /**< For each slot of the cache, its last use */
+  char *dirty; /**< For each slot of the cache, non-zero if modified */
+  uint64_t clock; /**< Incremented at each use of a tile */
+
+  int resident; /**< The number of tiles allocated (sparse tiles) */
+  fftw_complex *zero; /**< A tile of zeros (sparse tiles) */
+
+  fftw_complex *band; /**< side*dim buffer for whole rows or columns */
+
+  uint64_t loads; /**< The number of tiles read from the file */
+  uint64_t stores; /**< The number of tiles written to the file */
+};
+
+size_t tiles_pool_size(int dim, int side, int resident_max);
+int tiles_open(struct tiles *tiles, struct pool *pool, const char *name,
+               int dim, int side, int resident_max);
+size_t tiles_sparse_pool_size(int dim, int side, int resident_max);
+int tiles_sparse(struct tiles *tiles, struct pool *pool,
+                 int dim, int side, int resident_max);
+int tiles_sparse_count(int dim, int side, int delta, int radius, int jorga);
+size_t tiles_blocked_pool_size(int dim, int side);
+int tiles_blocked(struct tiles *tiles, struct pool *pool, int dim, int side);
+fftw_complex *tiles_get(struct tiles *tiles, int tile, int write);
+int tiles_copy_disk(struct tiles *tiles, fftw_complex *small, int th_dim,
+                    int centerX, int centerY, int radius, int to_tiles);
+int tiles_read_rows(struct tiles *tiles, int row, int nrows,
+                    fftw_complex *rows);
+int tiles_write_rows(struct tiles *tiles, int row, int nrows,
+                     fftw_complex *rows);
+int tiles_densify(struct tiles *tiles, fftw_complex *out);
+int tiles_from_matrix(struct tiles *tiles, fftw_complex *in);
+int tiles_fft(struct tiles *tiles, int sign);
+int tiles_tiff(struct tiles *tiles, const char *name);
+int tiles_flush(struct tiles *tiles);
+void tiles_close(struct tiles *tiles);
+
+#endif /* RELEASE_INCLUDE_TILES_H_ */
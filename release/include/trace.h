@@ -0,0 +1,49 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Timeline trace recorder header
+ *
+ */
+
+#ifndef RELEASE_INCLUDE_TRACE_H_
+#define RELEASE_INCLUDE_TRACE_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+/**
+ *  @brief Non-zero while events are recorded, see trace_start
+ *
+ */
+extern int trace_enabled;
+
+int trace_start(size_t capacity, int ring_nbr);
+void trace_stop(void);
+void trace_free(void);
+void trace_event(const char *name, char phase);
+size_t trace_count(void);
+int trace_dump(const char *name);
+
+/**
+ *  @brief Record the beginning of the event name (a string literal)
+ *
+ *  Only costs a load and a test when the recorder is stopped.
+ *
+ */
+#define TRACE_BEGIN(name) do {                                          \
+    if (__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED))              \
+      trace_event(name, 'B');                                           \
+  } while (0)
+
+/**
+ *  @brief Record the end of the event name (a string literal)
+ *
+ */
+#define TRACE_END(name) do {                                            \
+    if (__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED))              \
+      trace_event(name, 'E');                                           \
+  } while (0)
+
+#endif /* RELEASE_INCLUDE_TRACE_H_ */
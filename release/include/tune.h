@@ -0,0 +1,59 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  FFT autotuning header
+ *
+ */
+
+#ifndef RELEASE_INCLUDE_TUNE_H_
+#define RELEASE_INCLUDE_TUNE_H_
+
+#include <stdio.h>
+#include <fftw3.h>
+
+/** @brief The number of FFT dimensions a profile can hold */
+#define TUNE_DIMS 16
+
+/**
+ *  @brief The time during which each setting is measured, in ns
+ *
+ *  Each setting runs at least once, then until this time is spent.
+ *
+ */
+#define TUNE_MIN_NS 20000000
+
+/**
+ *  @brief Appended to the path of the wisdom to get the one of the profile
+ *
+ */
+#define TUNE_SUFFIX ".tune"
+
+/**
+ *  @brief The best settings measured for one dimension of 2d FFT
+ *
+ */
+struct tune_entry {
+  int dim; /**< The dimension of the FFT */
+  int threads; /**< The number of threads giving the fastest FFT */
+  unsigned flags; /**< FFTW_ESTIMATE or FFTW_MEASURE */
+  double ns; /**< The time of one FFT with these settings */
+};
+
+/**
+ *  @brief The settings of every dimension measured on this machine
+ *
+ */
+struct tune {
+  int nbr; /**< The number of measured dimensions */
+  struct tune_entry entries[TUNE_DIMS]; /**< The measured dimensions */
+};
+
+void tune_init(struct tune *tune);
+struct tune_entry *tune_find(struct tune *tune, int dim);
+int tune_measure(struct tune *tune, int dim, int max_threads);
+unsigned tune_plan(struct tune *tune, int dim);
+int tune_load(struct tune *tune, const char *wisdom);
+int tune_save(struct tune *tune, const char *wisdom);
+
+#endif /* RELEASE_INCLUDE_TUNE_H_ */
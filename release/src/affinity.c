@@ -0,0 +1,165 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  This file pins the OpenMP threads on the processors, so that each
+ *  thread keeps working on the memory node of the pages it touched
+ *  first.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <omp.h>
+#include "include/affinity.h"
+
+/** @brief The processors allowed before affinity_pin, for affinity_create */
+static cpu_set_t affinity_allowed;
+
+/** @brief Non-zero once affinity_allowed is saved */
+static int affinity_saved;
+
+/**
+ *  @brief Get a policy from its name
+ *  @param[in] name "compact", "spread" or "none"
+ *  @return int The policy, -1 if the name is unknown
+ *
+ */
+int affinity_parse(const char *name) {
+  if (strcmp(name, "none") == 0)
+    return AFFINITY_NONE;
+  if (strcmp(name, "compact") == 0)
+    return AFFINITY_COMPACT;
+  if (strcmp(name, "spread") == 0)
+    return AFFINITY_SPREAD;
+  return -1;
+}
+
+/**
+ *  @brief Get the processor of a thread
+ *  @param[in] policy AFFINITY_COMPACT or AFFINITY_SPREAD
+ *  @param[in] thread The number of the thread in the team
+ *  @param[in] threads The number of threads in the team
+ *  @param[in] cpus The number of allowed processors
+ *  @return int The index of the processor, in [0;cpus[
+ *
+ *  With more threads than processors, several threads share one.
+ *
+ */
+int affinity_cpu(int policy, int thread, int threads, int cpus) {
+  if (policy == AFFINITY_SPREAD && threads < cpus)
+    return (int) ((long) thread*cpus/threads);
+  return thread % cpus;
+}
+
+/**
+ *  @brief Get the socket of a processor
+ *  @return int The socket, 0 if it is unknown
+ *
+ */
+static int affinity_socket(int cpu) {
+  char name[80];
+  int socket = 0;
+  snprintf(name, sizeof(name),
+           "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+  FILE *file = fopen(name, "r");
+  if (file) {
+    if (fscanf(file, "%d", &socket) != 1)
+      socket = 0;
+    fclose(file);
+  }
+  return socket;
+}
+
+/**
+ *  @brief Pin each thread of the OpenMP team on one processor
+ *  @param[in] policy The placement of the threads
+ *  @return 1 If a thread could not be pinned
+ *  @return 0 Otherwise
+ *
+ *  Every later parallel region of the same size, including the ones
+ *  of fftw, reuses these threads and therefore their placement.
+ *  Nothing is done with AFFINITY_NONE.
+ *
+ *  The calling thread is pinned too, and the threads it creates would
+ *  share its processor: the background threads are created with
+ *  affinity_create instead, on the processors allowed before.
+ *
+ */
+int affinity_pin(int policy) {
+  int cpus[CPU_SETSIZE];
+  int sockets[CPU_SETSIZE];
+  int nbr = 0;
+  int error = 0;
+  cpu_set_t allowed;
+
+  if (policy == AFFINITY_NONE)
+    return 0;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed))
+    return 1;
+  if (!affinity_saved) {
+    affinity_allowed = allowed;
+    affinity_saved = 1;
+  }
+
+  /* insertion by socket, the processors of a socket stay in order */
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (!CPU_ISSET(cpu, &allowed))
+      continue;
+    int socket = affinity_socket(cpu);
+    int i = nbr++;
+    while (i > 0 && sockets[i-1] > socket) {
+      cpus[i] = cpus[i-1];
+      sockets[i] = sockets[i-1];
+      i--;
+    }
+    cpus[i] = cpu;
+    sockets[i] = socket;
+  }
+  if (nbr == 0)
+    return 1;
+
+  #pragma omp parallel reduction(|:error)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[affinity_cpu(policy, omp_get_thread_num(),
+                              omp_get_num_threads(), nbr)], &set);
+    error |= pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0;
+  }
+  return error;
+}
+
+/**
+ *  @brief Create a background thread, not pinned by affinity_pin
+ *  @param[out] thread The new thread
+ *  @param[in] start The function of the thread
+ *  @param[in] arg Given to start
+ *  @return int 0 If the thread was created, see pthread_create otherwise
+ *
+ *  The thread may run on every processor allowed to the process before
+ *  affinity_pin, instead of the one of the calling thread, so that it
+ *  overlaps with the reconstruction.
+ *
+ */
+int affinity_create(pthread_t *thread, void *(*start)(void*), void *arg) {
+  pthread_attr_t attr;
+  int error;
+
+  if (!affinity_saved)
+    return pthread_create(thread, NULL, start, arg);
+  error = pthread_attr_init(&attr);
+  if (error)
+    return error;
+  error = pthread_attr_setaffinity_np(&attr, sizeof(affinity_allowed),
+                                      &affinity_allowed);
+  if (!error)
+    error = pthread_create(thread, &attr, start, arg);
+  pthread_attr_destroy(&attr);
+  return error;
+}
@@ -0,0 +1,196 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  This file implements the checkpoints of a reconstruction: the
+ *  spectrum and the position in the spiral are saved in a raw binary
+ *  file, so that an interrupted reconstruction can be resumed.
+ *
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "include/checkpoint.h"
+#include "include/trace.h"
+
+/**
+ *  @brief Write a buffer entirely
+ *  @return 1 If a write failed
+ *  @return 0 Otherwise
+ *
+ */
+static int checkpoint_full_write(int fd, const char *buf, size_t size) {
+  while (size > 0) {
+    ssize_t done = write(fd, buf, size);
+    if (done <= 0)
+      return 1;
+    buf += done;
+    size -= done;
+  }
+  return 0;
+}
+
+/**
+ *  @brief Read a buffer entirely
+ *  @return 1 If a read failed or the file is too short
+ *  @return 0 Otherwise
+ *
+ */
+static int checkpoint_full_read(int fd, char *buf, size_t size) {
+  while (size > 0) {
+    ssize_t done = read(fd, buf, size);
+    if (done <= 0)
+      return 1;
+    buf += done;
+    size -= done;
+  }
+  return 0;
+}
+
+/**
+ *  @brief Get the size of the spectrum of a checkpoint in bytes
+ *
+ */
+static size_t checkpoint_data_size(const struct checkpoint_header *header) {
+  return (size_t) header->out_dim*header->out_dim*sizeof(fftw_complex);
+}
+
+/**
+ *  @brief Save a spectrum and the position of the reconstruction
+ *  @param[in] name The path of the checkpoint
+ *  @param[in,out] header The parameters and position to save \
+ *                        (magic, endian and offset are filled)
+ *  @param[in] out The spectrum
+ *  @return 1 If the file could not be written
+ *  @return 0 Otherwise
+ *
+ *  The checkpoint is written in name.tmp which is then renamed, so that
+ *  an interruption while writing never destroys the previous checkpoint.
+ *  Nothing is allocated on the heap.
+ *
+ */
+int checkpoint_write(const char *name, struct checkpoint_header *header,
+                     fftw_complex *out) {
+  char tmp[FILENAME_MAX];
+  if (snprintf(tmp, sizeof(tmp), "%s.tmp", name) >= (int) sizeof(tmp))
+    return 1;
+
+  memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+  header->endian = CHECKPOINT_ENDIAN;
+  header->offset = CHECKPOINT_ALIGN;
+
+  /* the header is padded to a full page */
+  char first[CHECKPOINT_ALIGN];
+  memset(first, 0, sizeof(first));
+  memcpy(first, header, sizeof(*header));
+
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return 1;
+
+  TRACE_BEGIN("checkpoint_write");
+  int error = checkpoint_full_write(fd, first, CHECKPOINT_ALIGN) ||
+    checkpoint_full_write(fd, (const char*) out,
+                          checkpoint_data_size(header)) ||
+    fsync(fd);
+  error = close(fd) || error;
+  if (!error)
+    error = rename(tmp, name) != 0;
+  else
+    unlink(tmp);
+  TRACE_END("checkpoint_write");
+
+  return error ? 1 : 0;
+}
+
+/**
+ *  @brief Read and check the header of a checkpoint
+ *  @param[in] name The path of the checkpoint
+ *  @param[out] header The header read
+ *  @return 1 If the file could not be read or is not a valid checkpoint
+ *  @return 0 Otherwise
+ *
+ */
+int checkpoint_read_header(const char *name,
+                           struct checkpoint_header *header) {
+  int fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return 1;
+  int error = checkpoint_full_read(fd, (char*) header, sizeof(*header));
+  close(fd);
+
+  if (error || memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic))
+      || header->endian != CHECKPOINT_ENDIAN || header->out_dim <= 0
+      || header->offset % CHECKPOINT_ALIGN)
+    return 1;
+  return 0;
+}
+
+/**
+ *  @brief Read a checkpoint
+ *  @param[in] name The path of the checkpoint
+ *  @param[out] header The header of the checkpoint
+ *  @param[out] out The spectrum, out_dim*out_dim as given in header
+ *  @return 1 If the file could not be read or is not a valid checkpoint
+ *  @return 0 Otherwise
+ *
+ *  Use checkpoint_read_header first to know the dimension of out.
+ *
+ */
+int checkpoint_load(const char *name, struct checkpoint_header *header,
+                    fftw_complex *out) {
+  if (checkpoint_read_header(name, header))
+    return 1;
+
+  int fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return 1;
+  TRACE_BEGIN("checkpoint_read");
+  int error = lseek(fd, header->offset, SEEK_SET) == (off_t) -1 ||
+    checkpoint_full_read(fd, (char*) out, checkpoint_data_size(header));
+  TRACE_END("checkpoint_read");
+  close(fd);
+  return error ? 1 : 0;
+}
+
+/**
+ *  @brief Map the spectrum of a checkpoint in memory, read-only
+ *  @param[in] name The path of the checkpoint
+ *  @param[out] header The header of the checkpoint
+ *  @return NULL If the file could not be mapped, is not valid or is \
+ *               too short for its spectrum (truncated)
+ *
+ *  Nothing is copied, the pages are shared with the page cache.
+ *  The mapping must be released with checkpoint_unmap.
+ *
+ */
+fftw_complex *checkpoint_map(const char *name,
+                             struct checkpoint_header *header) {
+  if (checkpoint_read_header(name, header))
+    return NULL;
+
+  int fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  /* a page mapped past the end of the file would raise SIGBUS */
+  struct stat st;
+  if (fstat(fd, &st) || (uint64_t) st.st_size < header->offset ||
+      (uint64_t) st.st_size - header->offset < checkpoint_data_size(header)) {
+    close(fd);
+    return NULL;
+  }
+  void *data = mmap(NULL, checkpoint_data_size(header), PROT_READ,
+                    MAP_SHARED, fd, header->offset);
+  close(fd);
+  return data == MAP_FAILED ? NULL : (fftw_complex*) data;
+}
+
+/**
+ *  @brief Release a mapping given by checkpoint_map
+ *
+ */
+void checkpoint_unmap(fftw_complex *out, struct checkpoint_header *header) {
+  munmap(out, checkpoint_data_size(header));
+}
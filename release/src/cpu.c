@@ -0,0 +1,29 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  This file tells which variant of the kernels compiled with
+ *  CPU_DISPATCH is used on this processor.
+ *
+ */
+
+#include "include/cpu.h"
+
+/**
+ *  @brief Get the instruction set of the kernels used on this processor
+ *  @return const char* "avx512f", "avx2" or "default"
+ *
+ *  It follows the same order as the loader: the first instruction set
+ *  of CPU_DISPATCH supported by the processor.
+ *
+ */
+const char *cpu_isa(void) {
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(CPU_NO_DISPATCH)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return "avx512f";
+  if (__builtin_cpu_supports("avx2"))
+    return "avx2";
+#endif
+  return "default";
+}
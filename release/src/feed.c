@@ -0,0 +1,269 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  This file lets a reconstruction start before the acquisition is
+ *  over: the thumbnails are flagged as they arrive, from the
+ *  acquisition itself or from a watched directory.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <unistd.h>
+#include <time.h>
+#include "include/feed.h"
+#include "include/affinity.h"
+#include "include/profile.h"
+#include "include/trace.h"
+
+/**
+ *  @brief Get the size of the pool needed by a feed
+ *  @param[in] jorga The number of thumbnails is (2*jorga+1)^2
+ *  @return size_t The number of bytes to take into account in pool_init
+ *
+ */
+size_t feed_pool_size(int jorga) {
+  return pool_round((size_t) (2*jorga+1)*(2*jorga+1)*sizeof(int));
+}
+
+/**
+ *  @brief Prepare a feed without any thumbnail
+ *  @param[out] feed The feed to initialize
+ *  @param[in,out] pool The pool in which the flags are taken \
+ *                      (see feed_pool_size)
+ *  @param[in] jorga The number of thumbnails is (2*jorga+1)^2
+ *  @return 1 If the pool is too small
+ *  @return 0 Otherwise
+ *
+ */
+int feed_init(struct feed *feed, struct pool *pool, int jorga) {
+  feed->side = 2*jorga+1;
+  feed->arrived = (int*) pool_alloc(pool, (size_t) feed->side*feed->side*
+                                    sizeof(int));
+  if (feed->arrived == NULL)
+    return 1;
+  for (int i = 0; i < feed->side*feed->side; i++)
+    feed->arrived[i] = 0;
+  feed->count = 0;
+  feed->closed = 0;
+  feed->dir = NULL;
+  pthread_mutex_init(&feed->lock, NULL);
+  pthread_cond_init(&feed->cond, NULL);
+  return 0;
+}
+
+/**
+ *  @brief Tell that a thumbnail is in its buffer
+ *  @param[in,out] feed The feed
+ *  @param[in] index The index of the thumbnail, in the order of swarm_run
+ *
+ *  The thumbnail must not change any more.
+ *
+ */
+void feed_arrive(struct feed *feed, int index) {
+  if (index < 0 || index >= feed->side*feed->side)
+    return;
+  pthread_mutex_lock(&feed->lock);
+  if (!feed->arrived[index]) {
+    __atomic_store_n(&feed->arrived[index], 1, __ATOMIC_RELEASE);
+    feed->count++;
+    pthread_cond_broadcast(&feed->cond);
+  }
+  pthread_mutex_unlock(&feed->lock);
+}
+
+/**
+ *  @brief Wait for a thumbnail
+ *  @param[in,out] feed The feed
+ *  @param[in] index The index of the thumbnail, in the order of swarm_run
+ *  @return 1 If the feed was closed before the thumbnail arrived
+ *  @return 0 Otherwise
+ *
+ *  Only costs a load once the thumbnail is there.
+ *
+ */
+int feed_wait(struct feed *feed, int index) {
+  return feed_wait_cancel(feed, index, NULL);
+}
+
+/**
+ *  @brief Wait for a thumbnail, unless a flag is set
+ *  @param[in,out] feed The feed
+ *  @param[in] index The index of the thumbnail, in the order of swarm_run
+ *  @param[in] cancel Stops the wait once non-zero, or NULL
+ *  @return 1 If the feed was closed or cancel was set before the \
+ *            thumbnail arrived
+ *  @return 0 Otherwise
+ *
+ *  cancel is set without the lock of the feed (from a signal handler
+ *  for example), so it is checked every FEED_INTERVAL_MS.
+ *
+ */
+int feed_wait_cancel(struct feed *feed, int index, const int *cancel) {
+  struct timespec deadline;
+
+  if (index < 0 || index >= feed->side*feed->side)
+    return 1;
+  if (__atomic_load_n(&feed->arrived[index], __ATOMIC_ACQUIRE))
+    return 0;
+
+  TRACE_BEGIN("feed_wait");
+  pthread_mutex_lock(&feed->lock);
+  while (!feed->arrived[index] && !feed->closed) {
+    if (cancel == NULL) {
+      pthread_cond_wait(&feed->cond, &feed->lock);
+      continue;
+    }
+    if (__atomic_load_n(cancel, __ATOMIC_ACQUIRE))
+      break;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += FEED_INTERVAL_MS*1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&feed->cond, &feed->lock, &deadline);
+  }
+  int missing = !feed->arrived[index];
+  pthread_mutex_unlock(&feed->lock);
+  TRACE_END("feed_wait");
+  return missing;
+}
+
+/**
+ *  @brief Check if every thumbnail arrived
+ *  @return 1 If they did
+ *  @return 0 Otherwise
+ *
+ */
+int feed_complete(struct feed *feed) {
+  pthread_mutex_lock(&feed->lock);
+  int complete = feed->count == feed->side*feed->side;
+  pthread_mutex_unlock(&feed->lock);
+  return complete;
+}
+
+/**
+ *  @brief Tell that no more thumbnail will arrive (aborted acquisition)
+ *
+ *  The waits for the missing thumbnails return at once.
+ *
+ */
+void feed_close(struct feed *feed) {
+  pthread_mutex_lock(&feed->lock);
+  feed->closed = 1;
+  pthread_cond_broadcast(&feed->cond);
+  pthread_mutex_unlock(&feed->lock);
+}
+
+/**
+ *  @brief Destroy the locks of a feed
+ *
+ *  The watcher must be stopped (see feed_unwatch). The flags are given
+ *  back with the pool.
+ *
+ */
+void feed_destroy(struct feed *feed) {
+  pthread_cond_destroy(&feed->cond);
+  pthread_mutex_destroy(&feed->lock);
+}
+
+/**
+ *  @brief Read a watched thumbnail if it is complete
+ *  @return 1 If it is not there or not complete yet
+ *  @return 0 Otherwise
+ *
+ */
+static int feed_read(struct feed *feed, int index) {
+  char path[FILENAME_MAX];
+  uint32 diml, dimw;
+
+  if (snprintf(path, sizeof(path), "%s/%.5d%.5d.tiff", feed->dir,
+               index/feed->side, index%feed->side) >= (int) sizeof(path) ||
+      access(path, R_OK))
+    return 1;
+  return tiff_getsize(path, &diml, &dimw) ||
+    (int) diml != feed->th_dim || (int) dimw != feed->th_dim ||
+    tiff_tomatrix(path, feed->thumbnails[index], diml, dimw);
+}
+
+/**
+ *  @brief Watcher thread: read the thumbnails as they appear in dir
+ *
+ */
+static void *feed_watcher(void *arg) {
+  struct feed *feed = (struct feed*) arg;
+  int nbr = feed->side*feed->side;
+  struct timespec interval = {0, FEED_INTERVAL_MS*1000000L};
+  uint64_t last = prof_now();
+
+  for (;;) {
+    pthread_mutex_lock(&feed->lock);
+    int done = feed->closed || feed->count == nbr;
+    pthread_mutex_unlock(&feed->lock);
+    if (done)
+      break;
+
+    for (int i = 0; i < nbr; i++)
+      if (!__atomic_load_n(&feed->arrived[i], __ATOMIC_ACQUIRE) &&
+          feed_read(feed, i) == 0) {
+        feed_arrive(feed, i);
+        last = prof_now();
+      }
+
+    if (feed->timeout_ms > 0 &&
+        prof_now() - last > (uint64_t) feed->timeout_ms*1000000) {
+      feed_close(feed);
+      break;
+    }
+    nanosleep(&interval, NULL);
+  }
+  return NULL;
+}
+
+/**
+ *  @brief Read the thumbnails in a directory as they are written
+ *  @param[in,out] feed The feed
+ *  @param[in] dir The directory, in which the thumbnails are named \
+ *                 xxxxxyyyyy.tiff as for stack_fromtiff
+ *  @param[out] thumbnails Where the thumbnails are read
+ *  @param[in] th_dim The dimension of each thumbnail
+ *  @param[in] timeout_ms Close the feed after this time without a new \
+ *                        thumbnail, 0 to wait for ever
+ *  @return 1 If the thread could not be created
+ *  @return 0 Otherwise
+ *
+ *  The directory is scanned every FEED_INTERVAL_MS in a background
+ *  thread. A thumbnail which cannot be read yet is tried again at the
+ *  next scan, but it is safer to write each one under another name
+ *  and rename it once complete.
+ *
+ */
+int feed_watch(struct feed *feed, const char *dir, double **thumbnails,
+               int th_dim, int timeout_ms) {
+  feed->dir = dir;
+  feed->thumbnails = thumbnails;
+  feed->th_dim = th_dim;
+  feed->timeout_ms = timeout_ms;
+  if (affinity_create(&feed->watcher, feed_watcher, feed)) {
+    feed->dir = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ *  @brief Stop watching the directory
+ *
+ *  If some thumbnails are still missing, the feed is closed.
+ *
+ */
+void feed_unwatch(struct feed *feed) {
+  if (feed->dir == NULL)
+    return;
+  feed_close(feed);
+  pthread_join(feed->watcher, NULL);
+  feed->dir = NULL;
+}
@@ -0,0 +1,211 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  This file implements the kernels applied to a thumbnail for each led,
+ *  once for each usual thumbnail dimension and once for any dimension.
+ *
+ *  Each kernel is written once as an inlined body taking the dimension,
+ *  KERNELS_DEFINE instantiates the bodies with a constant dimension so
+ *  that the compiler knows the trip counts. The arithmetic kernels are
+ *  also compiled for each instruction set of CPU_DISPATCH, the disk
+ *  copies rely on memcpy which already does so.
+ *
+ */
+
+#include "include/kernels.h"
+#include "include/cpu.h"
+
+/**
+ *  @brief Inline the bodies even when not optimizing
+ *
+ */
+#define KERNELS_INLINE inline __attribute__((always_inline))
+
+/**
+ *  @brief Set every element of a matrix to 0
+ *
+ */
+static KERNELS_INLINE void kernels_clear_body(int dim, fftw_complex *mat) {
+  size_t size = (size_t) dim*dim;
+  #pragma omp simd
+  for (size_t i = 0; i < size; i++) {
+    mat[i][0] = 0;
+    mat[i][1] = 0;
+  }
+}
+
+/**
+ *  @brief Divide every element of a matrix by dim, like div_dim
+ *
+ */
+static KERNELS_INLINE void kernels_normalize_body(int dim, fftw_complex *mat) {
+  size_t size = (size_t) dim*dim;
+  #pragma omp simd
+  for (size_t i = 0; i < size; i++) {
+    mat[i][0] = mat[i][0]/dim;
+    mat[i][1] = mat[i][1]/dim;
+  }
+}
+
+/**
+ *  @brief Replace the modules of a matrix, like matrix_project
+ *
+ */
+static KERNELS_INLINE void kernels_project_body(int dim, double *mod,
+                                                fftw_complex *mat) {
+  size_t size = (size_t) dim*dim;
+  #pragma omp simd
+  for (size_t i = 0; i < size; i++) {
+    double norm = sqrt(mat[i][0]*mat[i][0] + mat[i][1]*mat[i][1]);
+    double scale = norm == 0 ? 0 : mod[i]/norm;
+    mat[i][0] = norm == 0 ? mod[i] : mat[i][0]*scale;
+    mat[i][1] = mat[i][1]*scale;
+  }
+}
+
+/**
+ *  @brief Copy between a part of a line, folded, and a contiguous buffer
+ *  @param[in,out] line The line of the big matrix
+ *  @param[in] dim The length of the line
+ *  @param[in] y The first column in the line, in [0;dim[
+ *  @param[in,out] small The contiguous buffer
+ *  @param[in] len The number of elements, at most dim
+ *  @param[in] to_line 1 To copy from small to line, 0 for the opposite
+ *
+ */
+static KERNELS_INLINE void kernels_span(fftw_complex *line, int dim, int y,
+                                        fftw_complex *small, int len,
+                                        int to_line) {
+  int first = (dim - y < len) ? dim - y : len;
+  if (to_line) {
+    memcpy(line + y, small, first*sizeof(fftw_complex));
+    memcpy(line, small + first, (len - first)*sizeof(fftw_complex));
+  } else {
+    memcpy(small, line + y, first*sizeof(fftw_complex));
+    memcpy(small + first, line, (len - first)*sizeof(fftw_complex));
+  }
+}
+
+/**
+ *  @brief Copy a disk between a big matrix and [0;0] of a thumbnail
+ *  @param[in] dim The dimension of the thumbnail
+ *  @param[in,out] small The thumbnail
+ *  @param[in,out] big The big matrix
+ *  @param[in] bigDim The dimension of the big matrix
+ *  @param[in] bigX The x coordinate of the center in the big matrix
+ *  @param[in] bigY The y coordinate of the center in the big matrix
+ *  @param[in] radius The radius of the disk
+ *  @param[in] to_big 1 To copy from small to big, 0 for the opposite
+ *  @return 1 If the radius is not adapted
+ *  @return 0 Otherwise
+ *
+ *  The same cells as copy_disk_ultimate are copied. Since the disk is
+ *  centered on [0;0] in the thumbnail, each of its lines is two
+ *  contiguous parts there: the end and the beginning of a line.
+ *
+ */
+static KERNELS_INLINE int kernels_disk_body(int dim, fftw_complex *small,
+                                            fftw_complex *big, int bigDim,
+                                            int bigX, int bigY, int radius,
+                                            int to_big) {
+  int minDim = (dim <= bigDim) ? dim : bigDim;
+  if (minDim <= 0 || radius <= 0 || radius > (minDim-1)/2)
+    return 1;
+
+  int y = matrix_cyclic(bigY, bigDim);
+  for (int dx = -(radius-1); dx <= radius-1; dx++) {
+    int width = radius-1 - abs(dx);
+    fftw_complex *line = small + (size_t) (dx < 0 ? dim+dx : dx)*dim;
+    fftw_complex *big_line = big +
+      (size_t) matrix_cyclic(bigX+dx, bigDim)*bigDim;
+
+    kernels_span(big_line, bigDim, matrix_cyclic(y-width, bigDim),
+                 line + dim - width, width, to_big);
+    kernels_span(big_line, bigDim, y, line, width+1, to_big);
+  }
+  return 0;
+}
+
+/**
+ *  @brief Define the kernels named with suffix, for the dimension DIM
+ *
+ *  DIM is either a constant or dim for the generic kernels.
+ *
+ */
+#define KERNELS_DEFINE(suffix, DIM)                                     \
+  CPU_DISPATCH                                                          \
+  static void kernels_clear_##suffix(int dim, fftw_complex *mat) {      \
+    (void) dim;                                                         \
+    kernels_clear_body(DIM, mat);                                       \
+  }                                                                     \
+  CPU_DISPATCH                                                          \
+  static void kernels_normalize_##suffix(int dim, fftw_complex *mat) {  \
+    (void) dim;                                                         \
+    kernels_normalize_body(DIM, mat);                                   \
+  }                                                                     \
+  CPU_DISPATCH                                                          \
+  static void kernels_project_##suffix(int dim, double *mod,            \
+                                       fftw_complex *mat) {             \
+    (void) dim;                                                         \
+    kernels_project_body(DIM, mod, mat);                                \
+  }                                                                     \
+  static int kernels_extract_##suffix(int dim, fftw_complex *big,       \
+                                      int bigDim, int bigX, int bigY,   \
+                                      int radius, fftw_complex *small) { \
+    (void) dim;                                                         \
+    return kernels_disk_body(DIM, small, big, bigDim, bigX, bigY,       \
+                             radius, 0);                                \
+  }                                                                     \
+  static int kernels_writeback_##suffix(int dim, fftw_complex *small,   \
+                                        fftw_complex *big, int bigDim,  \
+                                        int bigX, int bigY, int radius) { \
+    (void) dim;                                                         \
+    return kernels_disk_body(DIM, small, big, bigDim, bigX, bigY,       \
+                             radius, 1);                                \
+  }
+
+KERNELS_DEFINE(generic, dim)
+KERNELS_DEFINE(64, 64)
+KERNELS_DEFINE(100, 100)
+KERNELS_DEFINE(128, 128)
+KERNELS_DEFINE(256, 256)
+
+/**
+ *  @brief The kernels of a dimension, specialized or not
+ *
+ */
+#define KERNELS_ENTRY(suffix, DIM, specialized)                         \
+  {DIM, specialized, kernels_clear_##suffix, kernels_normalize_##suffix, \
+   kernels_project_##suffix, kernels_extract_##suffix,                  \
+   kernels_writeback_##suffix}
+
+/**
+ *  @brief The specialized kernels, the last ones are the generic ones
+ *
+ */
+static const struct kernels kernels_table[] = {
+  KERNELS_ENTRY(64, 64, 1),
+  KERNELS_ENTRY(100, 100, 1),
+  KERNELS_ENTRY(128, 128, 1),
+  KERNELS_ENTRY(256, 256, 1),
+  KERNELS_ENTRY(generic, 0, 0)
+};
+
+/**
+ *  @brief Choose the kernels for a thumbnail dimension
+ *  @param[out] kernels The chosen kernels
+ *  @param[in] dim The dimension of the thumbnails
+ *
+ *  The specialized kernels are chosen if there are some for dim,
+ *  the generic ones otherwise.
+ *
+ */
+void kernels_select(struct kernels *kernels, int dim) {
+  int nbr = sizeof(kernels_table)/sizeof(kernels_table[0]);
+  int i = 0;
+  while (i < nbr-1 && kernels_table[i].dim != dim)
+    i++;
+  *kernels = kernels_table[i];
+  kernels->dim = dim;
+}
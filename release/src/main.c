@@ -8,6 +8,18 @@
 
 #include "include/main.h"
 
+/** @brief The reconstruction stopped by SIGINT and SIGTERM */
+static struct swarm_ctx *main_ctx;
+
+/**
+ *  @brief Stop the reconstruction, the image of the laps done is written
+ *
+ */
+static void main_interrupt(int sig) {
+  (void) sig;
+  if (main_ctx)
+    swarm_cancel(main_ctx);
+}
 
 /**
  *  @brief Main function
@@ -35,90 +47,339 @@ int main(int argc, char **argv) {
 
   srand(time(NULL));
 
+  const char *trace_name = getenv(TRACE_ENV);
+  if (trace_name)
+    trace_start(TRACE_CAPACITY, omp_get_max_threads() + TRACE_BACKGROUND);
+
   fftw_complex *out;
+  fftw_complex *run_out;
   double **thumbnails;
-  fftw_complex *thumbnail_buf[2];
   char *name;
 
   double *out_io;
 
-  fftw_plan forward;
   fftw_plan backward;
 
+  struct pool pool;
+  struct swarm_ctx ctx;
+  struct snapshot snap;
+  struct snapshot preview;
+
+  struct tune tune;
+  const char *wisdom = getenv(WISDOM_ENV);
+
+  struct tiles tiles;
+  const char *tiles_name = getenv(TILES_ENV);
+  int sparse = !tiles_name && getenv(SPARSE_ENV);
+  int sparse_nbr = 0;
+  int blocked = !tiles_name && !sparse && getenv(BLOCKED_ENV);
+
+  struct stream stream;
+  struct stream_tiff frames;
+  frames.pattern = (!tiles_name && !sparse && !blocked) ?
+    getenv(STREAM_ENV) : NULL;
+  frames.jorga = jorga_x;
+
+  struct feed feed;
+  const char *watch_dir = frames.pattern ? NULL : getenv(WATCH_ENV);
+
+  const char *snapshot_every = getenv(SNAPSHOT_ENV);
+  int every_leds = (snapshot_every && !tiles_name && !sparse && !blocked) ?
+    atoi(snapshot_every) : 0;
+  const char *preview_env = getenv(PREVIEW_ENV);
+  int preview_dim = (preview_env && !tiles_name && !sparse && !blocked) ?
+    atoi(preview_env) : 0;
+  if (preview_dim > out_dim)
+    preview_dim = out_dim;
+
+  int thumbnail_nbr = (2*jorga_x+1)*(2*jorga_y+1);
+  int name_size = strlen("build/swarm_with_jnn_dnn_rnn.tiff")+1;
+
   fftw_init_threads();
   fftw_plan_with_nthreads(omp_get_max_threads());
 
-  out = (fftw_complex*) fftw_malloc(out_dim * out_dim *
-                                    sizeof(fftw_complex));
-  thumbnail_buf[0] = (fftw_complex*) fftw_malloc(th_dim * th_dim *
-                                                 sizeof(fftw_complex));
-  thumbnail_buf[1] = (fftw_complex*) fftw_malloc(th_dim * th_dim *
-                                                 sizeof(fftw_complex));
+  /* before any page is touched, and before measuring the plans */
+  const char *affinity = getenv(AFFINITY_ENV);
+  if (affinity) {
+    int policy = affinity_parse(affinity);
+    if (policy < 0 || affinity_pin(policy))
+      fprintf(stderr, "Could not place the threads with %s\n", affinity);
+  }
+
+  size_t out_size, io_size;
+  if (matrix_size(out_dim, out_dim, sizeof(fftw_complex), &out_size) ||
+      matrix_size(out_dim, out_dim, sizeof(double), &io_size)) {
+    fprintf(stderr, "The image is too big\n");
+    return 1;
+  }
 
-  thumbnails = (double**) malloc((2*jorga_x+1)*(2*jorga_y+1)*
-                                 sizeof(double*));
-  for (int i = 0; i < (2*jorga_x+1)*(2*jorga_y+1); i++)
-    thumbnails[i] = (double*) fftw_malloc(th_dim * th_dim *
-                                          sizeof(double));
+  /* the final transform is not planned with an out-of-core spectrum */
+  tune_init(&tune);
+  if (wisdom) {
+    int measured = 0;
+    tune_load(&tune, wisdom);
+    if (!tune_find(&tune, th_dim))
+      measured |= !tune_measure(&tune, th_dim, omp_get_max_threads());
+    if (!tiles_name && !tune_find(&tune, out_dim))
+      measured |= !tune_measure(&tune, out_dim, omp_get_max_threads());
+    if (measured && tune_save(&tune, wisdom))
+      fprintf(stderr, "Could not save the wisdom in %s\n", wisdom);
+  }
 
-  name = (char*) malloc(sizeof(char)*(strlen("build/xxxxxyyyyy.tiff")+1));
-  out_io = (double*) malloc(out_dim * out_dim * sizeof(double));
+  if (sparse) {
+    sparse_nbr = tiles_sparse_count(out_dim, TILES_SIDE, delta_x, radius,
+                                    jorga_x);
+    if (sparse_nbr < 0) {
+      fprintf(stderr, "Incompatible parameters\n");
+      return 1;
+    }
+  }
 
-  forward = fftw_plan_dft_2d(out_dim, out_dim, out, out,
-                             FFTW_FORWARD, FFTW_ESTIMATE);
-  backward = fftw_plan_dft_2d(th_dim, th_dim, thumbnail_buf[1],
-                              thumbnail_buf[0], FFTW_BACKWARD, FFTW_ESTIMATE);
+  /* every buffer is taken from one pool, allocated once */
+  size_t pool_size = (sparse ?
+                      tiles_sparse_pool_size(out_dim, TILES_SIDE,
+                                             sparse_nbr) : 0) +
+    (blocked ? tiles_blocked_pool_size(out_dim, TILES_SIDE) : 0) +
+    (tiles_name ?
+     tiles_pool_size(out_dim, TILES_SIDE, TILES_RESIDENT) :
+     pool_round(out_size) + pool_round(io_size)) +
+    pool_round(thumbnail_nbr * sizeof(double*)) +
+    thumbnail_nbr * pool_round((size_t) th_dim * th_dim * sizeof(double)) +
+    pool_round(name_size * sizeof(char)) +
+    swarm_pool_size(th_dim, out_dim, radius) +
+    (frames.pattern ?
+     stream_pool_size(th_dim, out_dim, jorga_x, STREAM_SLOTS) : 0) +
+    (watch_dir ? feed_pool_size(jorga_x) : 0) +
+    (every_leds > 0 ?
+     snapshot_pool_size(out_dim, th_dim, SNAPSHOT_SLOTS) : 0) +
+    (preview_dim > 0 ?
+     snapshot_pool_size(preview_dim, 0, PREVIEW_SLOTS) : 0);
+  if (getenv(HUGEPAGES_ENV) ? pool_init_huge(&pool, pool_size) :
+      pool_init(&pool, pool_size)) {
+    fprintf(stderr, "Could not allocate memory\n");
+    return 1;
+  }
 
-  for (int i=0; i < out_dim*out_dim; i++) {
-    (out[i])[0] = 0;
-    (out[i])[1] = 0;
-    out_io[i] = 0;
+  out = NULL;
+  out_io = NULL;
+  if (tiles_name) {
+    if (tiles_open(&tiles, &pool, tiles_name, out_dim, TILES_SIDE,
+                   TILES_RESIDENT)) {
+      fprintf(stderr, "Could not create the spectrum in %s\n", tiles_name);
+      pool_destroy(&pool);
+      return 1;
+    }
+  } else {
+    out = (fftw_complex*) pool_alloc(&pool, out_size);
+    out_io = (double*) pool_alloc(&pool, io_size);
+    if ((sparse && tiles_sparse(&tiles, &pool, out_dim, TILES_SIDE,
+                                sparse_nbr)) ||
+        (blocked && tiles_blocked(&tiles, &pool, out_dim, TILES_SIDE))) {
+      fprintf(stderr, "Could not allocate memory\n");
+      pool_destroy(&pool);
+      return 1;
+    }
   }
+  thumbnails = (double**) pool_alloc(&pool, thumbnail_nbr * sizeof(double*));
+  for (int i = 0; i < thumbnail_nbr; i++)
+    thumbnails[i] = (double*) pool_alloc(&pool, (size_t) th_dim * th_dim *
+                                         sizeof(double));
+  name = (char*) pool_alloc(&pool, name_size * sizeof(char));
 
-  for (int i = 0; i < (2*jorga_x+1)*(2*jorga_y+1); i++)
+  if (swarm_init(&ctx, &pool, th_dim, out_dim, delta_x, radius, jorga_x)) {
+    fprintf(stderr, "Incompatible parameters\n");
+    if (tiles_name)
+      tiles_close(&tiles);
+    pool_destroy(&pool);
+    return 1;
+  }
+  if (wisdom && swarm_replan(&ctx, tune_plan(&tune, th_dim)))
+    fprintf(stderr, "Could not make the tuned plans\n");
+  /* with tiles, out is only used after the reconstruction */
+  run_out = out;
+  if (tiles_name || sparse || blocked) {
+    ctx.tiles = &tiles;
+    run_out = NULL;
+  }
+
+  if (every_leds > 0 &&
+      snapshot_init(&snap, &pool, out_dim, th_dim, SNAPSHOT_SLOTS,
+                    every_leds, 1) == 0)
+    ctx.snap = &snap;
+
+  if (preview_dim > 0 &&
+      snapshot_init(&preview, &pool, preview_dim, 0, PREVIEW_SLOTS,
+                    0, 0) == 0) {
+    if (snapshot_preview(&preview))
+      snapshot_destroy(&preview);
+    else
+      ctx.preview = &preview;
+  }
+
+  /* the first touch places each page on the node of the thread which
+   * works on it in the later kernels (same static schedule) */
+  if (run_out) {
+    matrix_init(out_dim, out, 0);
+    #pragma omp parallel for simd schedule(static) \
+      if (out_dim >= MATRIX_PARALLEL_DIM)
+    for (size_t i = 0; i < (size_t) out_dim*out_dim; i++)
+      out_io[i] = 0;
+  }
+
+  backward = NULL;
+  if (out) {
+    unsigned flags = tune_plan(&tune, out_dim);
+    backward = fftw_plan_dft_2d(out_dim, out_dim, out, out, FFTW_BACKWARD,
+                                flags);
+    /* FFTW_MEASURE writes in out */
+    if (run_out && flags != FFTW_ESTIMATE)
+      matrix_init(out_dim, out, 0);
+  }
+
+  for (int i = 0; i < thumbnail_nbr; i++)
     for (int j = 0; j < th_dim*th_dim ; j++)
       ((thumbnails[i])[j]) = 0;
 
-  int name_size;
-  name_size = strlen("build/swarm_with_jorga_eq_nn.tiff")+1;
-  free(name);
-  name = (char*) malloc(sizeof(char)*name_size);
-  backward = fftw_plan_dft_2d(out_dim, out_dim, out, out,
-                              FFTW_BACKWARD, FFTW_ESTIMATE);
+  ctx.checkpoint = run_out ? getenv(CHECKPOINT_ENV) : NULL;
+  if (ctx.checkpoint && swarm_resume(&ctx, ctx.checkpoint, out) == 0)
+    printf("Resuming from lap %d of %s\n", ctx.first_lap, ctx.checkpoint);
 
-  for (int i = 0; i < out_dim * out_dim; i++)
-    (out[i])[0] = (out[i])[1] = 0;
+  const char *warm_name = run_out ? getenv(WARM_ENV) : NULL;
+  if (warm_name && ctx.first_lap == 0 &&
+      swarm_warm(&ctx, warm_name, out)) {
+    fprintf(stderr, "Could not start from %s\n", warm_name);
+    matrix_init(out_dim, out, 0);
+  }
 
-  swarm(thumbnails, th_dim, out_dim,
-        delta_x, lap_nbr, radius, jorga_x, out);
+  const char *tolerance = getenv(TOLERANCE_ENV);
+  if (tolerance)
+    ctx.tolerance = atof(tolerance);
 
-  fftw_execute(backward);
-  div_dim(out, out, out_dim);
+  const char *budget = getenv(BUDGET_ENV);
+  if (budget)
+    ctx.budget_ms = atof(budget);
 
-  for (int i = 0; i < out_dim * out_dim; i++) {
-    alg2exp(out[i], out[i]);
-    out_io[i] = (out[i])[0];
+  /* the thumbnails of a stack are used in place, without any copy */
+  struct stack stack;
+  const char *stack_name = getenv(STACK_ENV);
+  if (stack_name) {
+    if (stack_map(stack_name, &stack)) {
+      fprintf(stderr, "Could not map the stack %s\n", stack_name);
+      stack_name = NULL;
+    } else if (stack.header.diml != th_dim || stack.header.dimw != th_dim ||
+               stack.header.jorga != jorga_x) {
+      fprintf(stderr, "The stack %s does not match the parameters\n",
+              stack_name);
+      stack_unmap(&stack);
+      stack_name = NULL;
+    } else {
+      thumbnails = stack.planes;
+    }
   }
 
+  main_ctx = &ctx;
+  signal(SIGINT, main_interrupt);
+  signal(SIGTERM, main_interrupt);
+  if (frames.pattern) {
+    /* the frames are written by the pipeline, not the final image */
+    if (stream_init(&stream, &pool, &ctx, STREAM_SLOTS, lap_nbr,
+                    stream_load_tiff, &frames, "build/frame_%.4d.tiff")) {
+      fprintf(stderr, "Could not prepare the frames of %s\n",
+              frames.pattern);
+    } else {
+      stream.warm = ctx.tolerance > 0;
+      int ret = stream_run(&stream, 0);
+      if (ret == 2)
+        printf("Cancelled after %d frames\n", stream.written);
+      else if (ret)
+        fprintf(stderr, "Could not reconstruct the frames of %s\n",
+                frames.pattern);
+      stream_report(&stream, stdout);
+      stream_destroy(&stream);
+    }
+  } else {
+    /* the first lap follows the acquisition */
+    if (watch_dir && !stack_name) {
+      if (feed_init(&feed, &pool, jorga_x)) {
+        fprintf(stderr, "Could not watch %s\n", watch_dir);
+      } else if (feed_watch(&feed, watch_dir, thumbnails, th_dim,
+                            WATCH_TIMEOUT_MS)) {
+        fprintf(stderr, "Could not watch %s\n", watch_dir);
+        feed_destroy(&feed);
+      } else {
+        ctx.feed = &feed;
+      }
+    }
+    if (swarm_run(&ctx, thumbnails, lap_nbr, run_out) == 5)
+      printf("Cancelled in lap %d after %d leds\n", ctx.progress.lap,
+             ctx.progress.led);
+    if (ctx.feed) {
+      feed_unwatch(&feed);
+      feed_destroy(&feed);
+      if (ctx.missing)
+        fprintf(stderr, "%d leds without thumbnail in %s\n", ctx.missing,
+                watch_dir);
+    }
+    if (ctx.tolerance > 0)
+      printf("%d laps, residual %g\n", ctx.laps, ctx.residual);
+    if (ctx.budget_ms > 0)
+      printf("%d laps, %d leds, %g ms per led%s\n", ctx.laps, ctx.leds,
+             ctx.led_ms, ctx.expired ? ", budget reached" : "");
+  }
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  main_ctx = NULL;
+
+  if (stack_name)
+    stack_unmap(&stack);
+
+  if (ctx.snap) {
+    snapshot_destroy(&snap);
+    if (snap.dropped)
+      fprintf(stderr, "%d snapshots dropped\n", snap.dropped);
+  }
+  if (ctx.preview)
+    snapshot_destroy(&preview);
+
   snprintf(name, name_size,
            "build/swarm_with_j%.2d_d%.2d_r%.2d.tiff",
            jorga_x, delta_x, radius);
-  tiff_frommatrix(name, out_io, out_dim, out_dim);
-  fftw_destroy_plan(forward);
-  fftw_destroy_plan(backward);
 
-  free(out_io);
-  free(name);
+  if (frames.pattern) {
+    fftw_destroy_plan(backward);
+  } else if (tiles_name) {
+    /* the image is computed and written without being in memory */
+    if (tiles_fft(&tiles, FFTW_BACKWARD) || tiles_tiff(&tiles, name))
+      fprintf(stderr, "Could not compute the image from %s\n", tiles_name);
+    tiles_close(&tiles);
+  } else {
+    if (sparse || blocked) {
+      if (tiles_densify(&tiles, out))
+        fprintf(stderr, "Could not densify the spectrum\n");
+      tiles_close(&tiles);
+    }
 
-  for (int i = 0; i < (2*jorga_x+1)*(2*jorga_y+1); i++)
-    free(thumbnails[i]);
-  free(thumbnails);
+    TRACE_BEGIN("fft_out");
+    fftw_execute(backward);
+    TRACE_END("fft_out");
+    div_dim(out, out, out_dim);
 
-  fftw_free(thumbnail_buf[0]);
-  fftw_free(thumbnail_buf[1]);
+    matrix_magnitude(out_dim, out, out_io);
 
-  fftw_free(out);
+    tiff_frommatrix(name, out_io, out_dim, out_dim);
+
+    fftw_destroy_plan(backward);
+  }
+  swarm_destroy(&ctx);
+  pool_destroy(&pool);
   fftw_cleanup_threads();
 
+  if (trace_name) {
+    trace_stop();
+    if (trace_dump(trace_name))
+      fprintf(stderr, "Could not write the trace in %s\n", trace_name);
+    trace_free();
+  }
+
   return 0;
 }
@@ -9,13 +9,38 @@
 
 #include "include/matrix.h"
 #include "include/benchmark.h"
+#include "include/cpu.h"
+
+/**
+ *  @brief Compute the size in bytes of a matrix
+ *  @param[in] diml The number of lines
+ *  @param[in] dimw The number of columns
+ *  @param[in] elem The size of an element
+ *  @param[out] size The number of bytes of the matrix
+ *  @return 1 If a dimension is negative or the size overflows
+ *  @return 0 Otherwise
+ *
+ *  To be used before allocating a matrix, dims above 46340 overflow
+ *  an int.
+ *
+ */
+int matrix_size(int diml, int dimw, size_t elem, size_t *size) {
+  size_t count;
+  if (diml < 0 || dimw < 0 ||
+      __builtin_mul_overflow((size_t) diml, (size_t) dimw, &count) ||
+      __builtin_mul_overflow(count, elem, size))
+    return 1;
+  return 0;
+}
 
 /**
  *  @brief A function to copy a fftw_complex matrix
  *
  */
 void matrix_copy(fftw_complex *in, fftw_complex *out, int dim) {
-  for (int i = 0; i < dim*dim; i++) {
+  size_t size = (size_t) dim*dim;
+  #pragma omp parallel for simd if (dim >= MATRIX_PARALLEL_DIM)
+  for (size_t i = 0; i < size; i++) {
     out[i][0] = in[i][0];
     out[i][1] = in[i][1];
   }
@@ -27,7 +52,9 @@ void matrix_copy(fftw_complex *in, fftw_complex *out, int dim) {
  *
  */
 void div_dim(fftw_complex *in, fftw_complex *out, int dim) {
-  for (int i = 0; i < dim*dim; i++) {
+  size_t size = (size_t) dim*dim;
+  #pragma omp parallel for simd if (dim >= MATRIX_PARALLEL_DIM)
+  for (size_t i = 0; i < size; i++) {
     out[i][0] = in[i][0]/dim;
     out[i][1] = in[i][1]/dim;
   }
@@ -55,9 +82,17 @@ int matrix_cyclic(int ind, int dim) {
  *
  *  This function initializes a matrix with a value in complexity O(n^{2})
  *
+ *  Big matrices are written by all the threads, each one a contiguous
+ *  part (static schedule, the default one of the other kernels): used
+ *  on fresh memory, each page lands on the memory node of the thread
+ *  which will work on it.
+ *
  */
 void matrix_init(int dim, fftw_complex *mat, double value) {
-  for (int i=0; i < dim*dim; i++) {
+  size_t size = (size_t) dim*dim;
+  #pragma omp parallel for simd schedule(static) \
+    if (dim >= MATRIX_PARALLEL_DIM)
+  for (size_t i = 0; i < size; i++) {
     (mat[i])[0] = value;
     (mat[i])[1] = value;
   }
@@ -79,8 +114,9 @@ void matrix_random(int dim, fftw_complex *mat, int max_rand) {
 
   for (int i=0; i < dim; i++)
     for (int j=0; j < dim; j++) {
-      (mat[i*dim+j])[0] = rand() % max_rand; /* NOLINT(runtime/threadsafe_fn) */
-      (mat[i*dim+j])[1] = 0;
+      size_t ij = (size_t) i*dim+j;
+      (mat[ij])[0] = rand() % max_rand; /* NOLINT(runtime/threadsafe_fn) */
+      (mat[ij])[1] = 0;
     }
 }
 
@@ -96,7 +132,8 @@ void matrix_random(int dim, fftw_complex *mat, int max_rand) {
 void matrix_print(int dim, fftw_complex *mat) {
   for (int i=0; i < dim; i++) {
     for (int j=0; j < dim; j++)
-      printf("%7.1f;%7.1f  ", (mat[i*dim+j])[0], (mat[i*dim+j])[1]);
+      printf("%7.1f;%7.1f  ", (mat[(size_t) i*dim+j])[0],
+             (mat[(size_t) i*dim+j])[1]);
     printf("\n");
   }
   printf("\n");
@@ -110,6 +147,7 @@ void matrix_print(int dim, fftw_complex *mat) {
  *  This function takes an algebraic complex number a+ib,
  *  stored in the in parameter,
  *  and computes the module and argument, returned in the out parameter.
+ *  The argument is in [-pi;pi], its sign is the sign of b.
  *
  *  in and out parameters can be the same memory address.
  *
@@ -117,11 +155,7 @@ void matrix_print(int dim, fftw_complex *mat) {
 void alg2exp(fftw_complex in, fftw_complex out) {
   fftw_complex tmp;
   tmp[0] = sqrt(in[0]*in[0] + in[1]*in[1]);
-  if (tmp[0] == 0) {
-    tmp[1] = 0;
-  } else {
-    tmp[1] = acos(in[0]/tmp[0]);
-  }
+  tmp[1] = atan2(in[1], in[0]);
   out[0] = tmp[0];
   out[1] = tmp[1];
 }
@@ -157,11 +191,214 @@ void exp2alg(fftw_complex in, fftw_complex out) {
  */
 void matrix_realpart(int dim, fftw_complex *complex_matrix,
                      double *real_matrix) {
-  for (int i=0; i < dim*dim; i++) {
+  size_t size = (size_t) dim*dim;
+  #pragma omp parallel for simd if (dim >= MATRIX_PARALLEL_DIM)
+  for (size_t i = 0; i < size; i++) {
     real_matrix[i] = (complex_matrix[i])[0];
   }
 }
 
+/**
+ *  @brief Get the module of every element of a matrix
+ *  @param[in] dim The dimension of both matrices
+ *  @param[in] in The fftw_complex matrix
+ *  @param[out] out The double matrix of modules
+ *
+ *  Same as alg2exp followed by matrix_realpart, without the argument.
+ *
+ */
+CPU_DISPATCH
+void matrix_magnitude(int dim, fftw_complex *in, double *out) {
+  size_t size = (size_t) dim*dim;
+  #pragma omp parallel for simd if (dim >= MATRIX_PARALLEL_DIM)
+  for (size_t i = 0; i < size; i++)
+    out[i] = sqrt(in[i][0]*in[i][0] + in[i][1]*in[i][1]);
+}
+
+/**
+ *  @brief Get the argument of every element of a matrix
+ *  @param[in] dim The dimension of both matrices
+ *  @param[in] in The fftw_complex matrix
+ *  @param[out] out The double matrix of arguments, in [-pi;pi]
+ *
+ *  atan2 is a call to the libm, so the loop is not vectorized, see
+ *  matrix_phase_fast.
+ *
+ */
+CPU_DISPATCH
+void matrix_phase(int dim, fftw_complex *in, double *out) {
+  size_t size = (size_t) dim*dim;
+  #pragma omp parallel for simd if (dim >= MATRIX_PARALLEL_DIM)
+  for (size_t i = 0; i < size; i++)
+    out[i] = atan2(in[i][1], in[i][0]);
+}
+
+/**
+ *  @brief Approximate the argument of a complex
+ *  @param[in] y The imaginary part
+ *  @param[in] x The real part
+ *  @return double The argument, within MATRIX_PHASE_ERROR of atan2(y, x)
+ *
+ *  The arctangent of the smallest ratio (in [0;1]) is a polynomial
+ *  (Abramowitz and Stegun 4.4.49), then the octant is restored
+ *  without any branch, so that loops using it can be vectorized.
+ *
+ */
+#pragma omp declare simd
+static double matrix_atan2_fast(double y, double x) {
+  double ax = fabs(x);
+  double ay = fabs(y);
+  double big = ax > ay ? ax : ay;
+  double t = big == 0 ? 0 : (ax > ay ? ay : ax)/big;
+  double t2 = t*t;
+  double a = t*(0.9998660 + t2*(-0.3302995 + t2*(0.1801410 +
+                t2*(-0.0851330 + t2*0.0208351))));
+  a = ay > ax ? M_PI_2 - a : a;
+  a = x < 0 ? M_PI - a : a;
+  return y < 0 ? -a : a;
+}
+
+/**
+ *  @brief Approximate the argument of every element of a matrix
+ *  @param[in] dim The dimension of both matrices
+ *  @param[in] in The fftw_complex matrix
+ *  @param[out] out The double matrix of arguments, in [-pi;pi]
+ *
+ *  Faster than matrix_phase, the error is at most MATRIX_PHASE_ERROR.
+ *  To be used for displaying, not in the reconstruction.
+ *
+ */
+CPU_DISPATCH
+void matrix_phase_fast(int dim, fftw_complex *in, double *out) {
+  size_t size = (size_t) dim*dim;
+  #pragma omp parallel for simd if (dim >= MATRIX_PARALLEL_DIM)
+  for (size_t i = 0; i < size; i++)
+    out[i] = matrix_atan2_fast(in[i][1], in[i][0]);
+}
+
+/**
+ *  @brief Build a matrix from modules and arguments
+ *  @param[in] dim The dimension of the matrices
+ *  @param[in] mod The double matrix of modules
+ *  @param[in] arg The double matrix of arguments
+ *  @param[out] out The fftw_complex matrix
+ *
+ *  Same as exp2alg on every element. cos and sin are calls to the
+ *  libm, so the loop is not vectorized, see matrix_polar_fast.
+ *
+ */
+CPU_DISPATCH
+void matrix_polar(int dim, double *mod, double *arg, fftw_complex *out) {
+  size_t size = (size_t) dim*dim;
+  #pragma omp parallel for simd if (dim >= MATRIX_PARALLEL_DIM)
+  for (size_t i = 0; i < size; i++) {
+    out[i][0] = mod[i]*cos(arg[i]);
+    out[i][1] = mod[i]*sin(arg[i]);
+  }
+}
+
+/**
+ *  @brief Approximate the sine or the cosine of an angle
+ *  @param[in] x The angle in radians, in [-pi;pi] for the error bound
+ *  @param[in] shift 0 for the sine, 1 for the cosine
+ *  @return double The sine or cosine, within MATRIX_POLAR_ERROR
+ *
+ *  x is reduced to [-pi/4;pi/4] by a multiple k of pi/2 (in two parts,
+ *  so that the reduction is exact), then both Taylor polynomials are
+ *  computed and the quadrant k+shift picks one of them and its sign,
+ *  without any branch, so that loops using it can be vectorized.
+ *
+ */
+#pragma omp declare simd uniform(shift)
+static double matrix_sin_fast(double x, int shift) {
+  /* rounded to the nearest integer by the addition, without any call */
+  double k = (x*M_2_PI + 6755399441055744.0) - 6755399441055744.0;
+  double r = (x - k*1.57079632673412561417e+00) -
+    k*6.07710050650619224932e-11;
+  double r2 = r*r;
+  double sin_r = r*(1 + r2*(-1./6 + r2*(1./120 + r2*(-1./5040 +
+                   r2*(1./362880 + r2*(-1./39916800))))));
+  double cos_r = 1 + r2*(-1./2 + r2*(1./24 + r2*(-1./720 +
+                   r2*(1./40320 + r2*(-1./3628800 + r2/479001600)))));
+  int quadrant = ((int) k + shift) & 3;
+  double v = quadrant & 1 ? cos_r : sin_r;
+  return quadrant & 2 ? -v : v;
+}
+
+/**
+ *  @brief Approximate matrix_polar
+ *  @param[in] dim The dimension of the matrices
+ *  @param[in] mod The double matrix of modules
+ *  @param[in] arg The double matrix of arguments, in [-pi;pi]
+ *  @param[out] out The fftw_complex matrix
+ *
+ *  Unlike matrix_polar, which calls cos and sin of the libm on each
+ *  element, this one is vectorized: the error of each part is at most
+ *  MATRIX_POLAR_ERROR times the module.
+ *
+ */
+CPU_DISPATCH
+void matrix_polar_fast(int dim, double *mod, double *arg,
+                       fftw_complex *out) {
+  size_t size = (size_t) dim*dim;
+  #pragma omp parallel for simd if (dim >= MATRIX_PARALLEL_DIM)
+  for (size_t i = 0; i < size; i++) {
+    out[i][0] = mod[i]*matrix_sin_fast(arg[i], 1);
+    out[i][1] = mod[i]*matrix_sin_fast(arg[i], 0);
+  }
+}
+
+/**
+ *  @brief Replace the module of every element, keeping the argument
+ *  @param[in] dim The dimension of the matrices
+ *  @param[in] mod The double matrix of new modules
+ *  @param[in,out] mat The fftw_complex matrix to change
+ *
+ *  Same as alg2exp, then setting the module, then exp2alg, but each
+ *  element is only scaled by mod/|mat|, without any trigonometry.
+ *  A zero element gets the argument 0, as with alg2exp.
+ *
+ */
+CPU_DISPATCH
+void matrix_project(int dim, double *mod, fftw_complex *mat) {
+  size_t size = (size_t) dim*dim;
+  #pragma omp parallel for simd if (dim >= MATRIX_PARALLEL_DIM)
+  for (size_t i = 0; i < size; i++) {
+    double norm = sqrt(mat[i][0]*mat[i][0] + mat[i][1]*mat[i][1]);
+    double scale = norm == 0 ? 0 : mod[i]/norm;
+    mat[i][0] = norm == 0 ? mod[i] : mat[i][0]*scale;
+    mat[i][1] = mat[i][1]*scale;
+  }
+}
+
+/**
+ *  @brief Get how far the modules of a matrix are from the expected ones
+ *  @param[in] dim The dimension of the matrices
+ *  @param[in] mod The double matrix of expected modules
+ *  @param[in] mat The fftw_complex matrix
+ *  @param[out] norm The sum of the squares of mod
+ *  @return double The sum of the squares of |mat|-mod
+ *
+ *  The ratio of both is the error that matrix_project removes.
+ *
+ */
+CPU_DISPATCH
+double matrix_residual(int dim, double *mod, fftw_complex *mat,
+                       double *norm) {
+  size_t size = (size_t) dim*dim;
+  double error = 0;
+  double energy = 0;
+  #pragma omp parallel for simd reduction(+:error, energy) \
+    if (dim >= MATRIX_PARALLEL_DIM)
+  for (size_t i = 0; i < size; i++) {
+    double diff = sqrt(mat[i][0]*mat[i][0] + mat[i][1]*mat[i][1]) - mod[i];
+    error += diff*diff;
+    energy += mod[i]*mod[i];
+  }
+  *norm = energy;
+  return error;
+}
+
 /**
  *  @brief Get the maximum of a matrix
  *  @param[in] diml The length of the matrix
@@ -169,13 +406,17 @@ void matrix_realpart(int dim, fftw_complex *complex_matrix,
  *  @param[in] matrix The matrix to work on
  *  @return int The maximum of the matrix
  *
+ *  Every element is compared, including the first column.
+ *
  */
+CPU_DISPATCH
 double matrix_max(int diml, int dimw, double *matrix) {
+  size_t size = (size_t) diml*dimw;
   double max = matrix[0];
-  for (int i=0; i < diml; i++)
-    for (int j=1; j < dimw; j++)
-      if (matrix[i*dimw+j] > max)
-        max = matrix[i*dimw+j];
+  #pragma omp parallel for simd reduction(max:max) \
+    if (diml >= MATRIX_PARALLEL_DIM)
+  for (size_t i = 0; i < size; i++)
+    max = matrix[i] > max ? matrix[i] : max;
   return max;
 }
 
@@ -186,16 +427,56 @@ double matrix_max(int diml, int dimw, double *matrix) {
  *  @param[in] matrix The matrix to work on
  *  @return int The minimum of the matrix
  *
+ *  Every element is compared, including the first column.
+ *
  */
+CPU_DISPATCH
 double matrix_min(int diml, int dimw, double *matrix) {
+  size_t size = (size_t) diml*dimw;
   double min = matrix[0];
-  for (int i=0; i < diml; i++)
-    for (int j=1; j < dimw; j++)
-      if (matrix[i*dimw+j] < min)
-        min = matrix[i*dimw+j];
+  #pragma omp parallel for simd reduction(min:min) \
+    if (diml >= MATRIX_PARALLEL_DIM)
+  for (size_t i = 0; i < size; i++)
+    min = matrix[i] < min ? matrix[i] : min;
   return min;
 }
 
+/**
+ *  @brief Copy a part of a line, folded in both lines
+ *  @param[in] in The input line
+ *  @param[in] dimIn The length of the input line
+ *  @param[in] inY The first column in the input line, in [0;dimIn[
+ *  @param[out] out The output line
+ *  @param[in] dimOut The length of the output line
+ *  @param[in] outY The first column in the output line, in [0;dimOut[
+ *  @param[in] len The number of elements, at most min(dimIn, dimOut)
+ *
+ *  The part is split at the wrap boundaries of both lines, the
+ *  contiguous segments (at most three) are copied with memcpy.
+ *
+ */
+static void matrix_copy_span(fftw_complex *in, int dimIn, int inY,
+                             fftw_complex *out, int dimOut, int outY,
+                             int len) {
+  while (len > 0) {
+    int chunk = len;
+    if (chunk > dimIn - inY)
+      chunk = dimIn - inY;
+    if (chunk > dimOut - outY)
+      chunk = dimOut - outY;
+
+    memcpy(out + outY, in + inY, chunk*sizeof(fftw_complex));
+
+    len -= chunk;
+    inY += chunk;
+    outY += chunk;
+    if (inY == dimIn)
+      inY = 0;
+    if (outY == dimOut)
+      outY = 0;
+  }
+}
+
 /**
  *  @brief Extract a little part of a matrix from a bigger one
  *
@@ -208,69 +489,44 @@ int matrix_extract(int smallDim, int bigDim, fftw_complex* small,
   if (smallDim > bigDim) {
     return 1;
   } else {
+    int Y = matrix_cyclic(offY, bigDim);
     for (int i = 0; i < smallDim; i++) {
-      for (int j = 0; j < smallDim; j++) {
-        int X = matrix_cyclic(i+offX, bigDim);
-        int Y = matrix_cyclic(j+offY, bigDim);
-
-        (small[i*smallDim+j])[0] = (big[X*bigDim+Y])[0];
-        (small[i*smallDim+j])[1] = (big[X*bigDim+Y])[1];
-      }
+      int X = matrix_cyclic(i+offX, bigDim);
+      matrix_copy_span(big + (size_t) X*bigDim, bigDim, Y,
+                       small + (size_t) i*smallDim, smallDim, 0, smallDim);
     }
     return 0;
   }
 }
 
 /**
- *  @brief Compute the von_neumann
- *  @param[in] x The line on which the function is applied
- *  @param[in] y The column on which the function is applied
+ *  @brief Copy a disk between two matrices of the same dimension
+ *  @param[in] x The line of the center of the disk
+ *  @param[in] y The column of the center of the disk
  *  @param[in] radius The radius of the disk, see below
- *  @param[in,out] mat The reference matrix used to remember the previous states
  *  @param[in] dim The dimension of the matrix
  *  @param[in] in The matrix in which to cut a disk
  *  @param[out] out The matrix in which is stored the result
  *
- *  This function is a recursive function spanning from the center of disk
- *  (initial call with right x and y values) to its border by decreasing
- *  radius by one each time it is called.
- *  In fact it copies the part which is in the disk to the output matrix.
+ *  The cells at a taxicab distance of at most radius from [x;y] are
+ *  copied at the same place, the disk folds on the sides.
+ *  Each line of the disk is copied in at most two segments.
  *
  */
-void von_neumann(int x, int y, int radius, int *mat, int dim,
+void von_neumann(int x, int y, int radius, int dim,
                  fftw_complex *in, fftw_complex *out) {
-  if (radius < 0)
-    return;
+  for (int dx = -radius; dx <= radius; dx++) {
+    int width = radius - abs(dx);
+    int len = (2*width+1 < dim) ? 2*width+1 : dim;
+    size_t line = (size_t) matrix_cyclic(x+dx, dim)*dim;
+    int Y = matrix_cyclic(y-width, dim);
 
-  (out[matrix_cyclic(x, dim)*dim+matrix_cyclic(y, dim)])[0] =
-    (in[matrix_cyclic(x, dim)*dim+matrix_cyclic(y, dim)])[0];
-  (out[matrix_cyclic(x, dim)*dim+matrix_cyclic(y, dim)])[1] =
-    (in[matrix_cyclic(x, dim)*dim+matrix_cyclic(y, dim)])[1];
-
-  if (mat[matrix_cyclic(x+1, dim)*dim+matrix_cyclic(y, dim)] < radius) {
-    mat[matrix_cyclic(x+1, dim)*dim+matrix_cyclic(y, dim)] = radius;
-    von_neumann(matrix_cyclic(x+1, dim), matrix_cyclic(y, dim), radius-1, mat,
-                dim, in, out);
-  }
-  if (mat[matrix_cyclic(x-1, dim)*dim+matrix_cyclic(y, dim)] < radius) {
-    mat[matrix_cyclic(x-1, dim)*dim+matrix_cyclic(y, dim)] = radius;
-    von_neumann(matrix_cyclic(x-1, dim), matrix_cyclic(y, dim), radius-1, mat,
-                dim, in, out);
-  }
-  if (mat[matrix_cyclic(x, dim)*dim+matrix_cyclic(y+1, dim)] < radius) {
-    mat[matrix_cyclic(x, dim)*dim+matrix_cyclic(y+1, dim)] = radius;
-    von_neumann(matrix_cyclic(x, dim), matrix_cyclic(y+1, dim), radius-1, mat,
-                dim, in, out);
-  }
-  if (mat[matrix_cyclic(x, dim)*dim+matrix_cyclic(y-1, dim)] < radius) {
-    mat[matrix_cyclic(x, dim)*dim+matrix_cyclic(y-1, dim)] = radius;
-    von_neumann(matrix_cyclic(x, dim), matrix_cyclic(y-1, dim), radius-1, mat,
-                dim, in, out);
+    matrix_copy_span(in + line, dim, Y, out + line, dim, Y, len);
   }
 }
 
 /**
- *  @brief Copy a cell and call itself on the adjacent cells
+ *  @brief Copy a disk between two matrices
  *  @param[in] in The matrix in which to cut a disk
  *  @param[out] out The matrix in which is stored the result
  *  @param[in] dimIn The dimension of the input matrix
@@ -279,58 +535,28 @@ void von_neumann(int x, int y, int radius, int *mat, int dim,
  *  @param[in] inY The y coordinate of the center in the input matrix
  *  @param[in] outX The x coordinate of the center in the output matrix
  *  @param[in] outY The y coordinate of the center in the output matrix
- *  @param[in,out] ref The reference matrix used to remember the previous states
- *  @param[in] refX The coordinate in ref
- *  @param[in] refY The coordinate in ref
- *  @param[in] radius The radius of the circle to cut
- *  @param[in] radius_max The maximum possible radius
+ *  @param[in] radius The radius of the circle to cut, at most \
+ *                    (min(dimIn, dimOut)-1)/2
  *  @see copy_disk_ultimate
  *
- *  This function is a recursive function spanning from the center
- *  of a disk to its border by decreasing the
- *  radius by one each time it is called.
- *
- *  In fact it copies the part which is in the disk to the output matrix.
- *
- *  There is a folding of the disk in the in and out matrices.
+ *  The cells at a taxicab distance of less than radius from the center
+ *  are copied, the disk folds on the sides of both matrices.
+ *  Each line of the disk is copied in at most three segments.
  *
  */
 void von_neumann_ultimate(fftw_complex* in, fftw_complex* out,
                           int dimIn, int dimOut,
                           int inX, int inY, int outX, int outY,
-                          int *ref, int refX, int refY,
-                          int radius, int radius_max) {
-  if (radius <= 0)
-    return;
-
-  int dimRef = 2*radius_max + 1;
-
-  /* if the cell is already copied */
-  if (!(ref[(refX)*dimRef + (refY)] < radius+1))
-    return;
-
-  /* if the cell is not in the disk */
-  if (refX < 0 || refY < 0 || refX >= dimRef || refY >= dimRef)
-    return;
-
-  ref[(refX)*dimRef + (refY)] = radius+1;
-
-  int out_X = matrix_cyclic(outX+refX-radius_max, dimOut);
-  int out_Y = matrix_cyclic(outY+refY-radius_max, dimOut);
-  int in_X = matrix_cyclic(inX+refX-radius_max, dimIn);
-  int in_Y = matrix_cyclic(inY+refY-radius_max, dimIn);
-
-  (out[out_X*dimOut+out_Y])[0] = (in[in_X*dimIn+in_Y])[0];
-  (out[out_X*dimOut+out_Y])[1] = (in[in_X*dimIn+in_Y])[1];
-
-  von_neumann_ultimate(in, out, dimIn, dimOut, inX, inY, outX, outY,
-                       ref, refX+1, refY, radius-1, radius_max);
-  von_neumann_ultimate(in, out, dimIn, dimOut, inX, inY, outX, outY,
-                       ref, refX-1, refY, radius-1, radius_max);
-  von_neumann_ultimate(in, out, dimIn, dimOut, inX, inY, outX, outY,
-                       ref, refX, refY+1, radius-1, radius_max);
-  von_neumann_ultimate(in, out, dimIn, dimOut, inX, inY, outX, outY,
-                       ref, refX, refY-1, radius-1, radius_max);
+                          int radius) {
+  for (int dx = -(radius-1); dx <= radius-1; dx++) {
+    int width = radius-1 - abs(dx);
+    size_t in_line = (size_t) matrix_cyclic(inX+dx, dimIn)*dimIn;
+    size_t out_line = (size_t) matrix_cyclic(outX+dx, dimOut)*dimOut;
+
+    matrix_copy_span(in + in_line, dimIn, matrix_cyclic(inY-width, dimIn),
+                     out + out_line, dimOut, matrix_cyclic(outY-width, dimOut),
+                     2*width+1);
+  }
 }
 
 /**
@@ -374,18 +600,8 @@ int copy_disk_ultimate(fftw_complex* in, fftw_complex* out,
       radius > radius_max) {
     return 1;
   } else {
-    int *ref = (int*) malloc((2*radius + 1)*(2*radius + 1)  * sizeof(int));
-
-    for (int i = 0; i < (2*radius + 1)*(2*radius + 1); i++)
-      ref[i] = -1;
-
-    int refX = radius;
-    int refY = radius;
-    ref[refX*(2*radius + 1) + refY] = radius;
-
     von_neumann_ultimate(in, out, dimIn, dimOut,
-                         inX, inY, outX, outY, ref, refX, refY, radius, radius);
-    free(ref);
+                         inX, inY, outX, outY, radius);
     return 0;
   }
 }
@@ -458,18 +674,130 @@ int copy_disk(fftw_complex* in, fftw_complex* out, int dim, int radius) {
  * 
  *  Applying for +offset and then -offset give the original matrix
  *
- *  "in" and "out" matrices must be different instances, namely
- *  the algorithm is not-in-place
- *  @bug Does not rotate the sub-matrix
+ *  With offset = dim/2 this is an fftshift, with offset = -(dim/2) an
+ *  ifftshift, for even and odd dimensions.
+ *
+ *  If "in" and "out" are the same matrix, the shift is done in place
+ *  (see matrix_shift), otherwise "in" and "out" must not overlap.
  */
 void matrix_recenter(fftw_complex *in, fftw_complex *out, int dim, int offset) {
+  if (in == out) {
+    matrix_shift(out, dim, offset);
+    return;
+  }
+
+  int Y = matrix_cyclic(offset, dim);
+  #pragma omp parallel for if (dim >= MATRIX_PARALLEL_DIM)
   for (int i = 0; i < dim; i++) {
-    for (int j = 0; j < dim; j++) {
-      int X = (i+offset)%dim;
-      int Y = (j+offset)%dim;
-      (out[X*dim+Y])[0] = (in[i*dim+j])[0];
-      (out[X*dim+Y])[1] = (in[i*dim+j])[1];
+    int X = matrix_cyclic(i+offset, dim);
+    matrix_copy_span(in + (size_t) i*dim, dim, 0,
+                     out + (size_t) X*dim, dim, Y, dim);
+  }
+}
+
+/**
+ *  @brief Swap two parts of lines
+ *
+ */
+static void matrix_swap_span(fftw_complex *a, fftw_complex *b, int len) {
+  for (int i = 0; i < len; i++) {
+    double re = a[i][0], im = a[i][1];
+    a[i][0] = b[i][0];
+    a[i][1] = b[i][1];
+    b[i][0] = re;
+    b[i][1] = im;
+  }
+}
+
+/**
+ *  @brief Reverse the order of the elements of a part of a line
+ *
+ */
+static void matrix_reverse_span(fftw_complex *line, int len) {
+  for (int i = 0, j = len-1; i < j; i++, j--) {
+    double re = line[i][0], im = line[i][1];
+    line[i][0] = line[j][0];
+    line[i][1] = line[j][1];
+    line[j][0] = re;
+    line[j][1] = im;
+  }
+}
+
+/**
+ *  @brief Reverse the order of lines first to last-1 of a matrix
+ *
+ */
+static void matrix_reverse_lines(fftw_complex *mat, int dim,
+                                 int first, int last) {
+  int half = (last - first)/2;
+  #pragma omp parallel for if (dim >= MATRIX_PARALLEL_DIM)
+  for (int k = 0; k < half; k++)
+    matrix_swap_span(mat + (size_t) (first+k)*dim,
+                     mat + (size_t) (last-1-k)*dim, dim);
+}
+
+/**
+ *  @brief Shift the lines and columns of a matrix cyclically, in place
+ *  @param[in,out] mat The matrix
+ *  @param[in] dim The dimension of the matrix
+ *  @param[in] offset The element [0;0] goes to [offset;offset]
+ *
+ *  When offset is dim/2 and dim is even, the shift is a swap of the
+ *  opposite quadrants, done line by line.
+ *  Otherwise each line is rotated, then the order of the lines, each
+ *  rotation being three reversals.
+ *  The lines are processed in parallel (OpenMP) for big matrices and
+ *  only contiguous parts of lines are accessed.
+ *
+ */
+void matrix_shift(fftw_complex *mat, int dim, int offset) {
+  int shift = (dim > 0) ? matrix_cyclic(offset, dim) : 0;
+  if (shift == 0)
+    return;
+
+  if (2*shift == dim) {
+    #pragma omp parallel for if (dim >= MATRIX_PARALLEL_DIM)
+    for (int i = 0; i < shift; i++) {
+      fftw_complex *top = mat + (size_t) i*dim;
+      fftw_complex *bottom = mat + (size_t) (i+shift)*dim;
+      matrix_swap_span(top, bottom + shift, shift);
+      matrix_swap_span(top + shift, bottom, shift);
     }
+    return;
   }
+
+  /* a rotation by shift is a reversal of all, then of both parts */
+  #pragma omp parallel for if (dim >= MATRIX_PARALLEL_DIM)
+  for (int i = 0; i < dim; i++) {
+    fftw_complex *line = mat + (size_t) i*dim;
+    matrix_reverse_span(line, dim);
+    matrix_reverse_span(line, shift);
+    matrix_reverse_span(line + shift, dim - shift);
+  }
+
+  matrix_reverse_lines(mat, dim, 0, dim);
+  matrix_reverse_lines(mat, dim, 0, shift);
+  matrix_reverse_lines(mat, dim, shift, dim);
+}
+
+/**
+ *  @brief Move the zero frequency to the center of a spectrum, in place
+ *  @param[in,out] mat The spectrum
+ *  @param[in] dim The dimension of the spectrum
+ *
+ */
+void matrix_fftshift(fftw_complex *mat, int dim) {
+  matrix_shift(mat, dim, dim/2);
 }
 
+/**
+ *  @brief Move the center of a spectrum to the zero frequency, in place
+ *  @param[in,out] mat The spectrum
+ *  @param[in] dim The dimension of the spectrum
+ *
+ *  The inverse of matrix_fftshift, also for odd dimensions.
+ *
+ */
+void matrix_ifftshift(fftw_complex *mat, int dim) {
+  matrix_shift(mat, dim, -(dim/2));
+}
@@ -0,0 +1,160 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  This file implements a pool of aligned memory from which all the
+ *  scratch buffers of a reconstruction are taken, so that nothing
+ *  is allocated on the heap once the setup is done.
+ *
+ */
+
+#include <sys/mman.h>
+#include "include/pool.h"
+
+/** @cond DEV */
+static uint64_t pool_heap_allocs = 0;
+/** @endcond */
+
+/**
+ *  @brief Allocate memory on the heap and count it
+ *  @param[in] size The number of bytes
+ *  @return NULL If memory allocation failed
+ *
+ *  The pools are allocated through this function, see
+ *  pool_heap_count. The stacks, tiles, traces and plan tuning
+ *  allocate their own buffers on the heap directly.
+ *  The memory is compatible with fftw (fftw_malloc).
+ *
+ */
+void *pool_heap_alloc(size_t size) {
+  __atomic_fetch_add(&pool_heap_allocs, 1, __ATOMIC_RELAXED);
+  return fftw_malloc(size);
+}
+
+/**
+ *  @brief Free memory given by pool_heap_alloc
+ *
+ */
+void pool_heap_free(void *ptr) {
+  fftw_free(ptr);
+}
+
+/**
+ *  @brief Get the number of pools allocated on the heap so far
+ *
+ */
+uint64_t pool_heap_count(void) {
+  return __atomic_load_n(&pool_heap_allocs, __ATOMIC_RELAXED);
+}
+
+/**
+ *  @brief Round a size to the alignment of the blocks
+ *  @param[in] size The size of a block
+ *  @return size_t The room taken by the block in a pool
+ *
+ *  Used to compute the size to give to pool_init.
+ *
+ */
+size_t pool_round(size_t size) {
+  return (size + POOL_ALIGN - 1) / POOL_ALIGN * POOL_ALIGN;
+}
+
+/**
+ *  @brief Initialize a pool
+ *  @param[out] pool The pool to initialize
+ *  @param[in] size The number of bytes the pool can give
+ *  @return 1 If memory allocation failed
+ *  @return 0 Otherwise
+ *
+ */
+int pool_init(struct pool *pool, size_t size) {
+  size = pool_round(size);
+  pool->mem = (char*) pool_heap_alloc(size + POOL_ALIGN);
+  if (pool->mem == NULL) {
+    pool->base = NULL;
+    pool->size = pool->used = pool->mapped = 0;
+    return 1;
+  }
+  pool->base = pool->mem + (POOL_ALIGN -
+                            (uintptr_t) pool->mem % POOL_ALIGN) % POOL_ALIGN;
+  pool->size = size;
+  pool->used = 0;
+  pool->mapped = 0;
+  return 0;
+}
+
+/**
+ *  @brief Initialize a pool backed by huge pages
+ *  @param[out] pool The pool to initialize
+ *  @param[in] size The number of bytes the pool can give
+ *  @return 1 If memory allocation failed
+ *  @return 0 Otherwise
+ *
+ *  Same as pool_init, but the memory is mapped in multiples of
+ *  POOL_HUGE_PAGE and the kernel is asked to back it with transparent
+ *  huge pages, which saves TLB misses on big spectra. If they are
+ *  disabled, the pool works anyway with normal pages.
+ *  Like with pool_init, no page is touched: each page lands on the
+ *  memory node of the thread writing it first.
+ *
+ */
+int pool_init_huge(struct pool *pool, size_t size) {
+  size_t length = (pool_round(size) + POOL_HUGE_PAGE - 1) /
+    POOL_HUGE_PAGE * POOL_HUGE_PAGE;
+
+  __atomic_fetch_add(&pool_heap_allocs, 1, __ATOMIC_RELAXED);
+  void *mem = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    pool->mem = pool->base = NULL;
+    pool->size = pool->used = pool->mapped = 0;
+    return 1;
+  }
+  madvise(mem, length, MADV_HUGEPAGE);
+
+  pool->mem = pool->base = (char*) mem;
+  pool->size = length;
+  pool->used = 0;
+  pool->mapped = length;
+  return 0;
+}
+
+/**
+ *  @brief Take a block from a pool
+ *  @param[in,out] pool The pool
+ *  @param[in] size The number of bytes needed
+ *  @return NULL If the pool is exhausted
+ *
+ *  The block is aligned on POOL_ALIGN bytes. It is given back
+ *  to the pool by pool_reset or pool_destroy only.
+ *
+ */
+void *pool_alloc(struct pool *pool, size_t size) {
+  size = pool_round(size);
+  if (pool->base == NULL || size > pool->size - pool->used)
+    return NULL;
+  void *block = pool->base + pool->used;
+  pool->used += size;
+  return block;
+}
+
+/**
+ *  @brief Give all the blocks back to a pool
+ *
+ */
+void pool_reset(struct pool *pool) {
+  pool->used = 0;
+}
+
+/**
+ *  @brief Free the memory of a pool
+ *
+ */
+void pool_destroy(struct pool *pool) {
+  if (pool->mem && pool->mapped)
+    munmap(pool->mem, pool->mapped);
+  else if (pool->mem)
+    pool_heap_free(pool->mem);
+  pool->mem = pool->base = NULL;
+  pool->size = pool->used = pool->mapped = 0;
+}
@@ -0,0 +1,103 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  This file implements the counters and timers used to know
+ *  where the time goes inside swarm.
+ *
+ */
+
+#include "include/profile.h"
+#include "include/cpu.h"
+
+/** @cond DEV */
+static uint64_t prof_counts[PROF_STAGES];
+static uint64_t prof_totals[PROF_STAGES];
+
+static const char *prof_names[PROF_STAGES] = {
+  "extract", "backward", "project", "forward", "writeback", "led", "lap"
+};
+/** @endcond */
+
+/**
+ *  @brief Get a monotonic timestamp
+ *  @return uint64_t The current time in nanoseconds
+ *
+ */
+uint64_t prof_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec*((uint64_t) 1000000000) +
+    (uint64_t) now.tv_nsec;
+}
+
+/**
+ *  @brief Clear all the counters
+ *
+ */
+void prof_reset(void) {
+  for (int i = 0; i < PROF_STAGES; i++) {
+    __atomic_store_n(&prof_counts[i], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&prof_totals[i], 0, __ATOMIC_RELAXED);
+  }
+}
+
+/**
+ *  @brief Account one execution of a stage
+ *  @param[in] stage The stage, see enum prof_stage
+ *  @param[in] ns The time spent in the stage in nanoseconds
+ *
+ */
+void prof_add(int stage, uint64_t ns) {
+  if (stage < 0 || stage >= PROF_STAGES)
+    return;
+  __atomic_fetch_add(&prof_counts[stage], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&prof_totals[stage], ns, __ATOMIC_RELAXED);
+}
+
+/**
+ *  @brief Get the number of executions of a stage
+ *
+ */
+uint64_t prof_count(int stage) {
+  if (stage < 0 || stage >= PROF_STAGES)
+    return 0;
+  return __atomic_load_n(&prof_counts[stage], __ATOMIC_RELAXED);
+}
+
+/**
+ *  @brief Get the total time spent in a stage in nanoseconds
+ *
+ */
+uint64_t prof_total(int stage) {
+  if (stage < 0 || stage >= PROF_STAGES)
+    return 0;
+  return __atomic_load_n(&prof_totals[stage], __ATOMIC_RELAXED);
+}
+
+/**
+ *  @brief Print a summary of all the stages
+ *  @param[in] stream Where to print the summary
+ *
+ *  One line per stage with the number of executions, the total
+ *  time in milliseconds and the mean time in microseconds:
+ *
+   \verbatim
+   stage           count    total_ms     mean_us
+   extract            98      12.345     125.969
+   \endverbatim
+ *
+ *  The last line tells which variant of the kernels ran (see cpu_isa).
+ *
+ */
+void prof_report(FILE *stream) {
+  fprintf(stream, "%-10s %10s %11s %11s\n",
+          "stage", "count", "total_ms", "mean_us");
+  for (int i = 0; i < PROF_STAGES; i++) {
+    uint64_t count = prof_count(i);
+    uint64_t total = prof_total(i);
+    fprintf(stream, "%-10s %10" PRIu64 " %11.3f %11.3f\n", prof_names[i],
+            count, total/1e6, count ? total/1e3/count : 0.);
+  }
+  fprintf(stream, "%-10s %10s\n", "isa", cpu_isa());
+}
@@ -0,0 +1,310 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  This file implements the writer of the intermediate states of a
+ *  reconstruction (modulus and argument of the spectrum and of the
+ *  last updated disk), decimated and written in a background thread.
+ *  The same writer gives low resolution previews of the image.
+ *
+ */
+
+#include "include/snapshot.h"
+#include "include/affinity.h"
+#include "include/trace.h"
+
+/**
+ *  @brief Get the size of the pool needed by a snapshot writer
+ *  @param[in] out_dim The dimension of the spectrum
+ *  @param[in] th_dim The dimension of the thumbnails
+ *  @param[in] slot_nbr The number of slots in the ring
+ *  @return size_t The number of bytes to take into account in pool_init
+ *
+ */
+size_t snapshot_pool_size(int out_dim, int th_dim, int slot_nbr) {
+  return pool_round(slot_nbr*sizeof(struct snapshot_slot)) +
+    slot_nbr*pool_round((size_t) out_dim*out_dim*sizeof(fftw_complex)) +
+    slot_nbr*pool_round((size_t) th_dim*th_dim*sizeof(fftw_complex)) +
+    2*pool_round((size_t) out_dim*out_dim*sizeof(double));
+}
+
+/**
+ *  @brief Write the modulus and argument of a matrix in two tiff images
+ *
+ */
+static void snapshot_write(struct snapshot *snap, fftw_complex *mat, int dim,
+                           const char *prefix, int step) {
+  char name[60];
+
+  matrix_magnitude(dim, mat, snap->io0);
+  matrix_phase_fast(dim, mat, snap->io1);
+  snprintf(name, sizeof(name), "build/%s0_%.4d.tiff", prefix, step);
+  tiff_frommatrix(name, snap->io0, dim, dim);
+  snprintf(name, sizeof(name), "build/%s1_%.4d.tiff", prefix, step+1);
+  tiff_frommatrix(name, snap->io1, dim, dim);
+}
+
+/**
+ *  @brief Background thread writing the filled slots
+ *
+ */
+static void *snapshot_worker(void *arg) {
+  struct snapshot *snap = (struct snapshot*) arg;
+
+  pthread_mutex_lock(&snap->lock);
+  for (;;) {
+    while (snap->count == 0 && !snap->stop)
+      pthread_cond_wait(&snap->cond, &snap->lock);
+    if (snap->count == 0)
+      break;
+
+    int tail = (snap->head - snap->count + snap->slot_nbr) % snap->slot_nbr;
+    struct snapshot_slot *slot = &snap->slots[tail];
+    pthread_mutex_unlock(&snap->lock);
+
+    /* the slot is ours until count is decreased */
+    TRACE_BEGIN("snapshot_write");
+    if (snap->backward) {
+      char name[60];
+      fftw_execute_dft(snap->backward, slot->out, slot->out);
+      matrix_magnitude(snap->out_dim, slot->out, snap->io0);
+      snprintf(name, sizeof(name), "build/preview_%.4d.tiff", slot->step);
+      tiff_frommatrix(name, snap->io0, snap->out_dim, snap->out_dim);
+    } else {
+      snapshot_write(snap, slot->out, snap->out_dim, "swarm", slot->step);
+      if (slot->with_freq)
+        snapshot_write(snap, slot->freq, snap->th_dim, "freq", slot->step+2);
+    }
+    TRACE_END("snapshot_write");
+
+    pthread_mutex_lock(&snap->lock);
+    snap->count--;
+    snap->written++;
+    pthread_cond_broadcast(&snap->cond);
+  }
+  pthread_mutex_unlock(&snap->lock);
+  return NULL;
+}
+
+/**
+ *  @brief Prepare a snapshot writer and start its thread
+ *  @param[out] snap The writer to initialize
+ *  @param[in,out] pool The pool in which the slots are taken \
+ *                      (see snapshot_pool_size)
+ *  @param[in] out_dim The dimension of the spectrum
+ *  @param[in] th_dim The dimension of the thumbnails
+ *  @param[in] slot_nbr The number of states which can wait to be written
+ *  @param[in] every_leds Take a snapshot every every_leds leds (0: never)
+ *  @param[in] every_laps Take a snapshot every every_laps laps (0: never)
+ *  @return 1 If the pool is too small or the thread could not be created
+ *  @return 0 Otherwise
+ *
+ *  The images are written in build/ and named swarm0_nnnn.tiff,
+ *  swarm1_nnnn.tiff (modulus and argument of the spectrum),
+ *  freq0_nnnn.tiff and freq1_nnnn.tiff (last updated disk).
+ *
+ */
+int snapshot_init(struct snapshot *snap, struct pool *pool,
+                  int out_dim, int th_dim, int slot_nbr,
+                  int every_leds, int every_laps) {
+  if (slot_nbr <= 0)
+    return 1;
+
+  snap->out_dim = out_dim;
+  snap->th_dim = th_dim;
+  snap->every_leds = every_leds;
+  snap->every_laps = every_laps;
+  snap->leds = snap->laps = snap->step = 0;
+  snap->written = snap->dropped = 0;
+  snap->slot_nbr = slot_nbr;
+  snap->head = snap->count = 0;
+  snap->stop = 0;
+  snap->backward = NULL;
+
+  snap->slots = (struct snapshot_slot*)
+    pool_alloc(pool, slot_nbr*sizeof(struct snapshot_slot));
+  if (snap->slots == NULL)
+    return 1;
+  for (int i = 0; i < slot_nbr; i++) {
+    snap->slots[i].out = (fftw_complex*)
+      pool_alloc(pool, (size_t) out_dim*out_dim*sizeof(fftw_complex));
+    snap->slots[i].freq = (fftw_complex*)
+      pool_alloc(pool, (size_t) th_dim*th_dim*sizeof(fftw_complex));
+    if (snap->slots[i].out == NULL || snap->slots[i].freq == NULL)
+      return 1;
+  }
+  snap->io0 = (double*) pool_alloc(pool, (size_t) out_dim*out_dim*
+                                   sizeof(double));
+  snap->io1 = (double*) pool_alloc(pool, (size_t) out_dim*out_dim*
+                                   sizeof(double));
+  if (snap->io0 == NULL || snap->io1 == NULL)
+    return 1;
+
+  pthread_mutex_init(&snap->lock, NULL);
+  pthread_cond_init(&snap->cond, NULL);
+  if (affinity_create(&snap->worker, snapshot_worker, snap)) {
+    pthread_cond_destroy(&snap->cond);
+    pthread_mutex_destroy(&snap->lock);
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ *  @brief Take the next slot of the ring
+ *  @param[in] step The number of images of this state
+ *  @return NULL If the ring is full and the state is dropped
+ *
+ *  Only the reconstruction thread fills slots, and the worker does
+ *  not touch this one until snapshot_commit.
+ *
+ */
+static struct snapshot_slot *snapshot_reserve(struct snapshot *snap,
+                                              int step) {
+  pthread_mutex_lock(&snap->lock);
+  if (snap->count == snap->slot_nbr) {
+    snap->dropped++;
+    pthread_mutex_unlock(&snap->lock);
+    return NULL;
+  }
+  struct snapshot_slot *slot = &snap->slots[snap->head];
+  slot->step = snap->step;
+  snap->step += step;
+  pthread_mutex_unlock(&snap->lock);
+  return slot;
+}
+
+/**
+ *  @brief Give the slot taken by snapshot_reserve to the worker
+ *
+ */
+static void snapshot_commit(struct snapshot *snap) {
+  pthread_mutex_lock(&snap->lock);
+  snap->head = (snap->head+1) % snap->slot_nbr;
+  snap->count++;
+  pthread_cond_broadcast(&snap->cond);
+  pthread_mutex_unlock(&snap->lock);
+}
+
+/**
+ *  @brief Copy a state in the ring
+ *  @param[in,out] snap The writer
+ *  @param[in] out The spectrum
+ *  @param[in] freq The last updated disk, or NULL
+ *  @return 1 If the ring is full and the state was dropped
+ *  @return 0 Otherwise
+ *
+ */
+int snapshot_push(struct snapshot *snap, fftw_complex *out,
+                  fftw_complex *freq) {
+  struct snapshot_slot *slot = snapshot_reserve(snap, freq ? 4 : 2);
+  if (slot == NULL)
+    return 1;
+
+  slot->with_freq = freq != NULL;
+  memcpy(slot->out, out,
+         (size_t) snap->out_dim*snap->out_dim*sizeof(fftw_complex));
+  if (freq)
+    memcpy(slot->freq, freq,
+           (size_t) snap->th_dim*snap->th_dim*sizeof(fftw_complex));
+
+  snapshot_commit(snap);
+  return 0;
+}
+
+/**
+ *  @brief Turn a writer into a writer of previews
+ *  @param[in,out] snap A writer initialized with out_dim the dimension \
+ *                      of the previews, and nothing in its ring
+ *  @return 1 If the inverse transform could not be planned
+ *  @return 0 Otherwise
+ *
+ *  Each state is then the centered crop of a spectrum (see
+ *  snapshot_crop), and only the modulus of its inverse transform,
+ *  the image at a lower resolution, is written in
+ *  build/preview_nnnn.tiff.
+ *
+ */
+int snapshot_preview(struct snapshot *snap) {
+  /* the slots are aligned alike, one in-place plan serves them all */
+  snap->backward = fftw_plan_dft_2d(snap->out_dim, snap->out_dim,
+                                    snap->slots[0].out, snap->slots[0].out,
+                                    FFTW_BACKWARD, FFTW_ESTIMATE);
+  return snap->backward == NULL;
+}
+
+/**
+ *  @brief Copy the low frequencies of a spectrum in the ring
+ *  @param[in,out] snap A writer of previews (see snapshot_preview)
+ *  @param[in] out The spectrum, DC at [0,0]
+ *  @param[in] out_dim The dimension of the spectrum
+ *  @return 1 If the ring is full or the spectrum is smaller than the \
+ *            previews
+ *  @return 0 Otherwise
+ *
+ *  Only snap->out_dim^2 elements are copied, and the transform is done
+ *  by the worker on this small crop, so a preview costs nearly nothing
+ *  to the reconstruction whatever out_dim.
+ *
+ */
+int snapshot_crop(struct snapshot *snap, fftw_complex *out, int out_dim) {
+  int dim = snap->out_dim;
+  if (dim > out_dim)
+    return 1;
+  struct snapshot_slot *slot = snapshot_reserve(snap, 1);
+  if (slot == NULL)
+    return 1;
+
+  slot->with_freq = 0;
+  /* centered, without moving DC back to [0,0]: the inverse transform
+   * only gets a phase ramp, which the modulus ignores */
+  matrix_extract(dim, out_dim, slot->out, out, -dim/2, -dim/2);
+
+  snapshot_commit(snap);
+  return 0;
+}
+
+/**
+ *  @brief Account one led update, and push the state if it is its turn
+ *  @return 1 If the state was dropped
+ *  @return 0 Otherwise
+ *
+ */
+int snapshot_led(struct snapshot *snap, fftw_complex *out,
+                 fftw_complex *freq) {
+  snap->leds++;
+  if (snap->every_leds <= 0 || snap->leds % snap->every_leds)
+    return 0;
+  return snapshot_push(snap, out, freq);
+}
+
+/**
+ *  @brief Account one lap, and push the spectrum if it is its turn
+ *  @return 1 If the state was dropped
+ *  @return 0 Otherwise
+ *
+ */
+int snapshot_lap(struct snapshot *snap, fftw_complex *out) {
+  snap->laps++;
+  if (snap->every_laps <= 0 || snap->laps % snap->every_laps)
+    return 0;
+  return snapshot_push(snap, out, NULL);
+}
+
+/**
+ *  @brief Write the remaining states and stop the thread
+ *
+ *  The slots are given back with the pool.
+ *
+ */
+void snapshot_destroy(struct snapshot *snap) {
+  pthread_mutex_lock(&snap->lock);
+  snap->stop = 1;
+  pthread_cond_broadcast(&snap->cond);
+  pthread_mutex_unlock(&snap->lock);
+  pthread_join(snap->worker, NULL);
+  if (snap->backward)
+    fftw_destroy_plan(snap->backward);
+  pthread_cond_destroy(&snap->cond);
+  pthread_mutex_destroy(&snap->lock);
+}
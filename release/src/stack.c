@@ -0,0 +1,263 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  This file implements a container for all the thumbnails of an
+ *  acquisition: a header, an index giving the led of each plane, then
+ *  the planes stored as doubles. Once converted from the tiff images,
+ *  an acquisition is mapped in memory and given to swarm without any
+ *  copy or conversion, the pages being shared between processes.
+ *
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "include/stack.h"
+#include "include/matrix.h"
+#include "include/trace.h"
+
+/**
+ *  @brief Write a buffer entirely
+ *  @return 1 If a write failed
+ *  @return 0 Otherwise
+ *
+ */
+static int stack_full_write(FILE *file, const void *buf, size_t size) {
+  return fwrite(buf, 1, size, file) != size;
+}
+
+/**
+ *  @brief Fill the header and index of a stack
+ *
+ */
+static void stack_layout(struct stack_header *header,
+                         struct stack_entry *entries,
+                         int jorga, int diml, int dimw, int source_bits) {
+  int side = 2*jorga+1;
+
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, STACK_MAGIC, sizeof(header->magic));
+  header->endian = STACK_ENDIAN;
+  header->diml = diml;
+  header->dimw = dimw;
+  header->bits = 8*sizeof(double);
+  header->source_bits = source_bits;
+  header->jorga = jorga;
+  header->nbr = side*side;
+  header->plane_size = ((uint64_t) diml*dimw*sizeof(double) +
+                        STACK_PLANE_ALIGN - 1) /
+    STACK_PLANE_ALIGN * STACK_PLANE_ALIGN;
+  header->data = (sizeof(*header) + header->nbr*sizeof(struct stack_entry) +
+                  STACK_ALIGN - 1) / STACK_ALIGN * STACK_ALIGN;
+
+  for (int i = 0; i < header->nbr; i++) {
+    entries[i].x = i/side - jorga;
+    entries[i].y = i%side - jorga;
+    entries[i].offset = header->data + i*header->plane_size;
+  }
+}
+
+/**
+ *  @brief Write thumbnails in a stack file
+ *  @param[in] name The path of the stack
+ *  @param[in] thumbnails The (2*jorga+1)^2 thumbnails, in the order \
+ *                        expected by swarm
+ *  @param[in] jorga The number of leds from the center to a side
+ *  @param[in] diml The number of lines of a thumbnail
+ *  @param[in] dimw The number of columns of a thumbnail
+ *  @param[in] source_bits Bits per sample of the acquired images
+ *  @return 1 If the file could not be written
+ *  @return 0 Otherwise
+ *
+ */
+int stack_write(const char *name, double **thumbnails, int jorga,
+                int diml, int dimw, int source_bits) {
+  struct stack_header header;
+  int side = 2*jorga+1;
+  struct stack_entry *entries = (struct stack_entry*)
+    malloc(side*side*sizeof(struct stack_entry));
+  char *padding = (char*) calloc(1, STACK_ALIGN);
+  FILE *file = fopen(name, "wb");
+
+  int error = entries == NULL || padding == NULL || file == NULL;
+  if (!error) {
+    stack_layout(&header, entries, jorga, diml, dimw, source_bits);
+    size_t plane = (size_t) diml*dimw*sizeof(double);
+    size_t index = sizeof(header) + header.nbr*sizeof(struct stack_entry);
+
+    error = stack_full_write(file, &header, sizeof(header)) ||
+      stack_full_write(file, entries, header.nbr*sizeof(struct stack_entry)) ||
+      stack_full_write(file, padding, header.data - index);
+    for (int i = 0; i < header.nbr && !error; i++)
+      error = stack_full_write(file, thumbnails[i], plane) ||
+        stack_full_write(file, padding, header.plane_size - plane);
+  }
+
+  if (file)
+    error = fclose(file) || error;
+  free(padding);
+  free(entries);
+  return error ? 1 : 0;
+}
+
+/**
+ *  @brief Convert a directory of tiff thumbnails in a stack file
+ *  @param[in] dir The directory of the thumbnails
+ *  @param[in] jorga The number of leds from the center to a side
+ *  @param[in] name The path of the stack
+ *  @return 1 If a thumbnail could not be read or the stack written
+ *  @return 0 Otherwise
+ *
+ *  The thumbnails are named as given by tiff_getname, xxxxxyyyyy.tiff
+ *  with x and y from 0 to 2*jorga, and must all have the same size.
+ *
+ */
+int stack_fromtiff(const char *dir, int jorga, const char *name) {
+  int side = 2*jorga+1;
+  char path[FILENAME_MAX];
+  uint32 diml, dimw;
+
+  snprintf(path, sizeof(path), "%s/%.5d%.5d.tiff", dir, 0, 0);
+  if (tiff_getsize(path, &diml, &dimw))
+    return 1;
+
+  double **thumbnails = (double**) calloc(side*side, sizeof(double*));
+  if (thumbnails == NULL)
+    return 1;
+
+  int error = 0;
+  for (int x = 0; x < side && !error; x++)
+    for (int y = 0; y < side && !error; y++) {
+      uint32 l, w;
+      double **plane = &thumbnails[x*side+y];
+      snprintf(path, sizeof(path), "%s/%.5d%.5d.tiff", dir, x, y);
+      *plane = (double*) malloc((size_t) diml*dimw*sizeof(double));
+      error = *plane == NULL || tiff_getsize(path, &l, &w) ||
+        l != diml || w != dimw || tiff_tomatrix(path, *plane, diml, dimw);
+    }
+
+  if (!error)
+    error = stack_write(name, thumbnails, jorga, diml, dimw, 8);
+
+  for (int i = 0; i < side*side; i++)
+    free(thumbnails[i]);
+  free(thumbnails);
+  return error;
+}
+
+/**
+ *  @brief Check that a header describes a stack within the file
+ *  @param[in] header The header read from the file
+ *  @param[in] length The length of the file
+ *  @return 1 If the header is not valid or the index or the planes \
+ *            go past the end of the file
+ *  @return 0 Otherwise
+ *
+ *  Every product is checked for overflow, as in matrix_size, since the
+ *  fields come from the file.
+ *
+ */
+static int stack_check(const struct stack_header *header, size_t length) {
+  size_t leds, plane, index, planes;
+
+  if (memcmp(header->magic, STACK_MAGIC, sizeof(header->magic)) ||
+      header->endian != STACK_ENDIAN || header->bits != 8*sizeof(double) ||
+      header->jorga < 0 || header->jorga > (INT32_MAX-1)/2 ||
+      header->diml <= 0 || header->dimw <= 0 || header->nbr <= 0)
+    return 1;
+
+  int side = 2*header->jorga+1;
+  if (matrix_size(side, side, 1, &leds) || leds != (size_t) header->nbr)
+    return 1;
+
+  /* a plane must hold a whole thumbnail */
+  if (matrix_size(header->diml, header->dimw, sizeof(double), &plane) ||
+      header->plane_size < plane)
+    return 1;
+
+  /* the index is between the header and the first plane */
+  if (matrix_size(header->nbr, 1, sizeof(struct stack_entry), &index) ||
+      __builtin_add_overflow(index, sizeof(*header), &index) ||
+      index > header->data || header->data > length)
+    return 1;
+
+  if (__builtin_mul_overflow((size_t) header->nbr, header->plane_size,
+                             &planes) ||
+      planes > length - header->data)
+    return 1;
+  return 0;
+}
+
+/**
+ *  @brief Map a stack file in memory, read-only
+ *  @param[in] name The path of the stack
+ *  @param[out] stack The mapped stack
+ *  @return 1 If the file could not be mapped or is not a valid stack
+ *  @return 0 Otherwise
+ *
+ *  stack->planes can be given to swarm as the thumbnails, nothing
+ *  is copied. The stack must be released with stack_unmap.
+ *
+ */
+int stack_map(const char *name, struct stack *stack) {
+  struct stat st;
+  int fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return 1;
+  if (fstat(fd, &st) || (size_t) st.st_size < sizeof(struct stack_header)) {
+    close(fd);
+    return 1;
+  }
+
+  TRACE_BEGIN("stack_map");
+  stack->length = st.st_size;
+  stack->map = mmap(NULL, stack->length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  TRACE_END("stack_map");
+  if (stack->map == MAP_FAILED)
+    return 1;
+
+  struct stack_header *header = &stack->header;
+  memcpy(header, stack->map, sizeof(*header));
+  if (stack_check(header, stack->length)) {
+    munmap(stack->map, stack->length);
+    return 1;
+  }
+  int side = 2*header->jorga+1;
+
+  stack->entries = (struct stack_entry*)
+    ((char*) stack->map + sizeof(*header));
+  stack->planes = (double**) calloc(header->nbr, sizeof(double*));
+  if (stack->planes == NULL) {
+    munmap(stack->map, stack->length);
+    return 1;
+  }
+  for (int i = 0; i < header->nbr; i++) {
+    struct stack_entry *entry = &stack->entries[i];
+    int x = entry->x + header->jorga;
+    int y = entry->y + header->jorga;
+    if (x < 0 || y < 0 || x >= side || y >= side || stack->planes[x*side+y] ||
+        entry->offset % sizeof(double) || entry->offset < header->data ||
+        entry->offset > stack->length - header->plane_size) {
+      stack_unmap(stack);
+      return 1;
+    }
+    stack->planes[x*side+y] = (double*) ((char*) stack->map + entry->offset);
+  }
+
+  madvise(stack->map, stack->length, MADV_WILLNEED);
+  return 0;
+}
+
+/**
+ *  @brief Release a stack mapped by stack_map
+ *
+ */
+void stack_unmap(struct stack *stack) {
+  free(stack->planes);
+  munmap(stack->map, stack->length);
+  stack->planes = NULL;
+  stack->map = NULL;
+}
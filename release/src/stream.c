@@ -0,0 +1,412 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  This file implements the reconstruction of a sequence of frames
+ *  (time-lapse, video), loading, reconstructing and writing different
+ *  frames at the same time.
+ *
+ */
+
+#include "include/stream.h"
+#include "include/affinity.h"
+#include "include/profile.h"
+#include "include/trace.h"
+
+/** @brief The names of the stages, in the order of stream.stage_ns */
+static const char *stream_stages[3] = {"load", "swarm", "write"};
+
+/**
+ *  @brief Empty a queue
+ *
+ */
+static void stream_queue_reset(struct stream_queue *queue) {
+  queue->head = 0;
+  queue->count = 0;
+  queue->closed = 0;
+}
+
+/**
+ *  @brief Add a slot at the end of a queue
+ *
+ *  A queue holds every slot, so it is never full.
+ *
+ */
+static void stream_queue_push(struct stream_queue *queue, int slot) {
+  pthread_mutex_lock(&queue->lock);
+  queue->items[(queue->head + queue->count) % STREAM_SLOTS_MAX] = slot;
+  queue->count++;
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ *  @brief Take the first slot of a queue, waiting for one if needed
+ *  @return int The slot, -1 if the queue is empty and closed
+ *
+ */
+static int stream_queue_pop(struct stream_queue *queue) {
+  int slot = -1;
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count == 0 && !queue->closed)
+    pthread_cond_wait(&queue->cond, &queue->lock);
+  if (queue->count > 0) {
+    slot = queue->items[queue->head];
+    queue->head = (queue->head+1) % STREAM_SLOTS_MAX;
+    queue->count--;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return slot;
+}
+
+/**
+ *  @brief Tell the consumer of a queue that nothing more will come
+ *
+ */
+static void stream_queue_close(struct stream_queue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  queue->closed = 1;
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ *  @brief Record a failure of a stage
+ *
+ */
+static void stream_fail(struct stream *stream) {
+  __atomic_store_n(&stream->error, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ *  @brief Get the size of the pool needed by a pipeline
+ *  @param[in] th_dim The dimension of each thumbnail
+ *  @param[in] out_dim The dimension of the final images
+ *  @param[in] jorga The dimension of thumbnails is (2*jorga+1)^2
+ *  @param[in] slot_nbr The number of frames in flight
+ *  @return size_t The number of bytes to take into account in pool_init
+ *
+ */
+size_t stream_pool_size(int th_dim, int out_dim, int jorga, int slot_nbr) {
+  size_t nbr = (size_t) (2*jorga+1)*(2*jorga+1);
+  size_t out_size = (size_t) out_dim*out_dim*sizeof(fftw_complex);
+  return pool_round(slot_nbr*sizeof(struct stream_frame)) +
+    slot_nbr*(pool_round(nbr*sizeof(double*)) +
+              nbr*pool_round((size_t) th_dim*th_dim*sizeof(double)) +
+              pool_round(out_size)) +
+    pool_round(out_size) +
+    pool_round((size_t) out_dim*out_dim*sizeof(double));
+}
+
+/**
+ *  @brief Prepare a pipeline
+ *  @param[out] stream The pipeline to initialize
+ *  @param[in,out] pool The pool in which the slots are taken \
+ *                      (see stream_pool_size)
+ *  @param[in,out] ctx The context of the reconstructions, its spectrum \
+ *                     must be in memory (no tiles)
+ *  @param[in] slot_nbr The number of frames in flight, 3 to keep every \
+ *                      stage busy, at most STREAM_SLOTS_MAX
+ *  @param[in] lap_nbr The number of laps of each frame
+ *  @param[in] load Reads the thumbnails of a frame
+ *  @param[in] load_arg Given to load
+ *  @param[in] pattern The printf format of the path of the images, \
+ *                     with one int conversion for the frame
+ *  @return 1 If the pool is too small or incompatible parameters
+ *  @return 0 Otherwise
+ *
+ *  The frames start from zero, set stream->warm to start each frame
+ *  from the spectrum of the previous one (see swarm_warm), with
+ *  ctx->tolerance to stop once it converged.
+ *
+ */
+int stream_init(struct stream *stream, struct pool *pool,
+                struct swarm_ctx *ctx, int slot_nbr, int lap_nbr,
+                stream_load_fn load, void *load_arg, const char *pattern) {
+  int out_dim = ctx->out_dim;
+  int nbr = (2*ctx->jorga+1)*(2*ctx->jorga+1);
+  size_t out_size, th_size;
+
+  if (slot_nbr <= 0 || slot_nbr > STREAM_SLOTS_MAX || ctx->tiles ||
+      matrix_size(out_dim, out_dim, sizeof(fftw_complex), &out_size) ||
+      matrix_size(ctx->th_dim, ctx->th_dim, sizeof(double), &th_size))
+    return 1;
+
+  stream->ctx = ctx;
+  stream->lap_nbr = lap_nbr;
+  stream->warm = 0;
+  stream->load = load;
+  stream->load_arg = load_arg;
+  stream->pattern = pattern;
+  stream->slot_nbr = slot_nbr;
+  stream->frame_nbr = 0;
+  stream->error = 0;
+  stream->cancelled = 0;
+  stream->written = 0;
+  stream->elapsed = 0;
+
+  stream->frames = (struct stream_frame*)
+    pool_alloc(pool, slot_nbr*sizeof(struct stream_frame));
+  if (stream->frames == NULL)
+    return 1;
+  for (int s = 0; s < slot_nbr; s++) {
+    struct stream_frame *frame = &stream->frames[s];
+    frame->index = -1;
+    frame->thumbnails = (double**) pool_alloc(pool, nbr*sizeof(double*));
+    frame->out = (fftw_complex*) pool_alloc(pool, out_size);
+    if (frame->thumbnails == NULL || frame->out == NULL)
+      return 1;
+    for (int i = 0; i < nbr; i++) {
+      frame->thumbnails[i] = (double*) pool_alloc(pool, th_size);
+      if (frame->thumbnails[i] == NULL)
+        return 1;
+    }
+    matrix_init(out_dim, frame->out, 0);
+  }
+  stream->image = (fftw_complex*) pool_alloc(pool, out_size);
+  stream->io = (double*) pool_alloc(pool, (size_t) out_dim*out_dim*
+                                    sizeof(double));
+  if (stream->image == NULL || stream->io == NULL)
+    return 1;
+
+  /* the plan is executed on the spectrum of every slot */
+  stream->backward = fftw_plan_dft_2d(out_dim, out_dim, stream->frames[0].out,
+                                      stream->image, FFTW_BACKWARD,
+                                      FFTW_ESTIMATE);
+  if (stream->backward == NULL)
+    return 1;
+
+  pthread_mutex_init(&stream->empty.lock, NULL);
+  pthread_cond_init(&stream->empty.cond, NULL);
+  pthread_mutex_init(&stream->loaded.lock, NULL);
+  pthread_cond_init(&stream->loaded.cond, NULL);
+  pthread_mutex_init(&stream->done.lock, NULL);
+  pthread_cond_init(&stream->done.cond, NULL);
+  return 0;
+}
+
+/**
+ *  @brief Loader thread: fill the empty slots with the next frames
+ *
+ */
+static void *stream_loader(void *arg) {
+  struct stream *stream = (struct stream*) arg;
+  int th_dim = stream->ctx->th_dim;
+
+  for (int f = 0; stream->frame_nbr <= 0 || f < stream->frame_nbr; f++) {
+    int slot = stream_queue_pop(&stream->empty);
+    if (slot < 0 || __atomic_load_n(&stream->cancelled, __ATOMIC_ACQUIRE))
+      break;
+    struct stream_frame *frame = &stream->frames[slot];
+
+    TRACE_BEGIN("frame_load");
+    uint64_t start = prof_now();
+    int end = stream->load(stream->load_arg, f, th_dim, frame->thumbnails);
+    stream->stage_ns[0] += prof_now() - start;
+    TRACE_END("frame_load");
+
+    if (end) {
+      /* only an error if the number of frames was given */
+      if (stream->frame_nbr > 0)
+        stream_fail(stream);
+      break;
+    }
+    frame->index = f;
+    stream_queue_push(&stream->loaded, slot);
+  }
+  stream_queue_close(&stream->loaded);
+  return NULL;
+}
+
+/**
+ *  @brief Writer thread: write the image of the reconstructed frames
+ *
+ */
+static void *stream_writer(void *arg) {
+  struct stream *stream = (struct stream*) arg;
+  int out_dim = stream->ctx->out_dim;
+  char name[FILENAME_MAX];
+  int slot;
+
+  while ((slot = stream_queue_pop(&stream->done)) >= 0) {
+    struct stream_frame *frame = &stream->frames[slot];
+
+    TRACE_BEGIN("frame_write");
+    uint64_t start = prof_now();
+    /* out is only read, the reconstruction may start the next frame
+     * from it */
+    fftw_execute_dft(stream->backward, frame->out, stream->image);
+    div_dim(stream->image, stream->image, out_dim);
+    matrix_magnitude(out_dim, stream->image, stream->io);
+    snprintf(name, sizeof(name), stream->pattern, frame->index);
+    if (tiff_frommatrix(name, stream->io, out_dim, out_dim))
+      stream_fail(stream);
+    else
+      stream->written++;
+    stream->stage_ns[2] += prof_now() - start;
+    TRACE_END("frame_write");
+
+    stream_queue_push(&stream->empty, slot);
+  }
+  return NULL;
+}
+
+/**
+ *  @brief Reconstruct a sequence of frames
+ *  @param[in,out] stream The pipeline
+ *  @param[in] frame_nbr The number of frames, <= 0 to go on until \
+ *                       load returns non-zero
+ *  @return 2 If a reconstruction was cancelled (see swarm_cancel)
+ *  @return 1 If a frame could not be loaded, reconstructed or written, \
+ *            or a thread could not be created
+ *  @return 0 Otherwise
+ *
+ *  The reconstructions run in the calling thread, the loading and the
+ *  writing in two other threads. Frame n is written at
+ *  stream->pattern with n, when every frame before it was.
+ *
+ *  A cancelled frame is still written, with the laps done so far, and
+ *  the pipeline stops there: the frames loaded after it are dropped
+ *  and stream->cancelled is set.
+ *
+ */
+int stream_run(struct stream *stream, int frame_nbr) {
+  pthread_t loader, writer;
+  int out_dim = stream->ctx->out_dim;
+  fftw_complex *last = NULL;
+  int slot;
+
+  stream_queue_reset(&stream->empty);
+  stream_queue_reset(&stream->loaded);
+  stream_queue_reset(&stream->done);
+  for (int s = 0; s < stream->slot_nbr; s++)
+    stream_queue_push(&stream->empty, s);
+  stream->frame_nbr = frame_nbr;
+  stream->error = 0;
+  stream->cancelled = 0;
+  stream->written = 0;
+  for (int i = 0; i < 3; i++)
+    stream->stage_ns[i] = 0;
+
+  uint64_t start = prof_now();
+  if (affinity_create(&loader, stream_loader, stream))
+    return 1;
+  if (affinity_create(&writer, stream_writer, stream)) {
+    stream_queue_close(&stream->empty);
+    pthread_join(loader, NULL);
+    return 1;
+  }
+
+  while ((slot = stream_queue_pop(&stream->loaded)) >= 0) {
+    struct stream_frame *frame = &stream->frames[slot];
+
+    TRACE_BEGIN("frame_swarm");
+    uint64_t frame_start = prof_now();
+    /* the loader never writes in out, so the previous spectrum is
+     * still there even if its slot was written and loaded again */
+    if (stream->warm && last) {
+      if (last != frame->out)
+        matrix_copy(last, frame->out, out_dim);
+    } else {
+      matrix_init(out_dim, frame->out, 0);
+    }
+    int error = swarm_run(stream->ctx, frame->thumbnails, stream->lap_nbr,
+                          frame->out);
+    if (error == 5)
+      __atomic_store_n(&stream->cancelled, 1, __ATOMIC_RELEASE);
+    else if (error)
+      stream_fail(stream);
+    last = frame->out;
+    stream->stage_ns[1] += prof_now() - frame_start;
+    TRACE_END("frame_swarm");
+
+    stream_queue_push(&stream->done, slot);
+    if (stream->cancelled) {
+      /* the loader stops at its next frame, what it loaded is dropped */
+      stream_queue_close(&stream->empty);
+      break;
+    }
+  }
+
+  pthread_join(loader, NULL);
+  stream_queue_close(&stream->done);
+  pthread_join(writer, NULL);
+  stream->elapsed = prof_now() - start;
+  if (stream->error)
+    return 1;
+  return stream->cancelled ? 2 : 0;
+}
+
+/**
+ *  @brief Get the sustained rate of the last stream_run
+ *  @return double The number of images written per second
+ *
+ */
+double stream_fps(struct stream *stream) {
+  if (stream->elapsed == 0)
+    return 0;
+  return stream->written*1e9/stream->elapsed;
+}
+
+/**
+ *  @brief Print the rate and the mean time of each stage per frame
+ *
+ *  The slowest stage bounds the rate, the others overlap with it.
+ *
+ */
+void stream_report(struct stream *stream, FILE *file) {
+  fprintf(file, "%d frames in %.3f s, %.2f fps\n", stream->written,
+          stream->elapsed*1e-9, stream_fps(stream));
+  for (int i = 0; i < 3 && stream->written > 0; i++)
+    fprintf(file, "%-8s %12.3f ms/frame\n", stream_stages[i],
+            stream->stage_ns[i]*1e-6/stream->written);
+}
+
+/**
+ *  @brief Destroy the plan and the locks of a pipeline
+ *
+ *  The slots are given back with the pool.
+ *
+ */
+void stream_destroy(struct stream *stream) {
+  fftw_destroy_plan(stream->backward);
+  pthread_cond_destroy(&stream->empty.cond);
+  pthread_mutex_destroy(&stream->empty.lock);
+  pthread_cond_destroy(&stream->loaded.cond);
+  pthread_mutex_destroy(&stream->loaded.lock);
+  pthread_cond_destroy(&stream->done.cond);
+  pthread_mutex_destroy(&stream->done.lock);
+}
+
+/**
+ *  @brief Read the thumbnails of a frame from a directory of tiff images
+ *  @param[in] arg The struct stream_tiff of the frames
+ *  @param[in] frame The number of the frame
+ *  @param[in] th_dim The dimension of each thumbnail
+ *  @param[out] thumbnails The thumbnails, see swarm_run
+ *  @return 1 If a thumbnail is missing or has not the size th_dim
+ *  @return 0 Otherwise
+ *
+ *  The thumbnails of a frame are named xxxxxyyyyy.tiff, as for
+ *  stack_fromtiff. To be given to stream_init as load.
+ *
+ */
+int stream_load_tiff(void *arg, int frame, int th_dim, double **thumbnails) {
+  struct stream_tiff *tiff = (struct stream_tiff*) arg;
+  char dir[FILENAME_MAX];
+  char path[FILENAME_MAX];
+  int side = 2*tiff->jorga+1;
+
+  snprintf(dir, sizeof(dir), tiff->pattern, frame);
+  for (int x = 0; x < side; x++)
+    for (int y = 0; y < side; y++) {
+      uint32 diml, dimw;
+      if (snprintf(path, sizeof(path), "%s/%.5d%.5d.tiff", dir, x, y) >=
+          (int) sizeof(path) ||
+          tiff_getsize(path, &diml, &dimw) ||
+          (int) diml != th_dim || (int) dimw != th_dim ||
+          tiff_tomatrix(path, thumbnails[x*side+y], diml, dimw))
+        return 1;
+    }
+  return 0;
+}
@@ -8,15 +8,20 @@
  */
 
 #include "include/swarm.h"
+#include "include/profile.h"
+#include "include/trace.h"
 
 /**
  *  @brief Computes some operations for one thumbnail
  *  @param[in] thumb The treated thumbnail
- *  @param[in] th_dim The dimension of the thumbnail
+ *  @param[in] kernels The kernels for the dimension of the thumbnail
  *  @param[in] forward The plan used for fourier transforms
  *  @param[in] backward The plan used for inverse transforms
  *  @param[in,out] time The source for FT and destination for IFT
  *  @param[in,out] freq The source for IFT and destination for FT
+ *  @param[in,out] error The residual of the led is added to it, \
+ *                       NULL to skip it (see matrix_residual)
+ *  @param[in,out] norm The energy of the thumbnail is added to it
  *
  *  This function does the following:
  *
@@ -31,22 +36,446 @@
  *  e is actually stored in freq parameter and is available for use
  *  in the calling function
  *
+ *  The plans are executed on time and freq, so they may have been
+ *  made on other buffers of the same dimension (see swarm_share).
+ *
  */
-void update_spectrum(double *thumb, int th_dim, fftw_plan forward,
-                     fftw_plan backward, fftw_complex *time,
-                     fftw_complex *freq) {
+void update_spectrum(double *thumb, struct kernels *kernels,
+                     fftw_plan forward, fftw_plan backward,
+                     fftw_complex *time, fftw_complex *freq,
+                     double *error, double *norm) {
   /** @todo optimize fftw_plans */
-  fftw_execute(backward);
-  div_dim(time, time, th_dim);
+  PROF_START(backward_start);
+  TRACE_BEGIN("fft_backward");
+  fftw_execute_dft(backward, freq, time);
+  TRACE_END("fft_backward");
+  kernels->normalize(kernels->dim, time);
+  PROF_STOP(PROF_BACKWARD, backward_start);
 
-  for (int i = 0; i < th_dim*th_dim; i++) {
-    alg2exp(time[i], time[i]);
-    (time[i])[0] = thumb[i];
-    exp2alg(time[i], time[i]);
+  PROF_START(project_start);
+  if (error) {
+    double energy;
+    *error += matrix_residual(kernels->dim, thumb, time, &energy);
+    *norm += energy;
   }
+  kernels->project(kernels->dim, thumb, time);
+  PROF_STOP(PROF_PROJECT, project_start);
+
+  PROF_START(forward_start);
+  TRACE_BEGIN("fft_forward");
+  fftw_execute_dft(forward, time, freq);
+  TRACE_END("fft_forward");
+  kernels->normalize(kernels->dim, freq);
+  PROF_STOP(PROF_FORWARD, forward_start);
+}
+
+/**
+ *  @brief Get the size of the pool needed by a swarm context
+ *  @param[in] th_dim The dimension of each thumbnail
+ *  @param[in] out_dim The dimension of the final image
+ *  @param[in] radius The radius of the extracted circle
+ *  @return size_t The number of bytes to give to pool_init
+ *
+ */
+size_t swarm_pool_size(int th_dim, int out_dim, int radius) {
+  (void) out_dim;
+  (void) radius;
+  return 2*pool_round((size_t) th_dim*th_dim*sizeof(fftw_complex));
+}
+
+/**
+ *  @brief Prepare everything needed by swarm_run
+ *  @param[out] ctx The context to initialize
+ *  @param[in,out] pool The pool in which the buffers are taken \
+ *                      (see swarm_pool_size)
+ *  @param[in] th_dim The dimension of each thumbnail
+ *  @param[in] out_dim The dimension of the final image
+ *  @param[in] delta The distance between two thumbnail centers
+ *  @param[in] radius The radius of the extracted circle
+ *  @param[in] jorga The dimension of thumbnails is (2*jorga+1)^2
+ *  @return 1 If the pool is too small or incompatible parameters
+ *  @return 0 Otherwise
+ *
+ *  All the memory and the fftw plans are set up here, so that
+ *  swarm_run does not allocate anything.
+ *
+ */
+int swarm_init(struct swarm_ctx *ctx, struct pool *pool,
+               int th_dim, int out_dim, int delta, int radius, int jorga) {
+  size_t th_size;
 
-  fftw_execute(forward);
-  div_dim(freq, freq, th_dim);
+  /** @todo check these formula */
+  /* check if out is big enough */
+  if ((int64_t) jorga*delta + th_dim/2 > out_dim/2 ||
+      matrix_size(th_dim, th_dim, sizeof(fftw_complex), &th_size))
+    return 1;
+
+  ctx->th_dim = th_dim;
+  ctx->out_dim = out_dim;
+  ctx->delta = delta;
+  ctx->radius = radius;
+  ctx->jorga = jorga;
+
+  ctx->time = (fftw_complex*) pool_alloc(pool, th_size);
+  ctx->freq = (fftw_complex*) pool_alloc(pool, th_size);
+  if (ctx->time == NULL || ctx->freq == NULL)
+    return 1;
+
+  ctx->tiles = NULL;
+  ctx->snap = NULL;
+  ctx->preview = NULL;
+  ctx->checkpoint = NULL;
+  ctx->checkpoint_every = 1;
+  ctx->first_lap = 0;
+  ctx->tolerance = 0;
+  ctx->residual = -1;
+  ctx->laps = 0;
+  ctx->feed = NULL;
+  ctx->missing = 0;
+  ctx->budget_ms = 0;
+  ctx->led_ms = 0;
+  ctx->clock = NULL;
+  ctx->leds = 0;
+  ctx->expired = 0;
+  ctx->progress.lap = 0;
+  ctx->progress.led = 0;
+  ctx->progress.residual = -1;
+  ctx->cancel = 0;
+
+  kernels_select(&ctx->kernels, th_dim);
+
+  matrix_init(th_dim, ctx->time, 0);
+  matrix_init(th_dim, ctx->freq, 0);
+
+  ctx->forward = fftw_plan_dft_2d(th_dim, th_dim, ctx->time, ctx->freq,
+                                  FFTW_FORWARD, FFTW_ESTIMATE);
+  ctx->backward = fftw_plan_dft_2d(th_dim, th_dim, ctx->freq, ctx->time,
+                                   FFTW_BACKWARD, FFTW_ESTIMATE);
+  ctx->own_plans = 1;
+  return 0;
+}
+
+/**
+ *  @brief Prepare a context using the plans of another one
+ *  @param[out] ctx The context to initialize
+ *  @param[in,out] pool The pool in which the buffers are taken \
+ *                      (see swarm_pool_size)
+ *  @param[in] model An initialized context with the same th_dim, \
+ *                   out_dim and jorga
+ *  @param[in] delta The distance between two thumbnail centers
+ *  @param[in] radius The radius of the extracted circle
+ *  @return 1 If the pool is too small or incompatible parameters
+ *  @return 0 Otherwise
+ *
+ *  Only the buffers are allocated: no plan is made, and the plans are
+ *  destroyed with model, which must be destroyed after ctx. Both
+ *  contexts can then run at the same time.
+ *
+ */
+int swarm_share(struct swarm_ctx *ctx, struct pool *pool,
+                struct swarm_ctx *model, int delta, int radius) {
+  size_t th_size;
+
+  if ((int64_t) model->jorga*delta + model->th_dim/2 > model->out_dim/2 ||
+      matrix_size(model->th_dim, model->th_dim, sizeof(fftw_complex),
+                  &th_size))
+    return 1;
+
+  *ctx = *model;
+  ctx->delta = delta;
+  ctx->radius = radius;
+  ctx->own_plans = 0;
+
+  ctx->time = (fftw_complex*) pool_alloc(pool, th_size);
+  ctx->freq = (fftw_complex*) pool_alloc(pool, th_size);
+  if (ctx->time == NULL || ctx->freq == NULL)
+    return 1;
+
+  ctx->tiles = NULL;
+  ctx->snap = NULL;
+  ctx->preview = NULL;
+  ctx->checkpoint = NULL;
+  ctx->first_lap = 0;
+  ctx->residual = -1;
+  ctx->laps = 0;
+  ctx->feed = NULL;
+  ctx->missing = 0;
+  ctx->led_ms = 0;
+  ctx->leds = 0;
+  ctx->expired = 0;
+  ctx->progress.lap = 0;
+  ctx->progress.led = 0;
+  ctx->progress.residual = -1;
+  ctx->cancel = 0;
+
+  matrix_init(ctx->th_dim, ctx->time, 0);
+  matrix_init(ctx->th_dim, ctx->freq, 0);
+  return 0;
+}
+
+/**
+ *  @brief Make the plans of a context again
+ *  @param[in,out] ctx The context
+ *  @param[in] flags The planner flags, see tune_plan
+ *  @return 1 If the plans could not be made, the old ones are kept
+ *  @return 0 Otherwise
+ *
+ *  The new plans use the number of threads given last to
+ *  fftw_plan_with_nthreads. The thumbnail buffers are cleared, since
+ *  planning with FFTW_MEASURE writes in them. The plans of a context
+ *  made by swarm_share cannot be changed.
+ *
+ */
+int swarm_replan(struct swarm_ctx *ctx, unsigned flags) {
+  if (!ctx->own_plans)
+    return 1;
+
+  fftw_plan forward = fftw_plan_dft_2d(ctx->th_dim, ctx->th_dim, ctx->time,
+                                       ctx->freq, FFTW_FORWARD, flags);
+  fftw_plan backward = fftw_plan_dft_2d(ctx->th_dim, ctx->th_dim, ctx->freq,
+                                        ctx->time, FFTW_BACKWARD, flags);
+  if (forward == NULL || backward == NULL) {
+    if (forward)
+      fftw_destroy_plan(forward);
+    if (backward)
+      fftw_destroy_plan(backward);
+    return 1;
+  }
+
+  fftw_destroy_plan(ctx->forward);
+  fftw_destroy_plan(ctx->backward);
+  ctx->forward = forward;
+  ctx->backward = backward;
+  matrix_init(ctx->th_dim, ctx->time, 0);
+  matrix_init(ctx->th_dim, ctx->freq, 0);
+  return 0;
+}
+
+/**
+ *  @brief Destroy the plans of a context
+ *
+ *  The buffers are given back with the pool. The plans shared with
+ *  swarm_share are left to their owner.
+ *
+ */
+void swarm_destroy(struct swarm_ctx *ctx) {
+  if (!ctx->own_plans)
+    return;
+  fftw_destroy_plan(ctx->forward);
+  fftw_destroy_plan(ctx->backward);
+}
+
+/**
+ *  @brief Write a checkpoint of the reconstruction
+ *  @param[in] ctx The context of the reconstruction
+ *  @param[in] out The spectrum
+ *  @param[in] lap The number of laps done
+ *  @return 1 If the checkpoint could not be written
+ *  @return 0 Otherwise
+ *
+ *  The checkpoint is written in ctx->checkpoint.
+ *
+ */
+int swarm_checkpoint(struct swarm_ctx *ctx, fftw_complex *out, int lap) {
+  struct checkpoint_header header;
+  memset(&header, 0, sizeof(header));
+  header.th_dim = ctx->th_dim;
+  header.out_dim = ctx->out_dim;
+  header.delta = ctx->delta;
+  header.radius = ctx->radius;
+  header.jorga = ctx->jorga;
+  header.lap = lap;
+  /* laps always start from the center led */
+  header.pos_x = header.pos_y = ctx->jorga+1;
+  return checkpoint_write(ctx->checkpoint, &header, out);
+}
+
+/**
+ *  @brief Resume a reconstruction from a checkpoint
+ *  @param[in,out] ctx The context of the reconstruction
+ *  @param[in] name The path of the checkpoint
+ *  @param[out] out The spectrum read from the checkpoint
+ *  @return 1 If the checkpoint could not be read or its parameters \
+ *            are not the ones of ctx
+ *  @return 0 Otherwise
+ *
+ *  The next call of swarm_run starts from the lap saved in the
+ *  checkpoint instead of the first one.
+ *
+ */
+int swarm_resume(struct swarm_ctx *ctx, const char *name, fftw_complex *out) {
+  struct checkpoint_header header;
+  if (checkpoint_read_header(name, &header))
+    return 1;
+  if (header.th_dim != ctx->th_dim || header.out_dim != ctx->out_dim ||
+      header.delta != ctx->delta || header.radius != ctx->radius ||
+      header.jorga != ctx->jorga || header.lap < 0)
+    return 1;
+  if (checkpoint_load(name, &header, out))
+    return 1;
+  ctx->first_lap = header.lap;
+  return 0;
+}
+
+/**
+ *  @brief Start a reconstruction from the spectrum of a checkpoint
+ *  @param[in] ctx The context of the reconstruction
+ *  @param[in] name The path of the checkpoint, usually of the previous \
+ *                  frame of a time-lapse or z-stack
+ *  @param[out] out The spectrum read from the checkpoint
+ *  @return 1 If the checkpoint could not be read or its spectrum \
+ *            does not have the dimension of out
+ *  @return 0 Otherwise
+ *
+ *  Unlike swarm_resume, the laps of the checkpoint are not skipped and
+ *  only out_dim must match: the spectrum is only a better starting
+ *  point than zero, to be used with ctx->tolerance.
+ *
+ */
+int swarm_warm(struct swarm_ctx *ctx, const char *name, fftw_complex *out) {
+  struct checkpoint_header header;
+  if (checkpoint_read_header(name, &header) ||
+      header.out_dim != ctx->out_dim)
+    return 1;
+  return checkpoint_load(name, &header, out);
+}
+
+/**
+ *  @brief Ask a running reconstruction to stop
+ *  @param[in,out] ctx The context given to swarm_run
+ *
+ *  Can be called from any thread, or from a signal handler. swarm_run
+ *  stops before its next led and returns 5, out keeping every update
+ *  done so far. Called before swarm_run, the run stops at once.
+ *  A run waiting for a thumbnail of ctx->feed stops within
+ *  FEED_INTERVAL_MS (see feed_wait_cancel).
+ *
+ */
+void swarm_cancel(struct swarm_ctx *ctx) {
+  __atomic_store_n(&ctx->cancel, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ *  @brief Read where a reconstruction is, from any thread
+ *  @param[in] ctx The context given to swarm_run
+ *  @param[out] progress The lap, led and residual of the run
+ *
+ *  Each field is read atomically, without lock, but the three of them
+ *  can come from successive leds.
+ *
+ */
+void swarm_poll(struct swarm_ctx *ctx, struct swarm_progress *progress) {
+  progress->lap = __atomic_load_n(&ctx->progress.lap, __ATOMIC_ACQUIRE);
+  progress->led = __atomic_load_n(&ctx->progress.led, __ATOMIC_ACQUIRE);
+  __atomic_load(&ctx->progress.residual, &progress->residual,
+                __ATOMIC_ACQUIRE);
+}
+
+/**
+ *  @brief Check if the run must stop before the next led
+ *  @return 1 If the budget expired or the run was cancelled
+ *  @return 0 Otherwise
+ *
+ */
+static int swarm_stopped(struct swarm_ctx *ctx) {
+  return ctx->expired || __atomic_load_n(&ctx->cancel, __ATOMIC_ACQUIRE);
+}
+
+/**
+ *  @brief Read the clock of the budget
+ *  @return uint64_t The time in nanoseconds
+ *
+ */
+static uint64_t swarm_now(struct swarm_ctx *ctx) {
+  return ctx->clock ? ctx->clock(ctx) : prof_now();
+}
+
+/**
+ *  @brief Get the time since the start of swarm_run
+ *  @return double The elapsed time in milliseconds
+ *
+ */
+static double swarm_elapsed_ms(struct swarm_ctx *ctx) {
+  return (swarm_now(ctx) - ctx->start)*1e-6;
+}
+
+/**
+ *  @brief Update the spectrum with the thumbnail of one led
+ *  @param[in,out] ctx The context of the reconstruction
+ *  @param[in] thumb The thumbnail of the led, NULL if it is missing
+ *  @param[in,out] out The spectrum being retrieved, unused if ctx->tiles
+ *  @param[in] centerX The x coordinate of the led disk in out
+ *  @param[in] centerY The y coordinate of the led disk in out
+ *  @return 2 If radius too big or a tile could not be read or written
+ *  @return 0 Otherwise
+ *
+ *  The disk centered on [centerX;centerY] is extracted from out,
+ *  updated (see update_spectrum) and written back in out.
+ *  A missing led is only counted in ctx->missing, and nothing is done
+ *  once the budget of the run expired or the run was cancelled.
+ *
+ */
+int update_led(struct swarm_ctx *ctx, double *thumb, fftw_complex *out,
+               int centerX, int centerY) {
+  int error = 0;
+
+  if (swarm_stopped(ctx))
+    return 0;
+  if (thumb == NULL) {
+    ctx->missing++;
+    return 0;
+  }
+
+  uint64_t led_time = swarm_now(ctx);
+  TRACE_BEGIN("led");
+  PROF_START(led_start);
+  PROF_START(extract_start);
+  ctx->kernels.clear(ctx->th_dim, ctx->freq);
+  if (ctx->tiles) {
+    if (tiles_copy_disk(ctx->tiles, ctx->freq, ctx->th_dim,
+                        centerX, centerY, ctx->radius, 0))
+      error = 2;
+  } else if (ctx->kernels.extract(ctx->th_dim, out, ctx->out_dim,
+                                  centerX, centerY, ctx->radius,
+                                  ctx->freq)) {
+    error = 2;
+  }
+  PROF_STOP(PROF_EXTRACT, extract_start);
+
+  update_spectrum(thumb, &ctx->kernels, ctx->forward, ctx->backward,
+                  ctx->time, ctx->freq,
+                  ctx->tolerance > 0 ? &ctx->error : NULL, &ctx->norm);
+
+  PROF_START(writeback_start);
+  if (ctx->tiles) {
+    if (tiles_copy_disk(ctx->tiles, ctx->freq, ctx->th_dim,
+                        centerX, centerY, ctx->radius, 1))
+      error = 2;
+  } else if (ctx->kernels.writeback(ctx->th_dim, ctx->freq, out,
+                                    ctx->out_dim, centerX, centerY,
+                                    ctx->radius)) {
+    error = 2;
+  }
+  PROF_STOP(PROF_WRITEBACK, writeback_start);
+  PROF_STOP(PROF_LED, led_start);
+  TRACE_END("led");
+
+  /* counted first, so that ctx->clock can follow the leds done */
+  ctx->leds++;
+  double led_ms = (swarm_now(ctx) - led_time)*1e-6;
+  ctx->led_ms = ctx->led_ms > 0 ?
+    ctx->led_ms + (led_ms - ctx->led_ms)/SWARM_LED_SMOOTHING : led_ms;
+  /* only this thread writes the progress */
+  __atomic_store_n(&ctx->progress.led, ctx->progress.led+1,
+                   __ATOMIC_RELEASE);
+  if (ctx->budget_ms > 0 &&
+      swarm_elapsed_ms(ctx) + ctx->led_ms > ctx->budget_ms)
+    ctx->expired = 1;
+
+  if (ctx->snap && out)
+    snapshot_led(ctx->snap, out, ctx->freq);
+
+  return error;
 }
 
 /**
@@ -76,6 +505,26 @@ int move_one(int* index_x, int* index_y, int direction) {
   return 0;
 }
 
+/**
+ *  @brief Get the thumbnail of a led, waiting for it if needed
+ *  @param[in,out] ctx The context of the reconstruction
+ *  @param[in] thumbnails All the thumbnails in one big matrix
+ *  @param[in] pos_x The x coordinate of the led, from 1 to 2*jorga+1
+ *  @param[in] pos_y The y coordinate of the led, from 1 to 2*jorga+1
+ *  @return double* The thumbnail, NULL if ctx->feed was closed before \
+ *                  it arrived or the run stops
+ *
+ */
+static double *swarm_thumbnail(struct swarm_ctx *ctx, double **thumbnails,
+                               int pos_x, int pos_y) {
+  int index = (pos_x-1)*(2*ctx->jorga+1)+(pos_y-1);
+  if (swarm_stopped(ctx))
+    return NULL;
+  if (ctx->feed && feed_wait_cancel(ctx->feed, index, &ctx->cancel))
+    return NULL;
+  return thumbnails[index];
+}
+
 /**
  *  @brief Update the leds between two corners in a row
  *  @return 1 if move_one error
@@ -83,74 +532,38 @@ int move_one(int* index_x, int* index_y, int direction) {
  *
  *  the leds in the corner should be updated by another function
  */
-int move_streak(double **thumbnails, fftw_complex *time,
-                fftw_complex *freq, fftw_complex *out,
-                fftw_plan forward, fftw_plan backward,
-                int th_dim, int out_dim, int radius, int delta, int side,
-                int *pos_x, int *pos_y, int side_leds,
-                int direction) {
+int move_streak(struct swarm_ctx *ctx, double **thumbnails, fftw_complex *out,
+                int *pos_x, int *pos_y, int side_leds, int direction) {
   int error = 0;
-  int mid = (side-1)/2 + 1;  // = jorga+1
+  int mid = ctx->jorga + 1;
   /* the center of the disk in out */
   int centerX, centerY;
   for (int remaining = side_leds; remaining != 0; remaining--) {
     error = move_one(pos_x, pos_y, direction);
-    centerX = (*pos_x-mid)*delta;
-    centerY = (*pos_y-mid)*delta;
-    matrix_init(th_dim, freq, 0);
-    if (copy_disk_ultimate(out, freq, out_dim, th_dim,
-                           centerX, centerY, 0, 0, radius))
-      error = 2;
-    update_spectrum(thumbnails[(*pos_x-1)*side+(*pos_y-1)],
-                    th_dim, forward, backward, time, freq);
-    if (copy_disk_ultimate(freq, out, th_dim, out_dim,
-                           0, 0, centerX, centerY, radius))
+    centerX = (*pos_x-mid)*ctx->delta;
+    centerY = (*pos_y-mid)*ctx->delta;
+    if (update_led(ctx, swarm_thumbnail(ctx, thumbnails, *pos_x, *pos_y),
+                   out, centerX, centerY))
       error = 2;
   }
   return error;
 }
 
 /**
- *  @brief Unite multiple small images in a big one
+ *  @brief Update every led once, in a spiral from the center
+ *  @param[in,out] ctx The context of the reconstruction
  *  @param[in] thumbnails All the thumbnails in one big matrix
- *  @param[in] th_dim The dimension of each thumbnail
- *  @param[in] out_dim The dimension of the final image
- *  @param[in] delta The distance between two thumbnail centers
- *  @param[in] lap_nbr The number of lap done
- *  @param[in] radius The radius of the extracted circle
- *  @param[in] jorga The dimension of thumbnails is (2*jorga+1)^2
- *  @param[out] out The retrieved image after the algorithm is done
+ *  @param[in,out] out The spectrum, NULL if ctx->tiles is set
+ *  @return 2 If a disk could not be copied (see update_led)
+ *  @return 1 If move_one error
+ *  @return 0 Otherwise
+ *
+ *  The lap goes on after an error, the first one is returned.
  *
- *  @return 1 If memory allocation failed or incompatible parameters
- *  @return 0 0therwise
  */
-int swarm(double **thumbnails, int th_dim, int out_dim, int delta,
-          const int lap_nbr, int radius, int jorga, fftw_complex *out) {
-  /** @todo check these formula */
-  /* check if out is big enough */
-  if (jorga*delta + th_dim/2 > out_dim/2)
-    return 1;
-
-  fftw_complex *time;
-  fftw_complex *freq;
-  fftw_plan forward;
-  fftw_plan backward;
-
-  if ( (time = (fftw_complex *) fftw_malloc(th_dim*th_dim*
-                                      sizeof(fftw_complex))) == NULL )
-    return 1;
-
-  if ( (freq = (fftw_complex *) fftw_malloc(th_dim*th_dim*
-                                     sizeof(fftw_complex))) == NULL )
-    return 1;
-
-  for (int i = 0; i < th_dim*th_dim; i++)
-    time[i][0] = time[i][1] = freq[i][0] = freq[i][1] = 0;
-
-  forward = fftw_plan_dft_2d(th_dim, th_dim, time, freq,
-                              FFTW_FORWARD, FFTW_ESTIMATE);
-  backward = fftw_plan_dft_2d(th_dim, th_dim, freq, time,
-                              FFTW_BACKWARD, FFTW_ESTIMATE);
+static int swarm_lap(struct swarm_ctx *ctx, double **thumbnails,
+                     fftw_complex *out) {
+  int error = 0;
 
   /*
    *  Spiral loop
@@ -167,223 +580,447 @@ int swarm(double **thumbnails, int th_dim, int out_dim, int delta,
 
   /* the coordinates of the thumbnail in the center
    * of thumbnails are [mid;mid] */
-  const int mid = jorga+1;
+  const int mid = ctx->jorga+1;
 
-  /* the side of thumbnails */
-  const int side = 2*jorga+1;
+  /* the direction of the next led */
+  int direction = DOWN;
 
-  #ifdef DEBUG /* !! debug_start !! */
-  int step = 0;
-  #endif /* !! debug_end !! */
+  /*
+   * the number of leds exploited (update_spectrum) in the same streak
+   * exluding the leds in the corner
+   *
+   * for example: for the first move of the lap, side_leds is 0 cause
+   * we have two successive leds that are in a corner
+   */
+  int side_leds = 0;
 
-  for (int lap = 0; lap < lap_nbr; lap++) {
-    /* the direction of the next led */
-    int direction = DOWN;
-
-    /*
-     * the number of leds exploited (update_spectrum) in the same streak
-     * exluding the leds in the corner
-     *
-     * for example: for the first move of the lap, side_leds is 0 cause
-     * we have two successive leds that are in a corner
-     */
-    int side_leds = 0;
-
-    /* index in thumbnails */
-    int pos_x = mid;
-    int pos_y = mid;
-
-
-    #ifdef DEBUG /* !! debug_start !! */
-    char name[60];
-
-    double *out_io0 = (double*) malloc(out_dim*out_dim*sizeof(double));
-    double *th_io0 = (double*) malloc(th_dim*th_dim*sizeof(double));
-    double *out_io1 = (double*) malloc(out_dim*out_dim*sizeof(double));
-    double *th_io1 = (double*) malloc(th_dim*th_dim*sizeof(double));
-    fftw_complex *out_tmp;
-    fftw_complex *th_tmp;
-    out_tmp = (fftw_complex*) fftw_malloc(out_dim*out_dim*
-                                          sizeof(fftw_complex));
-    th_tmp = (fftw_complex*) fftw_malloc(th_dim*th_dim*
-                                         sizeof(fftw_complex));
-
-    for (int i = 0; i < out_dim * out_dim; i++) {
-      alg2exp(out[i], out_tmp[i]);
-      out_io0[i] = (out_tmp[i])[0];
-      out_io1[i] = (out_tmp[i])[1];
-    }
-    snprintf(name, 50, "build/swarm0_%.4d.tiff", step++);
-    tiff_frommatrix(name, out_io0, out_dim, out_dim);
-    snprintf(name, 50, "build/swarm1_%.4d.tiff", step++);
-    tiff_frommatrix(name, out_io1, out_dim, out_dim);
-    #endif /* !! debug_end !! */
-    matrix_init(th_dim, freq, 0);
-
-    copy_disk_ultimate(out, freq, out_dim, th_dim, 0, 0, 0, 0, radius);
-    /* special: no adjacent circle */
-    update_spectrum(thumbnails[(pos_x-1)*side+(pos_y-1)],
-                    th_dim, forward, backward, time, freq);
-    copy_disk_ultimate(freq, out, th_dim, out_dim, 0, 0, 0, 0, radius);
-
-    #ifdef DEBUG /* !! debug_start !! */
-    for (int i = 0; i < out_dim * out_dim; i++) {
-      alg2exp(out[i], out_tmp[i]);
-      out_io0[i] = (out_tmp[i])[0];
-      out_io1[i] = (out_tmp[i])[1];
-    }
-    snprintf(name, 50, "build/swarm0_%.4d.tiff", step++);
-    tiff_frommatrix(name, out_io0, out_dim, out_dim);
-    snprintf(name, 50, "build/swarm1_%.4d.tiff", step++);
-    tiff_frommatrix(name, out_io1, out_dim, out_dim);
-
-    for (int i = 0; i < th_dim * th_dim; i++) {
-      alg2exp(freq[i], th_tmp[i]);
-      th_io0[i] = (th_tmp[i])[0];
-      th_io1[i] = (th_tmp[i])[1];
-    }
-    snprintf(name, 50, "build/freq0_%.4d.tiff", step++);
-    tiff_frommatrix(name, th_io0, th_dim, th_dim);
-    snprintf(name, 50, "build/freq1_%.4d.tiff", step++);
-    tiff_frommatrix(name, th_io1, th_dim, th_dim);
-    #endif /* !! debug_end !! */
-
-    /*
-     * one whorl correspond of a move going from one corner
-     * to the same but farther from the center by going in spiral
-     * example : from [-2, 2] to [-3, 3]
-     *
-     * a whorl correspond to four streaks
-     */
-    for (int whorl = 1; whorl <= 2*jorga; whorl++) {
-      /* side leds */
-      move_streak(thumbnails, time, freq, out, forward, backward,
-                  th_dim, out_dim, radius, delta, side, &pos_x, &pos_y,
-                  side_leds, direction);
-
-      /* @bug error management */
-      int error;
-      int centerX, centerY;
-
-      /* special: corner led */
-      move_one(&pos_x, &pos_y, direction);
-      centerX = (pos_x-mid)*delta;
-      centerY = (pos_y-mid)*delta;
-      matrix_init(th_dim, freq, 0);
-      if (copy_disk_ultimate(out, freq, out_dim, th_dim,
-                             centerX, centerY, 0, 0, radius))
-        error = 2;
-      update_spectrum(thumbnails[(pos_x-1)*side+(pos_y-1)],
-                      th_dim, forward, backward, time, freq);
-      if (copy_disk_ultimate(freq, out, th_dim, out_dim,
-                             0, 0, centerX, centerY, radius))
-        error = 2;
-
-      #ifdef DEBUG /* !! debug_start !! */
-      for (int i = 0; i < out_dim * out_dim; i++) {
-        alg2exp(out[i], out_tmp[i]);
-        out_io0[i] = (out_tmp[i])[0];
-        out_io1[i] = (out_tmp[i])[1];
-      }
-      snprintf(name, 50, "build/swarm0_%.4d.tiff", step++);
-      tiff_frommatrix(name, out_io0, out_dim, out_dim);
-      snprintf(name, 50, "build/swarm1_%.4d.tiff", step++);
-      tiff_frommatrix(name, out_io1, out_dim, out_dim);
-
-      for (int i = 0; i < th_dim * th_dim; i++) {
-        alg2exp(freq[i], th_tmp[i]);
-        th_io0[i] = (th_tmp[i])[0];
-        th_io1[i] = (th_tmp[i])[1];
-      }
-      snprintf(name, 50, "build/freq0_%.4d.tiff", step++);
-      tiff_frommatrix(name, th_io0, th_dim, th_dim);
-      snprintf(name, 50, "build/freq1_%.4d.tiff", step++);
-      tiff_frommatrix(name, th_io1, th_dim, th_dim);
-      #endif /* !! debug_end !! */
-
-      /* direction change: clockwise route */
-      direction = (direction+1)%4;
-
-      /* side leds */
-      move_streak(thumbnails, time, freq, out, forward, backward,
-                  th_dim, out_dim, radius, delta, side, &pos_x, &pos_y,
-                  side_leds, direction);
-
-      /* special: corner led */
-      move_one(&pos_x, &pos_y, direction);
-      centerX = (pos_x-mid)*delta;
-      centerY = (pos_y-mid)*delta;
-      matrix_init(th_dim, freq, 0);
-      if (copy_disk_ultimate(out, freq, out_dim, th_dim,
-                             centerX, centerY, 0, 0, radius))
-        error = 2;
-      update_spectrum(thumbnails[(pos_x-1)*side+(pos_y-1)],
-                      th_dim, forward, backward, time, freq);
-      if (copy_disk_ultimate(freq, out, th_dim, out_dim,
-                             0, 0, centerX, centerY, radius))
-        error = 2;
-
-      #ifdef DEBUG /* !! debug_start !! */
-      for (int i = 0; i < out_dim * out_dim; i++) {
-        alg2exp(out[i], out_tmp[i]);
-        out_io0[i] = (out_tmp[i])[0];
-        out_io1[i] = (out_tmp[i])[1];
-      }
-      snprintf(name, 50, "build/swarm0_%.4d.tiff", step++);
-      tiff_frommatrix(name, out_io0, out_dim, out_dim);
-      snprintf(name, 50, "build/swarm1_%.4d.tiff", step++);
-      tiff_frommatrix(name, out_io1, out_dim, out_dim);
-
-      for (int i = 0; i < th_dim * th_dim; i++) {
-        alg2exp(freq[i], th_tmp[i]);
-        th_io0[i] = (th_tmp[i])[0];
-        th_io1[i] = (th_tmp[i])[1];
-      }
-      snprintf(name, 50, "build/freq0_%.4d.tiff", step++);
-      tiff_frommatrix(name, th_io0, th_dim, th_dim);
-      snprintf(name, 50, "build/freq1_%.4d.tiff", step++);
-      tiff_frommatrix(name, th_io1, th_dim, th_dim);
-      #endif /* !! debug_end !! */
-
-      direction = (direction+1)%4;
-      side_leds++;
+  /* index in thumbnails */
+  int pos_x = mid;
+  int pos_y = mid;
+
+  /* special: no adjacent circle */
+  error = update_led(ctx, swarm_thumbnail(ctx, thumbnails, pos_x, pos_y),
+                     out, 0, 0);
+
+  /*
+   * one whorl correspond of a move going from one corner
+   * to the same but farther from the center by going in spiral
+   * example : from [-2, 2] to [-3, 3]
+   *
+   * a whorl correspond to four streaks
+   */
+  for (int whorl = 1; whorl <= 2*ctx->jorga; whorl++) {
+    int led_error;
+
+    /* side leds */
+    led_error = move_streak(ctx, thumbnails, out, &pos_x, &pos_y,
+                            side_leds, direction);
+    if (!error)
+      error = led_error;
+
+    int centerX, centerY;
+
+    /* special: corner led */
+    move_one(&pos_x, &pos_y, direction);
+    centerX = (pos_x-mid)*ctx->delta;
+    centerY = (pos_y-mid)*ctx->delta;
+    led_error = update_led(ctx, swarm_thumbnail(ctx, thumbnails, pos_x, pos_y),
+                           out, centerX, centerY);
+    if (!error)
+      error = led_error;
+
+    /* direction change: clockwise route */
+    direction = (direction+1)%4;
+
+    /* side leds */
+    led_error = move_streak(ctx, thumbnails, out, &pos_x, &pos_y,
+                            side_leds, direction);
+    if (!error)
+      error = led_error;
+
+    /* special: corner led */
+    move_one(&pos_x, &pos_y, direction);
+    centerX = (pos_x-mid)*ctx->delta;
+    centerY = (pos_y-mid)*ctx->delta;
+    led_error = update_led(ctx, swarm_thumbnail(ctx, thumbnails, pos_x, pos_y),
+                           out, centerX, centerY);
+    if (!error)
+      error = led_error;
+
+    direction = (direction+1)%4;
+    side_leds++;
+  }
+
+  /* at this point side_leds = side */
+  /* we just need to finish the spiral */
+
+  int led_error = move_streak(ctx, thumbnails, out, &pos_x, &pos_y,
+                              side_leds, direction);
+  if (!error)
+    error = led_error;
+  /* there is no corner led here */
+  /* the spiral lap is done at this point */
+  return error;
+}
+
+/**
+ *  @brief Unite multiple small images in a big one
+ *  @param[in,out] ctx The context prepared by swarm_init
+ *  @param[in] thumbnails All the thumbnails in one big matrix
+ *  @param[in] lap_nbr The number of lap done
+ *  @param[in,out] out The retrieved image after the algorithm is done, \
+ *                     its content is used as the initial spectrum, \
+ *                     NULL if ctx->tiles is set
+ *
+ *  @return 5 If the run was cancelled (see swarm_cancel)
+ *  @return 4 If ctx->feed was closed before every thumbnail arrived
+ *  @return 3 If a checkpoint could not be written
+ *  @return 2 If a disk could not be copied (radius too big, or a tile \
+ *            could not be read or written back): the laps stop there
+ *  @return 0 Otherwise
+ *
+ *  The first error is returned.
+ *
+ *  Nothing is allocated on the heap by this function.
+ *
+ *  The laps start at ctx->first_lap (see swarm_resume), which is reset
+ *  to 0 on return. If ctx->checkpoint is set, a checkpoint is written
+ *  every ctx->checkpoint_every laps.
+ *
+ *  If ctx->tiles is set, the spectrum is in these tiles instead of out:
+ *  snapshots, previews and checkpoints are then skipped.
+ *
+ *  If ctx->preview is set (see snapshot_preview), the image is
+ *  written at its resolution after each lap, from the low frequencies
+ *  of the spectrum only.
+ *
+ *  If ctx->tolerance is set, the residual of each lap (the relative
+ *  distance between the modules of the thumbnails and the ones of the
+ *  spectrum, see matrix_residual) is kept in ctx->residual, and the
+ *  laps stop once it is below the tolerance. ctx->laps tells how many
+ *  laps were done.
+ *
+ *  If ctx->feed is set, each led waits for its thumbnail (see
+ *  feed_wait_cancel): the first lap follows the acquisition, which goes
+ *  from the center out as the spiral, and the next laps run once every
+ *  thumbnail is there. The leds of a closed feed are skipped.
+ *
+ *  If ctx->budget_ms is set, the time of a led update is followed
+ *  (ctx->led_ms, on ctx->clock) and no lap is started unless it is
+ *  expected to end within the budget. A lap is also cut at the led
+ *  which would exceed it, leaving out with every update done so far:
+ *  ctx->expired is set, ctx->laps counts the whole laps only and
+ *  ctx->leds every update.
+ *
+ *  The lap and led being done are in ctx->progress, which other
+ *  threads read with swarm_poll, and swarm_cancel stops the run
+ *  before the next led in the same way as the budget.
+ *
+ */
+int swarm_run(struct swarm_ctx *ctx, double **thumbnails, const int lap_nbr,
+              fftw_complex *out) {
+  int error = 0;
+
+  PROF_RESET();
+
+  ctx->residual = -1;
+  ctx->laps = 0;
+  ctx->missing = 0;
+  ctx->leds = 0;
+  ctx->expired = 0;
+  ctx->start = swarm_now(ctx);
+  double residual = -1;
+  __atomic_store(&ctx->progress.residual, &residual, __ATOMIC_RELEASE);
+  int led_nbr = (2*ctx->jorga+1)*(2*ctx->jorga+1);
+  for (int lap = ctx->first_lap; lap < lap_nbr; lap++) {
+    /* the first lap is always started, ctx->led_ms may be unknown */
+    if (ctx->budget_ms > 0 && lap > ctx->first_lap &&
+        swarm_elapsed_ms(ctx) + led_nbr*ctx->led_ms > ctx->budget_ms)
+      ctx->expired = 1;
+    if (swarm_stopped(ctx))
+      break;
+    __atomic_store_n(&ctx->progress.led, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&ctx->progress.lap, lap, __ATOMIC_RELEASE);
+
+    TRACE_BEGIN("lap");
+    PROF_START(lap_start);
+
+    ctx->error = 0;
+    ctx->norm = 0;
+    int done = ctx->leds + ctx->missing;
+    int lap_error = swarm_lap(ctx, thumbnails, out);
+
+    PROF_STOP(PROF_LAP, lap_start);
+    TRACE_END("lap");
+
+    if (lap_error) {
+      error = lap_error;
+      break;
     }
 
-    /* at this point side_leds = side */
-    /* we just need to finish the spiral */
-
-    move_streak(thumbnails, time, freq, out, forward, backward,
-                th_dim, out_dim, radius, delta, side, &pos_x, &pos_y,
-                side_leds, direction);
-    #ifdef DEBUG /* !! debug_start !! */
-    for (int i = 0; i < out_dim * out_dim; i++) {
-      alg2exp(out[i], out_tmp[i]);
-      out_io0[i] = (out_tmp[i])[0];
-      out_io1[i] = (out_tmp[i])[1];
+    /* a cut lap is neither saved nor measured */
+    if (ctx->leds + ctx->missing - done < led_nbr)
+      break;
+    ctx->laps++;
+
+    if (ctx->snap && out)
+      snapshot_lap(ctx->snap, out);
+    if (ctx->preview && out)
+      snapshot_crop(ctx->preview, out, ctx->out_dim);
+
+    if (out && ctx->checkpoint && ctx->checkpoint_every > 0 &&
+        (lap+1) % ctx->checkpoint_every == 0 &&
+        swarm_checkpoint(ctx, out, lap+1) && !error)
+      error = 3;
+
+    if (ctx->tolerance > 0) {
+      ctx->residual = ctx->norm > 0 ? sqrt(ctx->error/ctx->norm) : 0;
+      __atomic_store(&ctx->progress.residual, &ctx->residual,
+                     __ATOMIC_RELEASE);
+      if (ctx->residual < ctx->tolerance)
+        break;
     }
-    snprintf(name, 50, "build/swarm0_%.4d.tiff", step++);
-    tiff_frommatrix(name, out_io0, out_dim, out_dim);
-    snprintf(name, 50, "build/swarm1_%.4d.tiff", step++);
-    tiff_frommatrix(name, out_io1, out_dim, out_dim);
-    #endif /* !! debug_end !! */
-    /* there is no corner led here */
-    /* the spiral lap is done at this point */
-
-    #ifdef DEBUG /* !! debug_start !! */
-    free(out_io0);
-    free(out_io1);
-    free(th_io0);
-    free(th_io1);
-    fftw_free(out_tmp);
-    fftw_free(th_tmp);
-    #endif /* !! debug_end !! */
   }
 
-  fftw_destroy_plan(forward);
-  fftw_destroy_plan(backward);
+  ctx->first_lap = 0;
+  if (ctx->missing && !error)
+    error = 4;
+  /* a cancel coming after the last led is for this run, not the next */
+  if (__atomic_exchange_n(&ctx->cancel, 0, __ATOMIC_ACQ_REL) && !error)
+    error = 5;
 
-  fftw_free(time);
-  fftw_free(freq);
+  PROF_REPORT();
 
-  return 0;
+  return error;
+}
+
+/**
+ *  @brief Set up a context for a single call of swarm_run
+ *  @param[in] tolerance See swarm_until
+ *  @param[in] budget_ms See swarm_within
+ *  @param[out] laps The number of laps done, or NULL
+ *  @param[out] leds The number of led updates done, or NULL
+ *
+ *  The other parameters are the ones of swarm.
+ *
+ */
+static int swarm_once(double **thumbnails, int th_dim, int out_dim,
+                      int delta, const int lap_nbr, int radius, int jorga,
+                      double tolerance, double budget_ms, int *laps,
+                      int *leds, fftw_complex *out) {
+  struct pool pool;
+  struct swarm_ctx ctx;
+  size_t size = swarm_pool_size(th_dim, out_dim, radius);
+
+  #ifdef DEBUG /* !! debug_start !! */
+  struct snapshot snap;
+  size += snapshot_pool_size(out_dim, th_dim, SNAPSHOT_DEBUG_SLOTS);
+  #endif /* !! debug_end !! */
+
+  if (pool_init(&pool, size))
+    return 1;
+
+  if (swarm_init(&ctx, &pool, th_dim, out_dim, delta, radius, jorga)) {
+    pool_destroy(&pool);
+    return 1;
+  }
+
+  #ifdef DEBUG /* !! debug_start !! */
+  if (snapshot_init(&snap, &pool, out_dim, th_dim, SNAPSHOT_DEBUG_SLOTS,
+                    1, 1) == 0)
+    ctx.snap = &snap;
+  #endif /* !! debug_end !! */
+
+  ctx.tolerance = tolerance;
+  ctx.budget_ms = budget_ms;
+  int error = swarm_run(&ctx, thumbnails, lap_nbr, out);
+  if (laps)
+    *laps = ctx.laps;
+  if (leds)
+    *leds = ctx.leds;
+
+  #ifdef DEBUG /* !! debug_start !! */
+  if (ctx.snap)
+    snapshot_destroy(&snap);
+  #endif /* !! debug_end !! */
+
+  swarm_destroy(&ctx);
+  pool_destroy(&pool);
+  return error;
+}
+
+/**
+ *  @brief Unite multiple small images in a big one
+ *  @param[in] thumbnails All the thumbnails in one big matrix
+ *  @param[in] th_dim The dimension of each thumbnail
+ *  @param[in] out_dim The dimension of the final image
+ *  @param[in] delta The distance between two thumbnail centers
+ *  @param[in] lap_nbr The number of lap done
+ *  @param[in] radius The radius of the extracted circle
+ *  @param[in] jorga The dimension of thumbnails is (2*jorga+1)^2
+ *  @param[in] tolerance Stop once the residual of a lap is below, \
+ *                       0 to do every lap (see swarm_run)
+ *  @param[out] laps The number of laps done, or NULL
+ *  @param[in,out] out The retrieved image after the algorithm is done, \
+ *                     its content is used as the initial spectrum
+ *
+ *  @return 1 If memory allocation failed or incompatible parameters
+ *  @return 0 0therwise
+ *
+ *  Wrapper setting up a context for a single call of swarm_run,
+ *  use swarm_init and swarm_run directly to avoid the setup.
+ *
+ *  Starting from the result of a close frame (time-lapse, z-stack)
+ *  instead of zero, a tolerance stops after a few laps.
+ *
+ */
+int swarm_until(double **thumbnails, int th_dim, int out_dim, int delta,
+                const int lap_nbr, int radius, int jorga, double tolerance,
+                int *laps, fftw_complex *out) {
+  return swarm_once(thumbnails, th_dim, out_dim, delta, lap_nbr, radius,
+                    jorga, tolerance, 0, laps, NULL, out);
+}
+
+/**
+ *  @brief Unite multiple small images in a big one, in a given time
+ *  @param[in] thumbnails All the thumbnails in one big matrix
+ *  @param[in] th_dim The dimension of each thumbnail
+ *  @param[in] out_dim The dimension of the final image
+ *  @param[in] delta The distance between two thumbnail centers
+ *  @param[in] lap_nbr The maximum number of laps
+ *  @param[in] radius The radius of the extracted circle
+ *  @param[in] jorga The dimension of thumbnails is (2*jorga+1)^2
+ *  @param[in] budget_ms The time the reconstruction must not exceed
+ *  @param[out] laps The number of whole laps done, or NULL
+ *  @param[out] leds The number of led updates done, or NULL
+ *  @param[in,out] out The retrieved image after the algorithm is done, \
+ *                     its content is used as the initial spectrum
+ *
+ *  @return 1 If memory allocation failed or incompatible parameters
+ *  @return 0 0therwise
+ *
+ *  The laps stop before the budget is exceeded, whatever the machine
+ *  and the sample, and out is the state after the last led update
+ *  (see swarm_run). The setup of the context is not in the budget.
+ *
+ */
+int swarm_within(double **thumbnails, int th_dim, int out_dim, int delta,
+                 const int lap_nbr, int radius, int jorga, double budget_ms,
+                 int *laps, int *leds, fftw_complex *out) {
+  return swarm_once(thumbnails, th_dim, out_dim, delta, lap_nbr, radius,
+                    jorga, 0, budget_ms, laps, leds, out);
+}
+
+/**
+ *  @brief Unite multiple small images in a big one
+ *  @param[in] thumbnails All the thumbnails in one big matrix
+ *  @param[in] th_dim The dimension of each thumbnail
+ *  @param[in] out_dim The dimension of the final image
+ *  @param[in] delta The distance between two thumbnail centers
+ *  @param[in] lap_nbr The number of lap done
+ *  @param[in] radius The radius of the extracted circle
+ *  @param[in] jorga The dimension of thumbnails is (2*jorga+1)^2
+ *  @param[in,out] out The retrieved image after the algorithm is done, \
+ *                     its content is used as the initial spectrum
+ *
+ *  @return 1 If memory allocation failed or incompatible parameters
+ *  @return 0 0therwise
+ *
+ *  Every lap is done, see swarm_until to stop on convergence.
+ *
+ */
+int swarm(double **thumbnails, int th_dim, int out_dim, int delta,
+          const int lap_nbr, int radius, int jorga, fftw_complex *out) {
+  return swarm_until(thumbnails, th_dim, out_dim, delta, lap_nbr, radius,
+                     jorga, 0, NULL, out);
+}
+
+/**
+ *  @brief Unite the thumbnails of several channels in one image each
+ *  @param[in,out] channels The thumbnails, geometry and spectrum of \
+ *                          each channel, see swarm_run for out
+ *  @param[in] nbr The number of channels
+ *  @param[in] out_dim The dimension of the final images
+ *  @param[in] lap_nbr The number of lap done
+ *  @param[in] jorga The dimension of thumbnails is (2*jorga+1)^2
+ *
+ *  @return 2 If a disk of a channel could not be copied (see update_led)
+ *  @return 1 If memory allocation failed or incompatible parameters
+ *  @return 0 Otherwise
+ *
+ *  The channels with the same th_dim share one pair of plans (see
+ *  swarm_share), and the channels are reconstructed at the same time,
+ *  one thread each, so that a few channels cost about the time of
+ *  one. Every channel gives the same image as swarm alone.
+ *
+ *  A channel whose disk could not be copied stops its laps there, with
+ *  channels[c].error set to 2, and the others go on: the error of the
+ *  first failed channel is returned.
+ *
+ *  Only the laps of swarm_run are done: the channels have no tiles,
+ *  checkpoint, snapshot, preview, feed, budget, tolerance, cancel or
+ *  progress, and every lap is done.
+ *
+ */
+int swarm_channels(struct swarm_channel *channels, int nbr, int out_dim,
+                   const int lap_nbr, int jorga) {
+  struct pool pool;
+  struct swarm_ctx *ctxs;
+  size_t size;
+  int ready = 0;
+  int error = 0;
+
+  if (nbr <= 0 || matrix_size(nbr, 1, sizeof(struct swarm_ctx), &size))
+    return 1;
+  for (int c = 0; c < nbr; c++)
+    channels[c].error = 0;
+  size = pool_round(size);
+  for (int c = 0; c < nbr; c++)
+    size += swarm_pool_size(channels[c].th_dim, out_dim, channels[c].radius);
+
+  if (pool_init(&pool, size))
+    return 1;
+  ctxs = (struct swarm_ctx*) pool_alloc(&pool, nbr*sizeof(struct swarm_ctx));
+  if (ctxs == NULL)
+    error = 1;
+
+  for (int c = 0; c < nbr && !error; c++) {
+    int model = 0;
+    while (channels[model].th_dim != channels[c].th_dim)
+      model++;
+    if (model == c)
+      error = swarm_init(&ctxs[c], &pool, channels[c].th_dim, out_dim,
+                         channels[c].delta, channels[c].radius, jorga);
+    else
+      error = swarm_share(&ctxs[c], &pool, &ctxs[model],
+                          channels[c].delta, channels[c].radius);
+    if (!error)
+      ready++;
+  }
+
+  if (!error) {
+    PROF_RESET();
+
+    #pragma omp parallel for if (nbr > 1) num_threads(nbr) schedule(static, 1)
+    for (int c = 0; c < nbr; c++) {
+      for (int lap = 0; lap < lap_nbr && !channels[c].error; lap++) {
+        TRACE_BEGIN("lap");
+        PROF_START(lap_start);
+        channels[c].error = swarm_lap(&ctxs[c], channels[c].thumbnails,
+                                      channels[c].out);
+        PROF_STOP(PROF_LAP, lap_start);
+        TRACE_END("lap");
+      }
+    }
+
+    PROF_REPORT();
+    for (int c = 0; c < nbr && !error; c++)
+      error = channels[c].error;
+  }
+
+  /* the contexts sharing plans go before their owner */
+  for (int c = ready-1; c >= 0; c--)
+    swarm_destroy(&ctxs[c]);
+  pool_destroy(&pool);
+  return error;
 }
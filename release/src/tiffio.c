@@ -8,6 +8,8 @@
  */
 
 #include "include/tiffio.h"
+#include "include/trace.h"
+#include "include/cpu.h"
 
 /**
  *  @brief Get the size of a tiff image
@@ -64,6 +66,23 @@ int tiff_maxnormalized(double max, double tosample) {
   return (int) tosample*255/max;
 }
 
+/**
+ *  @brief Sample a line of doubles into bytes
+ *  @param[in] min The minimum of the matrix
+ *  @param[in] max The maximum of the matrix
+ *  @param[in] line The values to sample
+ *  @param[out] data The samples, see \ref tiff_fullscale
+ *  @param[in] dimw The number of values
+ *
+ */
+CPU_DISPATCH
+void tiff_quantize(double min, double max, double *line,
+                   unsigned char *data, uint32 dimw) {
+  #pragma omp simd
+  for (uint32 i = 0; i < dimw; i++)
+    data[i] = tiff_fullscale(min, max, line[i]);
+}
+
 /**
  *  @brief Import an extern tiff file
  *  @param[in] name The path to the image to import
@@ -82,6 +101,7 @@ int tiff_tomatrix(const char *name, double *matrix, uint32 diml, uint32 dimw) {
   tdata_t buf;
   unsigned char *data;
 
+  TRACE_BEGIN("tiff_read");
   TIFF* tiff = TIFFOpen(name, "r");
   if (tiff) {
     buf = _TIFFmalloc(TIFFScanlineSize(tiff));
@@ -92,18 +112,21 @@ int tiff_tomatrix(const char *name, double *matrix, uint32 diml, uint32 dimw) {
         free(data);
         _TIFFfree(buf);
         TIFFClose(tiff);
+        TRACE_END("tiff_read");
         return 1;
       }
       memcpy(data, buf, dimw*sizeof(char));
-      for (int i=0; i < (int) dimw; i++)
-        matrix[row*dimw+i] = (double) data[i];
+      for (uint32 i=0; i < dimw; i++)
+        matrix[(size_t) row*dimw+i] = (double) data[i];
     }
 
     free(data);
     _TIFFfree(buf);
     TIFFClose(tiff);
+    TRACE_END("tiff_read");
     return 0;
   } else {
+    TRACE_END("tiff_read");
     return 1;
   }
 }
@@ -127,6 +150,7 @@ int tiff_frommatrix(const char *name, double *matrix,
   tdata_t buf;
   unsigned char *data;
 
+  TRACE_BEGIN("tiff_write");
   TIFF* tiff = TIFFOpen(name, "w");
   if (tiff) {
     buf = _TIFFmalloc(dimw*sizeof(char));
@@ -141,15 +165,14 @@ int tiff_frommatrix(const char *name, double *matrix,
     double min = matrix_min(diml, dimw, matrix);
 
     for (uint32 row=0; row < diml; row++) {
-      for (int i=0; i < (int) dimw; i++) {
-        data[i] = tiff_fullscale(min, max, matrix[row*dimw+i]);
-      }
+      tiff_quantize(min, max, matrix + (size_t) row*dimw, data, dimw);
       memcpy(buf, data, dimw*sizeof(char));
 
       if (TIFFWriteScanline(tiff, buf, row, 0) == -1) {
         free(data);
         _TIFFfree(buf);
         TIFFClose(tiff);
+        TRACE_END("tiff_write");
         return 1;
       }
     }
@@ -158,8 +181,68 @@ int tiff_frommatrix(const char *name, double *matrix,
     _TIFFfree(buf);
     TIFFClose(tiff);
 
+    TRACE_END("tiff_write");
     return 0;
   } else {
+    TRACE_END("tiff_write");
+    return 1;
+  }
+}
+
+/**
+ *  @brief Export an image given line by line into a tiff image
+ *  @param[in] name The path in which the image is saved
+ *  @param[in] diml The number of lines
+ *  @param[in] dimw The number of columns
+ *  @param[in] min The minimum of the image
+ *  @param[in] max The maximum of the image
+ *  @param[in] get_row The function filling line with the row-th line, \
+ *                     returning non-zero on error
+ *  @param[in] arg The first parameter of get_row
+ *  @param[in] line A buffer of dimw doubles
+ *  @return 1 If there is a writing error or get_row failed
+ *  @return 0 Otherwise
+ *
+ *  Same as \ref tiff_frommatrix for images too big to be in memory:
+ *  the minimum and maximum must be known beforehand.
+ *
+ */
+int tiff_fromrows(const char *name, uint32 diml, uint32 dimw,
+                  double min, double max,
+                  int (*get_row)(void *arg, uint32 row, double *line),
+                  void *arg, double *line) {
+  tdata_t buf;
+  unsigned char *data;
+  int error = 0;
+
+  TRACE_BEGIN("tiff_write");
+  TIFF* tiff = TIFFOpen(name, "w");
+  if (tiff) {
+    buf = _TIFFmalloc(dimw*sizeof(char));
+    data = (unsigned char *) buf;
+
+    TIFFSetField(tiff, TIFFTAG_IMAGELENGTH, diml);
+    TIFFSetField(tiff, TIFFTAG_IMAGEWIDTH, dimw);
+    TIFFSetField(tiff, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tiff, TIFFTAG_SAMPLESPERPIXEL, 1);
+
+    for (uint32 row=0; row < diml && !error; row++) {
+      if (get_row(arg, row, line)) {
+        error = 1;
+        break;
+      }
+      tiff_quantize(min, max, line, data, dimw);
+
+      if (TIFFWriteScanline(tiff, buf, row, 0) == -1)
+        error = 1;
+    }
+
+    _TIFFfree(buf);
+    TIFFClose(tiff);
+    TRACE_END("tiff_write");
+    return error;
+  } else {
+    TRACE_END("tiff_write");
     return 1;
   }
 }
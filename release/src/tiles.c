@@ -0,0 +1,893 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  This file implements a tiled spectrum, either stored in a file so
+ *  that the spectrum of a reconstruction does not have to fit in
+ *  memory, or sparse so that only the tiles under the disks of the
+ *  leds are allocated: a led only touches the few tiles under its disk.
+ *
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <limits.h>
+#include "include/tiles.h"
+#include "include/trace.h"
+
+/**
+ *  @brief Get the size of a tile in bytes
+ *
+ */
+static size_t tiles_tile_size(const struct tiles *tiles) {
+  return (size_t) tiles->side*tiles->side*sizeof(fftw_complex);
+}
+
+/**
+ *  @brief Write a tile entirely at its offset
+ *  @return 1 If a write failed
+ *  @return 0 Otherwise
+ *
+ */
+static int tiles_full_pwrite(int fd, const char *buf, size_t size,
+                             off_t offset) {
+  while (size > 0) {
+    ssize_t done = pwrite(fd, buf, size, offset);
+    if (done <= 0)
+      return 1;
+    buf += done;
+    size -= done;
+    offset += done;
+  }
+  return 0;
+}
+
+/**
+ *  @brief Read a tile entirely from its offset
+ *  @return 1 If a read failed or the file is too short
+ *  @return 0 Otherwise
+ *
+ */
+static int tiles_full_pread(int fd, char *buf, size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t done = pread(fd, buf, size, offset);
+    if (done <= 0)
+      return 1;
+    buf += done;
+    size -= done;
+    offset += done;
+  }
+  return 0;
+}
+
+/**
+ *  @brief Get the size of the pool needed by tiles_open
+ *  @param[in] dim The dimension of the spectrum
+ *  @param[in] side The side of a tile
+ *  @param[in] resident_max The number of tiles which can be in memory
+ *  @return size_t The number of bytes to take from a pool
+ *
+ */
+size_t tiles_pool_size(int dim, int side, int resident_max) {
+  size_t nbr = (dim + side - 1)/side;
+  return pool_round(nbr*nbr*sizeof(fftw_complex*)) +
+    pool_round((size_t) resident_max*side*side*sizeof(fftw_complex)) +
+    pool_round(resident_max*sizeof(int)) +
+    pool_round(resident_max*sizeof(uint64_t)) +
+    pool_round(resident_max*sizeof(char)) +
+    pool_round((size_t) side*dim*sizeof(fftw_complex));
+}
+
+/**
+ *  @brief Create a blank tiled spectrum backed by a file
+ *  @param[out] tiles The tiled spectrum
+ *  @param[in,out] pool The pool in which the buffers are taken \
+ *                      (see tiles_pool_size)
+ *  @param[in] name The path of the backing file, overwritten
+ *  @param[in] dim The dimension of the spectrum
+ *  @param[in] side The side of a tile, at least 2
+ *  @param[in] resident_max The number of tiles which can be in memory
+ *  @return 1 If the file could not be created or the pool is too small
+ *  @return 0 Otherwise
+ *
+ *  The file is created sparse: the blocks of tiles never written do
+ *  not use any disk space and read as zeros.
+ *
+ */
+int tiles_open(struct tiles *tiles, struct pool *pool, const char *name,
+               int dim, int side, int resident_max) {
+  size_t band_size;
+
+  tiles->fd = -1;
+  if (dim <= 0 || side < 2 || resident_max <= 0 ||
+      matrix_size(side, dim, sizeof(fftw_complex), &band_size))
+    return 1;
+
+  tiles->dim = dim;
+  tiles->side = side;
+  tiles->nbr = (dim + side - 1)/side;
+  tiles->resident_max = resident_max;
+  tiles->clock = 0;
+  tiles->loads = 0;
+  tiles->stores = 0;
+  tiles->resident = 0;
+  tiles->zero = NULL;
+
+  size_t count = (size_t) tiles->nbr*tiles->nbr;
+  tiles->data = (fftw_complex**) pool_alloc(pool,
+                                            count*sizeof(fftw_complex*));
+  tiles->cache = (fftw_complex*) pool_alloc(pool, resident_max*
+                                            tiles_tile_size(tiles));
+  tiles->owner = (int*) pool_alloc(pool, resident_max*sizeof(int));
+  tiles->last_use = (uint64_t*) pool_alloc(pool,
+                                           resident_max*sizeof(uint64_t));
+  tiles->dirty = (char*) pool_alloc(pool, resident_max*sizeof(char));
+  tiles->band = (fftw_complex*) pool_alloc(pool, band_size);
+  if (tiles->data == NULL || tiles->cache == NULL || tiles->owner == NULL ||
+      tiles->last_use == NULL || tiles->dirty == NULL || tiles->band == NULL)
+    return 1;
+
+  for (size_t i = 0; i < count; i++)
+    tiles->data[i] = NULL;
+  for (int i = 0; i < resident_max; i++) {
+    tiles->owner[i] = -1;
+    tiles->last_use[i] = 0;
+    tiles->dirty[i] = 0;
+  }
+
+  tiles->fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (tiles->fd < 0)
+    return 1;
+  if (ftruncate(tiles->fd, (off_t) (count*tiles_tile_size(tiles)))) {
+    close(tiles->fd);
+    tiles->fd = -1;
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ *  @brief Get the size of the pool needed by tiles_sparse
+ *  @param[in] dim The dimension of the spectrum
+ *  @param[in] side The side of a tile
+ *  @param[in] resident_max The number of tiles which can be allocated
+ *  @return size_t The number of bytes to take from a pool
+ *
+ */
+size_t tiles_sparse_pool_size(int dim, int side, int resident_max) {
+  size_t nbr = (dim + side - 1)/side;
+  return pool_round(nbr*nbr*sizeof(fftw_complex*)) +
+    pool_round((size_t) (resident_max+1)*side*side*sizeof(fftw_complex)) +
+    pool_round(resident_max*sizeof(int)) +
+    pool_round(resident_max*sizeof(uint64_t)) +
+    pool_round(resident_max*sizeof(char));
+}
+
+/**
+ *  @brief Create a blank sparse tiled spectrum
+ *  @param[out] tiles The tiled spectrum
+ *  @param[in,out] pool The pool in which the tiles are taken \
+ *                      (see tiles_sparse_pool_size)
+ *  @param[in] dim The dimension of the spectrum
+ *  @param[in] side The side of a tile
+ *  @param[in] resident_max The number of tiles which can be written, \
+ *                          see tiles_sparse_count
+ *  @return 1 If the pool is too small or incompatible parameters
+ *  @return 0 Otherwise
+ *
+ *  Writing more than resident_max different tiles fails. The tiles
+ *  never written are not allocated and read as zeros.
+ *  tiles_fft and tiles_tiff are not available, see tiles_densify.
+ *
+ */
+int tiles_sparse(struct tiles *tiles, struct pool *pool,
+                 int dim, int side, int resident_max) {
+  tiles->fd = -1;
+  if (dim <= 0 || side <= 0 || resident_max <= 0)
+    return 1;
+
+  tiles->dim = dim;
+  tiles->side = side;
+  tiles->nbr = (dim + side - 1)/side;
+  tiles->resident_max = resident_max;
+  tiles->clock = 0;
+  tiles->loads = 0;
+  tiles->stores = 0;
+  tiles->resident = 0;
+  tiles->band = NULL;
+
+  size_t count = (size_t) tiles->nbr*tiles->nbr;
+  tiles->data = (fftw_complex**) pool_alloc(pool,
+                                            count*sizeof(fftw_complex*));
+  tiles->zero = (fftw_complex*) pool_alloc(pool, (resident_max+1)*
+                                           tiles_tile_size(tiles));
+  tiles->owner = (int*) pool_alloc(pool, resident_max*sizeof(int));
+  tiles->last_use = (uint64_t*) pool_alloc(pool,
+                                           resident_max*sizeof(uint64_t));
+  tiles->dirty = (char*) pool_alloc(pool, resident_max*sizeof(char));
+  if (tiles->data == NULL || tiles->zero == NULL || tiles->owner == NULL ||
+      tiles->last_use == NULL || tiles->dirty == NULL)
+    return 1;
+
+  /* the zero tile is followed by the tiles to allocate */
+  tiles->cache = tiles->zero + (size_t) side*side;
+  memset(tiles->zero, 0, tiles_tile_size(tiles));
+
+  for (size_t i = 0; i < count; i++)
+    tiles->data[i] = NULL;
+  for (int i = 0; i < resident_max; i++) {
+    tiles->owner[i] = -1;
+    tiles->last_use[i] = 0;
+    tiles->dirty[i] = 0;
+  }
+
+  return 0;
+}
+
+/**
+ *  @brief Count the tiles touched by the disks of all the leds
+ *  @param[in] dim The dimension of the spectrum
+ *  @param[in] side The side of a tile
+ *  @param[in] delta The distance between two thumbnail centers
+ *  @param[in] radius The radius of the extracted circle
+ *  @param[in] jorga The dimension of thumbnails is (2*jorga+1)^2
+ *  @return int The number of tiles to give to tiles_sparse
+ *  @return -1 If memory allocation failed or incompatible parameters
+ *
+ *  The disks are the ones of update_led, centered on multiples of delta.
+ *
+ */
+int tiles_sparse_count(int dim, int side, int delta, int radius, int jorga) {
+  if (dim <= 0 || side <= 0 || radius <= 0 || radius > (dim-1)/2)
+    return -1;
+
+  int nbr = (dim + side - 1)/side;
+  char *touched = (char*) calloc((size_t) nbr*nbr, sizeof(char));
+  if (touched == NULL)
+    return -1;
+
+  int count = 0;
+  for (int i = -jorga; i <= jorga; i++) {
+    for (int j = -jorga; j <= jorga; j++) {
+      for (int dx = -(radius-1); dx <= radius-1; dx++) {
+        int width = radius-1 - abs(dx);
+        int x = matrix_cyclic(i*delta + dx, dim);
+        int y = matrix_cyclic(j*delta - width, dim);
+
+        /* the line of the disk, folded at most once */
+        for (int len = 2*width+1; len > 0; ) {
+          int end = (y + len < dim) ? y + len : dim;
+          for (int tile_y = y/side; tile_y <= (end-1)/side; tile_y++) {
+            char *mark = touched + (size_t) (x/side)*nbr + tile_y;
+            if (!*mark) {
+              *mark = 1;
+              count++;
+            }
+          }
+          len -= end - y;
+          y = 0;
+        }
+      }
+    }
+  }
+
+  free(touched);
+  return count;
+}
+
+/**
+ *  @brief Get the size of the pool needed by tiles_blocked
+ *  @param[in] dim The dimension of the spectrum
+ *  @param[in] side The side of a tile
+ *  @return size_t The number of bytes to take from a pool
+ *
+ */
+size_t tiles_blocked_pool_size(int dim, int side) {
+  size_t nbr = (dim + side - 1)/side;
+  return pool_round(nbr*nbr*sizeof(fftw_complex*)) +
+    pool_round(nbr*nbr*side*side*sizeof(fftw_complex)) +
+    pool_round(nbr*nbr*sizeof(int)) +
+    pool_round(nbr*nbr*sizeof(uint64_t)) +
+    pool_round(nbr*nbr*sizeof(char));
+}
+
+/**
+ *  @brief Create a blank blocked spectrum in memory
+ *  @param[out] tiles The tiled spectrum
+ *  @param[in,out] pool The pool in which the tiles are taken \
+ *                      (see tiles_blocked_pool_size)
+ *  @param[in] dim The dimension of the spectrum
+ *  @param[in] side The side of a tile
+ *  @return 1 If the pool is too small or incompatible parameters
+ *  @return 0 Otherwise
+ *
+ *  Unlike a row-major matrix, where the lines of a disk are dim elements
+ *  apart, a disk only spans a few side*side tiles.
+ *  tiles_fft and tiles_tiff are not available, see tiles_densify and
+ *  tiles_from_matrix.
+ *
+ */
+int tiles_blocked(struct tiles *tiles, struct pool *pool, int dim, int side) {
+  tiles->fd = -1;
+  if (dim <= 0 || side <= 0)
+    return 1;
+
+  tiles->dim = dim;
+  tiles->side = side;
+  tiles->nbr = (dim + side - 1)/side;
+  tiles->clock = 0;
+  tiles->loads = 0;
+  tiles->stores = 0;
+  tiles->zero = NULL;
+  tiles->band = NULL;
+
+  size_t count = (size_t) tiles->nbr*tiles->nbr;
+  if (count > INT_MAX)
+    return 1;
+  tiles->resident_max = tiles->resident = (int) count;
+  tiles->data = (fftw_complex**) pool_alloc(pool,
+                                            count*sizeof(fftw_complex*));
+  tiles->cache = (fftw_complex*) pool_alloc(pool, count*
+                                            tiles_tile_size(tiles));
+  tiles->owner = (int*) pool_alloc(pool, count*sizeof(int));
+  tiles->last_use = (uint64_t*) pool_alloc(pool, count*sizeof(uint64_t));
+  tiles->dirty = (char*) pool_alloc(pool, count*sizeof(char));
+  if (tiles->data == NULL || tiles->cache == NULL || tiles->owner == NULL ||
+      tiles->last_use == NULL || tiles->dirty == NULL)
+    return 1;
+
+  memset(tiles->cache, 0, count*tiles_tile_size(tiles));
+  for (size_t i = 0; i < count; i++) {
+    tiles->data[i] = tiles->cache + i*side*side;
+    tiles->owner[i] = i;
+    tiles->last_use[i] = 0;
+    tiles->dirty[i] = 0;
+  }
+
+  return 0;
+}
+
+/**
+ *  @brief Free a slot of the cache, writing its tile back if modified
+ *  @return 1 If the tile could not be written
+ *  @return 0 Otherwise
+ *
+ */
+static int tiles_evict(struct tiles *tiles, int slot) {
+  int tile = tiles->owner[slot];
+  if (tile < 0)
+    return 0;
+
+  if (tiles->dirty[slot]) {
+    if (tiles_full_pwrite(tiles->fd, (const char*) tiles->data[tile],
+                          tiles_tile_size(tiles),
+                          (off_t) tile*tiles_tile_size(tiles)))
+      return 1;
+    tiles->stores++;
+    tiles->dirty[slot] = 0;
+  }
+
+  tiles->data[tile] = NULL;
+  tiles->owner[slot] = -1;
+  return 0;
+}
+
+/**
+ *  @brief Get the memory of a tile, reading it if needed
+ *  @param[in,out] tiles The tiled spectrum
+ *  @param[in] tile The index of the tile (row-major)
+ *  @param[in] write Non-zero if the tile is going to be modified
+ *  @return fftw_complex* The side*side row-major tile, valid until \
+ *                        the next call
+ *  @return NULL If a tile could not be read or written back, or too \
+ *               many sparse tiles are written
+ *
+ *  The least recently used tile is evicted when the cache is full.
+ *  A sparse tile never written is a tile of zeros which must not be
+ *  modified.
+ *
+ */
+fftw_complex *tiles_get(struct tiles *tiles, int tile, int write) {
+  size_t tile_len = (size_t) tiles->side*tiles->side;
+  int slot;
+
+  if (tiles->data[tile]) {
+    slot = (tiles->data[tile] - tiles->cache)/tile_len;
+  } else if (tiles->fd < 0) {
+    /* sparse: allocated when first written */
+    if (!write)
+      return tiles->zero;
+    if (tiles->resident == tiles->resident_max)
+      return NULL;
+
+    slot = tiles->resident++;
+    tiles->owner[slot] = tile;
+    tiles->data[tile] = tiles->cache + slot*tile_len;
+    memset(tiles->data[tile], 0, tiles_tile_size(tiles));
+  } else {
+    slot = 0;
+    for (int i = 0; i < tiles->resident_max; i++) {
+      if (tiles->owner[i] < 0) {
+        slot = i;
+        break;
+      }
+      if (tiles->last_use[i] < tiles->last_use[slot])
+        slot = i;
+    }
+
+    if (tiles_evict(tiles, slot))
+      return NULL;
+
+    fftw_complex *data = tiles->cache + slot*tile_len;
+    if (tiles_full_pread(tiles->fd, (char*) data, tiles_tile_size(tiles),
+                         (off_t) tile*tiles_tile_size(tiles)))
+      return NULL;
+    tiles->loads++;
+
+    tiles->owner[slot] = tile;
+    tiles->data[tile] = data;
+  }
+
+  tiles->last_use[slot] = ++tiles->clock;
+  if (write)
+    tiles->dirty[slot] = 1;
+  return tiles->data[tile];
+}
+
+/**
+ *  @brief Copy a contiguous part of a line between the tiles and a buffer
+ *  @param[in,out] tiles The tiled spectrum
+ *  @param[in] x The line in the spectrum
+ *  @param[in] y The first column in the spectrum
+ *  @param[in] len The number of elements, y+len <= dim
+ *  @param[in,out] buf The buffer
+ *  @param[in] to_tiles Non-zero to copy from buf into the tiles
+ *  @return 1 If a tile could not be read or written back
+ *  @return 0 Otherwise
+ *
+ */
+static int tiles_copy_span(struct tiles *tiles, int x, int y, int len,
+                           fftw_complex *buf, int to_tiles) {
+  int side = tiles->side;
+  while (len > 0) {
+    int tile_y = y/side;
+    int in_y = y - tile_y*side;
+    int chunk = (len < side - in_y) ? len : side - in_y;
+
+    fftw_complex *data = tiles_get(tiles, (x/side)*tiles->nbr + tile_y,
+                                   to_tiles);
+    if (data == NULL)
+      return 1;
+    data += (x % side)*side + in_y;
+
+    if (to_tiles)
+      memcpy(data, buf, chunk*sizeof(fftw_complex));
+    else
+      memcpy(buf, data, chunk*sizeof(fftw_complex));
+
+    buf += chunk;
+    y += chunk;
+    len -= chunk;
+  }
+  return 0;
+}
+
+/**
+ *  @brief Copy a disk between the tiles and a small matrix
+ *  @param[in,out] tiles The tiled spectrum
+ *  @param[in,out] small The th_dim*th_dim matrix
+ *  @param[in] th_dim The dimension of small
+ *  @param[in] centerX The x coordinate of the disk center in the spectrum
+ *  @param[in] centerY The y coordinate of the disk center in the spectrum
+ *  @param[in] radius The radius of the disk
+ *  @param[in] to_tiles Non-zero to copy from small into the tiles
+ *  @return 1 If the radius is not adapted or a tile could not be read \
+ *            or written back
+ *  @return 0 Otherwise
+ *
+ *  Same disk as copy_disk_ultimate, centered on [0;0] in small:
+ *  both matrices are folded.
+ *
+ */
+int tiles_copy_disk(struct tiles *tiles, fftw_complex *small, int th_dim,
+                    int centerX, int centerY, int radius, int to_tiles) {
+  int minDim = (th_dim <= tiles->dim) ? th_dim : tiles->dim;
+  if (minDim <= 0 || radius <= 0 || radius > (minDim-1)/2)
+    return 1;
+
+  for (int dx = -(radius-1); dx <= radius-1; dx++) {
+    int width = radius-1 - abs(dx);
+    int x = matrix_cyclic(centerX + dx, tiles->dim);
+    fftw_complex *line = small + matrix_cyclic(dx, th_dim)*th_dim;
+
+    /* columns -width..-1 are at the end of the line of small */
+    int dy = -width;
+    while (dy <= width) {
+      int y = matrix_cyclic(centerY + dy, tiles->dim);
+      int small_y = matrix_cyclic(dy, th_dim);
+      int len = width - dy + 1;
+      if (len > tiles->dim - y)
+        len = tiles->dim - y;
+      if (len > th_dim - small_y)
+        len = th_dim - small_y;
+
+      if (tiles_copy_span(tiles, x, y, len, line + small_y, to_tiles))
+        return 1;
+      dy += len;
+    }
+  }
+  return 0;
+}
+
+/**
+ *  @brief Copy whole lines between the tiles and a row-major buffer
+ *  @return 1 If a tile could not be read or written back
+ *  @return 0 Otherwise
+ *
+ *  The lines are copied tile by tile, so that each tile is got once
+ *  even when a row of tiles does not fit in the cache.
+ *
+ */
+static int tiles_copy_rows(struct tiles *tiles, int row, int nrows,
+                           fftw_complex *rows, int to_tiles) {
+  int side = tiles->side;
+  int dim = tiles->dim;
+
+  while (nrows > 0) {
+    int tile_x = row/side;
+    int in_x = row - tile_x*side;
+    int chunk = (nrows < side - in_x) ? nrows : side - in_x;
+
+    for (int tile_y = 0; tile_y < tiles->nbr; tile_y++) {
+      fftw_complex *data = tiles_get(tiles, tile_x*tiles->nbr + tile_y,
+                                     to_tiles);
+      if (data == NULL)
+        return 1;
+
+      int ncols = (dim - tile_y*side < side) ? dim - tile_y*side : side;
+      for (int i = 0; i < chunk; i++) {
+        fftw_complex *line = rows + (size_t) i*dim + tile_y*side;
+        fftw_complex *tile_line = data + (in_x + i)*side;
+        if (to_tiles)
+          memcpy(tile_line, line, ncols*sizeof(fftw_complex));
+        else
+          memcpy(line, tile_line, ncols*sizeof(fftw_complex));
+      }
+    }
+
+    rows += (size_t) chunk*dim;
+    row += chunk;
+    nrows -= chunk;
+  }
+  return 0;
+}
+
+/**
+ *  @brief Copy whole lines of the spectrum into a row-major buffer
+ *  @param[in,out] tiles The tiled spectrum
+ *  @param[in] row The first line
+ *  @param[in] nrows The number of lines
+ *  @param[out] rows The nrows*dim buffer
+ *  @return 1 If a tile could not be read or written back
+ *  @return 0 Otherwise
+ *
+ */
+int tiles_read_rows(struct tiles *tiles, int row, int nrows,
+                    fftw_complex *rows) {
+  return tiles_copy_rows(tiles, row, nrows, rows, 0);
+}
+
+/**
+ *  @brief Copy a row-major buffer into whole lines of the spectrum
+ *  @param[in,out] tiles The tiled spectrum
+ *  @param[in] row The first line
+ *  @param[in] nrows The number of lines
+ *  @param[in] rows The nrows*dim buffer
+ *  @return 1 If a tile could not be read or written back
+ *  @return 0 Otherwise
+ *
+ */
+int tiles_write_rows(struct tiles *tiles, int row, int nrows,
+                     fftw_complex *rows) {
+  return tiles_copy_rows(tiles, row, nrows, rows, 1);
+}
+
+/**
+ *  @brief Copy the whole tiled spectrum into a matrix
+ *  @param[in,out] tiles The tiled spectrum
+ *  @param[out] out The dim*dim matrix
+ *  @return 1 If a tile could not be read or written back
+ *  @return 0 Otherwise
+ *
+ *  Used before a transform of the whole spectrum in memory.
+ *
+ */
+int tiles_densify(struct tiles *tiles, fftw_complex *out) {
+  int side = tiles->side;
+  int dim = tiles->dim;
+
+  for (int tile_x = 0; tile_x < tiles->nbr; tile_x++) {
+    for (int tile_y = 0; tile_y < tiles->nbr; tile_y++) {
+      fftw_complex *data = tiles_get(tiles, tile_x*tiles->nbr + tile_y, 0);
+      if (data == NULL)
+        return 1;
+
+      int nrows = (dim - tile_x*side < side) ? dim - tile_x*side : side;
+      int ncols = (dim - tile_y*side < side) ? dim - tile_y*side : side;
+      for (int i = 0; i < nrows; i++)
+        memcpy(out + (size_t) (tile_x*side + i)*dim + tile_y*side,
+               data + i*side, ncols*sizeof(fftw_complex));
+    }
+  }
+  return 0;
+}
+
+/**
+ *  @brief Copy a matrix into the whole tiled spectrum
+ *  @param[in,out] tiles The tiled spectrum
+ *  @param[in] in The dim*dim matrix
+ *  @return 1 If a tile could not be read or written back, or too \
+ *            many sparse tiles are written
+ *  @return 0 Otherwise
+ *
+ *  The reverse of tiles_densify.
+ *
+ */
+int tiles_from_matrix(struct tiles *tiles, fftw_complex *in) {
+  int side = tiles->side;
+  int dim = tiles->dim;
+
+  for (int tile_x = 0; tile_x < tiles->nbr; tile_x++) {
+    for (int tile_y = 0; tile_y < tiles->nbr; tile_y++) {
+      fftw_complex *data = tiles_get(tiles, tile_x*tiles->nbr + tile_y, 1);
+      if (data == NULL)
+        return 1;
+
+      int nrows = (dim - tile_x*side < side) ? dim - tile_x*side : side;
+      int ncols = (dim - tile_y*side < side) ? dim - tile_y*side : side;
+      for (int i = 0; i < nrows; i++)
+        memcpy(data + i*side,
+               in + (size_t) (tile_x*side + i)*dim + tile_y*side,
+               ncols*sizeof(fftw_complex));
+    }
+  }
+  return 0;
+}
+
+/**
+ *  @brief Copy whole columns of the spectrum between the tiles and band
+ *  @return 1 If a tile could not be read or written back
+ *  @return 0 Otherwise
+ *
+ *  The column col+j is contiguous in band, at j*dim.
+ *
+ */
+static int tiles_copy_columns(struct tiles *tiles, int col, int ncols,
+                              int to_tiles) {
+  int side = tiles->side;
+  int dim = tiles->dim;
+  int tile_y = col/side;
+
+  for (int tile_x = 0; tile_x < tiles->nbr; tile_x++) {
+    fftw_complex *data = tiles_get(tiles, tile_x*tiles->nbr + tile_y,
+                                   to_tiles);
+    if (data == NULL)
+      return 1;
+
+    int nrows = dim - tile_x*side;
+    if (nrows > side)
+      nrows = side;
+
+    for (int i = 0; i < nrows; i++) {
+      for (int j = 0; j < ncols; j++) {
+        fftw_complex *cell = tiles->band + (size_t) j*dim + tile_x*side + i;
+        fftw_complex *elem = data + i*side + j;
+        if (to_tiles) {
+          (*elem)[0] = (*cell)[0];
+          (*elem)[1] = (*cell)[1];
+        } else {
+          (*cell)[0] = (*elem)[0];
+          (*cell)[1] = (*elem)[1];
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ *  @brief Fourier transform of the whole tiled spectrum
+ *  @param[in,out] tiles The tiled spectrum
+ *  @param[in] sign FFTW_FORWARD or FFTW_BACKWARD
+ *  @return 1 If a tile could not be read or written back
+ *  @return 0 Otherwise
+ *
+ *  The 2D transform is done as 1D transforms of bands of side lines,
+ *  then of bands of side columns, so that only side*dim elements
+ *  are in memory besides the cache.
+ *  The result is divided by dim like div_dim does.
+ *  Not available for sparse tiles.
+ *
+ */
+int tiles_fft(struct tiles *tiles, int sign) {
+  int side = tiles->side;
+  int dim = tiles->dim;
+  int error = 0;
+
+  if (tiles->band == NULL)
+    return 1;
+
+  TRACE_BEGIN("tiles_fft");
+  fftw_plan plan = fftw_plan_many_dft(1, &dim, side,
+                                      tiles->band, NULL, 1, dim,
+                                      tiles->band, NULL, 1, dim,
+                                      sign, FFTW_ESTIMATE);
+
+  /* the unused lines of the last band are transformed for nothing */
+  for (int row = 0; row < dim && !error; row += side) {
+    int nrows = (dim - row < side) ? dim - row : side;
+    if (tiles_read_rows(tiles, row, nrows, tiles->band)) {
+      error = 1;
+      break;
+    }
+    fftw_execute(plan);
+    error = tiles_write_rows(tiles, row, nrows, tiles->band);
+  }
+
+  for (int col = 0; col < dim && !error; col += side) {
+    int ncols = (dim - col < side) ? dim - col : side;
+    if (tiles_copy_columns(tiles, col, ncols, 0)) {
+      error = 1;
+      break;
+    }
+    fftw_execute(plan);
+    for (size_t i = 0; i < (size_t) ncols*dim; i++) {
+      tiles->band[i][0] /= dim;
+      tiles->band[i][1] /= dim;
+    }
+    error = tiles_copy_columns(tiles, col, ncols, 1);
+  }
+
+  fftw_destroy_plan(plan);
+  TRACE_END("tiles_fft");
+  return error;
+}
+
+/**
+ *  @brief The band of lines read by tiles_tiff
+ *
+ */
+struct tiles_modulus {
+  struct tiles *tiles; /**< The tiled spectrum */
+  int first; /**< The first line of the band, -1 if none */
+  int nrows; /**< The number of lines of the band */
+};
+
+/**
+ *  @brief Read the band of side lines holding a line, as its modulus
+ *  @return 1 If a tile could not be read
+ *  @return 0 Otherwise
+ *
+ *  The modulus of the element k of the band is put in place, at the
+ *  double k of the band, so that the band holds nrows*dim doubles
+ *  followed by room for as many.
+ *
+ */
+static int tiles_modulus_band(struct tiles_modulus *band, int row) {
+  struct tiles *tiles = band->tiles;
+  int side = tiles->side;
+  int dim = tiles->dim;
+  int first = row - row % side;
+
+  if (band->first == first)
+    return 0;
+  band->first = -1;
+  band->nrows = (dim - first < side) ? dim - first : side;
+  if (tiles_read_rows(tiles, first, band->nrows, tiles->band))
+    return 1;
+
+  /* the double k is written after the element k, at doubles 2k and
+   * 2k+1, was read */
+  double *modulus = (double*) tiles->band;
+  for (size_t k = 0; k < (size_t) band->nrows*dim; k++)
+    modulus[k] = sqrt(tiles->band[k][0]*tiles->band[k][0] +
+                      tiles->band[k][1]*tiles->band[k][1]);
+  band->first = first;
+  return 0;
+}
+
+/**
+ *  @brief Give the modulus of a line of the spectrum to tiff_fromrows
+ *
+ */
+static int tiles_modulus_row(void *arg, uint32 row, double *line) {
+  struct tiles_modulus *band = (struct tiles_modulus*) arg;
+  int dim = band->tiles->dim;
+  if (tiles_modulus_band(band, row))
+    return 1;
+  memcpy(line, (double*) band->tiles->band + (size_t) (row - band->first)*dim,
+         dim*sizeof(double));
+  return 0;
+}
+
+/**
+ *  @brief Export the modulus of the spectrum into a tiff image
+ *  @param[in,out] tiles The tiled spectrum
+ *  @param[in] name The path in which the image is saved
+ *  @return 1 If a tile could not be read or the image written
+ *  @return 0 Otherwise
+ *
+ *  The spectrum is read twice, a band of side lines at a time: once
+ *  for the minimum and maximum, once to write the image line by line.
+ *  Not available for sparse tiles.
+ *
+ */
+int tiles_tiff(struct tiles *tiles, const char *name) {
+  if (tiles->band == NULL)
+    return 1;
+
+  int dim = tiles->dim;
+  struct tiles_modulus band = {tiles, -1, 0};
+  /* the second half of band holds a line for tiff_fromrows */
+  double *line = (double*) tiles->band + (size_t) tiles->side*dim;
+  double *modulus = (double*) tiles->band;
+  double min = 0;
+  double max = 0;
+
+  for (int row = 0; row < dim; row += tiles->side) {
+    if (tiles_modulus_band(&band, row))
+      return 1;
+    for (size_t k = 0; k < (size_t) band.nrows*dim; k++) {
+      if ((row == 0 && k == 0) || modulus[k] < min)
+        min = modulus[k];
+      if ((row == 0 && k == 0) || modulus[k] > max)
+        max = modulus[k];
+    }
+  }
+
+  return tiff_fromrows(name, dim, dim, min, max, tiles_modulus_row,
+                       &band, line);
+}
+
+/**
+ *  @brief Write back every modified tile
+ *  @param[in,out] tiles The tiled spectrum
+ *  @return 1 If a tile could not be written
+ *  @return 0 Otherwise
+ *
+ *  The tiles stay in memory.
+ *
+ */
+int tiles_flush(struct tiles *tiles) {
+  if (tiles->fd < 0)
+    return 0;
+
+  for (int slot = 0; slot < tiles->resident_max; slot++) {
+    int tile = tiles->owner[slot];
+    if (tile < 0 || !tiles->dirty[slot])
+      continue;
+    if (tiles_full_pwrite(tiles->fd, (const char*) tiles->data[tile],
+                          tiles_tile_size(tiles),
+                          (off_t) tile*tiles_tile_size(tiles)))
+      return 1;
+    tiles->stores++;
+    tiles->dirty[slot] = 0;
+  }
+  return 0;
+}
+
+/**
+ *  @brief Close the backing file of a tiled spectrum
+ *  @param[in,out] tiles The tiled spectrum
+ *
+ *  Modified tiles are not written back, see tiles_flush.
+ *  The memory belongs to the pool given to tiles_open or tiles_sparse.
+ *
+ */
+void tiles_close(struct tiles *tiles) {
+  if (tiles->fd >= 0)
+    close(tiles->fd);
+  tiles->fd = -1;
+}
@@ -0,0 +1,206 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  This file implements a recorder of begin/end events which
+ *  can be exported in the Chrome trace-event format and opened
+ *  in a trace viewer (chrome://tracing, Perfetto...).
+ *
+ *  Each thread records in its own ring buffer, without any lock nor
+ *  allocation: the rings are allocated by trace_start, a thread claims
+ *  one on its first event with an atomic increment, then only this
+ *  thread writes in it.
+ *
+ */
+
+#include <unistd.h>
+#include "include/trace.h"
+#include "include/profile.h"
+
+/** @cond DEV */
+struct trace_record {
+  const char *name;
+  uint64_t ts;
+  char phase;
+};
+
+struct trace_ring {
+  int tid;
+  uint64_t head;
+  struct trace_record *records;
+};
+
+int trace_enabled = 0;
+
+static struct trace_ring *trace_rings = NULL;
+static struct trace_record *trace_records = NULL;
+static int trace_ring_nbr = 0;
+static size_t trace_capacity = 0;
+static int trace_generation = 0;
+static int trace_claimed = 0;
+
+static __thread struct trace_ring *trace_local = NULL;
+static __thread int trace_local_generation = -1;
+/** @endcond */
+
+/**
+ *  @brief Start recording events
+ *  @param[in] capacity The number of events kept per thread
+ *  @param[in] ring_nbr The number of threads which can record events
+ *  @return 1 If capacity or ring_nbr is zero, or memory allocation failed
+ *  @return 0 Otherwise
+ *
+ *  The events previously recorded are dropped.
+ *  When a ring is full, the oldest events are overwritten. The events
+ *  of the threads coming after the first ring_nbr ones are dropped.
+ *
+ */
+int trace_start(size_t capacity, int ring_nbr) {
+  trace_free();
+  if (capacity == 0 || ring_nbr <= 0 ||
+      capacity > SIZE_MAX/sizeof(struct trace_record)/ring_nbr)
+    return 1;
+
+  /* the pages are only touched by the threads which record */
+  trace_rings = (struct trace_ring*) malloc(ring_nbr*
+                                            sizeof(struct trace_ring));
+  trace_records = (struct trace_record*) malloc(ring_nbr*capacity*
+                                                sizeof(struct trace_record));
+  if (trace_rings == NULL || trace_records == NULL) {
+    trace_free();
+    return 1;
+  }
+  for (int r = 0; r < ring_nbr; r++) {
+    trace_rings[r].tid = r+1;
+    trace_rings[r].head = 0;
+    trace_rings[r].records = trace_records + r*capacity;
+  }
+  trace_ring_nbr = ring_nbr;
+  trace_capacity = capacity;
+  __atomic_store_n(&trace_enabled, 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/**
+ *  @brief Stop recording events, the recorded ones are kept
+ *
+ */
+void trace_stop(void) {
+  __atomic_store_n(&trace_enabled, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ *  @brief Stop recording and free all the rings
+ *
+ *  No thread may be recording an event while this is called.
+ *
+ */
+void trace_free(void) {
+  trace_stop();
+  free(trace_records);
+  free(trace_rings);
+  trace_records = NULL;
+  trace_rings = NULL;
+  trace_ring_nbr = 0;
+  /* the threads will claim new rings on their next event */
+  __atomic_fetch_add(&trace_generation, 1, __ATOMIC_ACQ_REL);
+  __atomic_store_n(&trace_claimed, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ *  @brief Get the number of rings claimed by the threads
+ *
+ */
+static int trace_ring_used(void) {
+  int claimed = __atomic_load_n(&trace_claimed, __ATOMIC_ACQUIRE);
+  return claimed < trace_ring_nbr ? claimed : trace_ring_nbr;
+}
+
+/**
+ *  @brief Get the ring of the calling thread, claiming one if needed
+ *  @return NULL If every ring is already claimed
+ *
+ */
+static struct trace_ring *trace_ring_local(void) {
+  int generation = __atomic_load_n(&trace_generation, __ATOMIC_ACQUIRE);
+  if (trace_local_generation == generation)
+    return trace_local;
+
+  int r = __atomic_fetch_add(&trace_claimed, 1, __ATOMIC_ACQ_REL);
+  trace_local = r < trace_ring_nbr ? &trace_rings[r] : NULL;
+  trace_local_generation = generation;
+  return trace_local;
+}
+
+/**
+ *  @brief Record an event in the ring of the calling thread
+ *  @param[in] name The name of the event, must outlive the recorder
+ *  @param[in] phase 'B' for a beginning, 'E' for an end
+ *
+ *  Use the TRACE_BEGIN and TRACE_END macros rather than this function.
+ *
+ */
+void trace_event(const char *name, char phase) {
+  struct trace_ring *ring = trace_ring_local();
+  if (ring == NULL)
+    return;
+
+  uint64_t head = ring->head;
+  struct trace_record *record = &ring->records[head % trace_capacity];
+  record->name = name;
+  record->phase = phase;
+  record->ts = prof_now();
+  __atomic_store_n(&ring->head, head+1, __ATOMIC_RELEASE);
+}
+
+/**
+ *  @brief Get the number of events kept in all the rings
+ *
+ */
+size_t trace_count(void) {
+  size_t count = 0;
+  int used = trace_ring_used();
+  for (int r = 0; r < used; r++) {
+    struct trace_ring *ring = &trace_rings[r];
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    count += head < trace_capacity ? head : trace_capacity;
+  }
+  return count;
+}
+
+/**
+ *  @brief Export the recorded events in Chrome trace-event JSON
+ *  @param[in] name The path of the JSON file
+ *  @return 1 If the file could not be written
+ *  @return 0 Otherwise
+ *
+ *  It should be called once the recorder is stopped, otherwise the
+ *  oldest events of a ring may be overwritten while being exported.
+ *
+ */
+int trace_dump(const char *name) {
+  FILE *file = fopen(name, "w");
+  if (file == NULL)
+    return 1;
+
+  int pid = (int) getpid();
+  int first = 1;
+  fprintf(file, "{\"traceEvents\":[\n");
+
+  int used = trace_ring_used();
+  for (int r = 0; r < used; r++) {
+    struct trace_ring *ring = &trace_rings[r];
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t start = head > trace_capacity ? head - trace_capacity : 0;
+    for (uint64_t i = start; i < head; i++) {
+      struct trace_record *record = &ring->records[i % trace_capacity];
+      fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+              "\"pid\":%d,\"tid\":%d}", first ? "" : ",\n", record->name,
+              record->phase, record->ts/1e3, pid, ring->tid);
+      first = 0;
+    }
+  }
+
+  fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  return fclose(file) ? 1 : 0;
+}
@@ -0,0 +1,212 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  This file measures the fastest settings of the fftw plans for each
+ *  dimension of FFT, and keeps them in a profile next to the fftw
+ *  wisdom so that the next runs use them without measuring again.
+ *
+ */
+
+#include <limits.h>
+#include <omp.h>
+#include "include/tune.h"
+#include "include/matrix.h"
+#include "include/profile.h"
+
+/** @brief The first line of a profile, with its version */
+#define TUNE_HEADER "fourierscope-tune 1"
+
+/**
+ *  @brief Empty a profile
+ *
+ */
+void tune_init(struct tune *tune) {
+  tune->nbr = 0;
+}
+
+/**
+ *  @brief Get the settings of a dimension
+ *  @param[in] tune The profile
+ *  @param[in] dim The dimension of the FFT
+ *  @return struct tune_entry* The settings, or NULL if not measured
+ *
+ */
+struct tune_entry *tune_find(struct tune *tune, int dim) {
+  for (int i = 0; i < tune->nbr; i++)
+    if (tune->entries[i].dim == dim)
+      return &tune->entries[i];
+  return NULL;
+}
+
+/**
+ *  @brief Measure the fastest settings for a dimension
+ *  @param[in,out] tune The profile in which the settings are kept
+ *  @param[in] dim The dimension of the FFT
+ *  @param[in] max_threads The maximal number of threads to try
+ *  @return 1 If the profile is full or memory allocation failed
+ *  @return 0 Otherwise
+ *
+ *  Every power of two of threads up to max_threads (and max_threads)
+ *  is tried with FFTW_ESTIMATE and FFTW_MEASURE, each for at least
+ *  TUNE_MIN_NS. The plans made with FFTW_MEASURE go in the wisdom.
+ *  Small dimensions are usually faster on one thread.
+ *
+ */
+int tune_measure(struct tune *tune, int dim, int max_threads) {
+  unsigned flags[2] = {FFTW_ESTIMATE, FFTW_MEASURE};
+  struct tune_entry best;
+  struct tune_entry *entry = tune_find(tune, dim);
+  fftw_complex *mat;
+  size_t size;
+
+  if (dim <= 0 || max_threads <= 0 ||
+      (entry == NULL && tune->nbr == TUNE_DIMS) ||
+      matrix_size(dim, dim, sizeof(fftw_complex), &size))
+    return 1;
+  mat = (fftw_complex*) fftw_malloc(size);
+  if (mat == NULL)
+    return 1;
+
+  best.ns = -1;
+  int threads = 1;
+  while (1) {
+    for (int f = 0; f < 2; f++) {
+      fftw_plan_with_nthreads(threads);
+      fftw_plan plan = fftw_plan_dft_2d(dim, dim, mat, mat, FFTW_FORWARD,
+                                        flags[f]);
+      if (plan == NULL)
+        continue;
+      /* the planner may have written in mat */
+      matrix_init(dim, mat, 0);
+
+      uint64_t nbr = 0;
+      uint64_t elapsed;
+      uint64_t start = prof_now();
+      do {
+        fftw_execute(plan);
+        nbr++;
+        elapsed = prof_now() - start;
+      } while (elapsed < TUNE_MIN_NS);
+      fftw_destroy_plan(plan);
+
+      double ns = (double) elapsed/nbr;
+      if (best.ns < 0 || ns < best.ns) {
+        best.dim = dim;
+        best.threads = threads;
+        best.flags = flags[f];
+        best.ns = ns;
+      }
+    }
+    if (threads == max_threads)
+      break;
+    threads = (2*threads < max_threads) ? 2*threads : max_threads;
+  }
+
+  fftw_free(mat);
+  fftw_plan_with_nthreads(omp_get_max_threads());
+  if (best.ns < 0)
+    return 1;
+  if (entry == NULL)
+    entry = &tune->entries[tune->nbr++];
+  *entry = best;
+  return 0;
+}
+
+/**
+ *  @brief Prepare fftw for the plans of a dimension
+ *  @param[in] tune The profile
+ *  @param[in] dim The dimension of the FFT
+ *  @return unsigned The flags to give to the planner
+ *
+ *  The number of threads of the next plans is set. Without settings
+ *  for dim, every thread is used with FFTW_ESTIMATE.
+ *
+ */
+unsigned tune_plan(struct tune *tune, int dim) {
+  struct tune_entry *entry = tune_find(tune, dim);
+  if (entry == NULL) {
+    fftw_plan_with_nthreads(omp_get_max_threads());
+    return FFTW_ESTIMATE;
+  }
+  fftw_plan_with_nthreads(entry->threads);
+  return entry->flags;
+}
+
+/**
+ *  @brief Load the wisdom and the profile saved by tune_save
+ *  @param[out] tune The profile
+ *  @param[in] wisdom The path of the fftw wisdom
+ *  @return 1 If there is no valid profile, tune is then empty
+ *  @return 0 Otherwise
+ *
+ *  The profile is at the path of the wisdom followed by TUNE_SUFFIX.
+ *
+ */
+int tune_load(struct tune *tune, const char *wisdom) {
+  char name[PATH_MAX];
+  char header[64];
+  struct tune_entry entry;
+  int error = 0;
+
+  tune_init(tune);
+  fftw_import_wisdom_from_filename(wisdom);
+
+  if (snprintf(name, sizeof(name), "%s%s", wisdom, TUNE_SUFFIX) >=
+      (int) sizeof(name))
+    return 1;
+  FILE *file = fopen(name, "r");
+  if (file == NULL)
+    return 1;
+
+  if (fgets(header, sizeof(header), file) == NULL ||
+      strcmp(header, TUNE_HEADER "\n") != 0)
+    error = 1;
+  while (!error && fscanf(file, "%d %d %u %lf", &entry.dim, &entry.threads,
+                          &entry.flags, &entry.ns) == 4) {
+    if (entry.dim <= 0 || entry.threads <= 0 || tune->nbr == TUNE_DIMS)
+      error = 1;
+    else
+      tune->entries[tune->nbr++] = entry;
+  }
+  if (!error && !feof(file))
+    error = 1;
+
+  fclose(file);
+  if (error)
+    tune_init(tune);
+  return error;
+}
+
+/**
+ *  @brief Save the wisdom and the profile
+ *  @param[in] tune The profile
+ *  @param[in] wisdom The path of the fftw wisdom
+ *  @return 1 If one of them could not be written
+ *  @return 0 Otherwise
+ *
+ */
+int tune_save(struct tune *tune, const char *wisdom) {
+  char name[PATH_MAX];
+  int error = 0;
+
+  if (!fftw_export_wisdom_to_filename(wisdom) ||
+      snprintf(name, sizeof(name), "%s%s", wisdom, TUNE_SUFFIX) >=
+      (int) sizeof(name))
+    return 1;
+  FILE *file = fopen(name, "w");
+  if (file == NULL)
+    return 1;
+
+  if (fprintf(file, "%s\n", TUNE_HEADER) < 0)
+    error = 1;
+  for (int i = 0; i < tune->nbr && !error; i++)
+    if (fprintf(file, "%d %d %u %.1f\n", tune->entries[i].dim,
+                tune->entries[i].threads, tune->entries[i].flags,
+                tune->entries[i].ns) < 0)
+      error = 1;
+
+  if (fclose(file))
+    error = 1;
+  return error;
+}
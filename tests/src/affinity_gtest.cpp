@@ -0,0 +1,85 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Thread placement test file
+ *
+ */
+
+#include <sched.h>
+#include <pthread.h>
+#include <omp.h>
+#include "include/affinity.h"
+#include "gtest/gtest.h"
+
+/**
+ *  @brief affinity_parse function test
+ *
+ */
+TEST(affinity_suite, affinity_parse) {
+  EXPECT_EQ(AFFINITY_NONE, affinity_parse("none"));
+  EXPECT_EQ(AFFINITY_COMPACT, affinity_parse("compact"));
+  EXPECT_EQ(AFFINITY_SPREAD, affinity_parse("spread"));
+  EXPECT_EQ(-1, affinity_parse("close"));
+}
+
+/**
+ *  @brief affinity_cpu function test
+ *
+ *  compact fills the first processors, spread takes processors as far
+ *  apart as possible, both share them when there are more threads
+ *
+ */
+TEST(affinity_suite, affinity_cpu) {
+  for (int t = 0; t < 4; t++) {
+    EXPECT_EQ(t, affinity_cpu(AFFINITY_COMPACT, t, 4, 16));
+    EXPECT_EQ(4*t, affinity_cpu(AFFINITY_SPREAD, t, 4, 16));
+  }
+  for (int t = 0; t < 6; t++) {
+    EXPECT_EQ(t % 4, affinity_cpu(AFFINITY_COMPACT, t, 6, 4));
+    EXPECT_EQ(t % 4, affinity_cpu(AFFINITY_SPREAD, t, 6, 4));
+  }
+  EXPECT_EQ(6, affinity_cpu(AFFINITY_SPREAD, 2, 3, 10));
+}
+
+/**
+ *  @brief Get the processors of a thread created by affinity_create
+ *
+ */
+static void *affinity_test_thread(void *arg) {
+  pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), (cpu_set_t*) arg);
+  return NULL;
+}
+
+/**
+ *  @brief affinity_pin function test
+ *
+ *  Each thread ends on one processor, the placement is then restored.
+ *  A background thread created by the pinned master thread gets every
+ *  processor allowed before.
+ *
+ */
+TEST(affinity_suite, affinity_pin) {
+  cpu_set_t allowed;
+  ASSERT_EQ(0, sched_getaffinity(0, sizeof(allowed), &allowed));
+
+  EXPECT_EQ(0, affinity_pin(AFFINITY_NONE));
+  ASSERT_EQ(0, affinity_pin(AFFINITY_SPREAD));
+
+  cpu_set_t background;
+  pthread_t thread;
+  ASSERT_EQ(0, affinity_create(&thread, affinity_test_thread, &background));
+  pthread_join(thread, NULL);
+  EXPECT_TRUE(CPU_EQUAL(&allowed, &background));
+
+  int pinned = 0;
+  #pragma omp parallel reduction(+:pinned)
+  {
+    cpu_set_t set;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0 &&
+        CPU_COUNT(&set) == 1)
+      pinned++;
+    pthread_setaffinity_np(pthread_self(), sizeof(allowed), &allowed);
+  }
+  EXPECT_EQ(omp_get_max_threads(), pinned);
+}
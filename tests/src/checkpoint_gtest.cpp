@@ -0,0 +1,166 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Checkpoint functions test file
+ *
+ */
+
+#include <unistd.h>
+#include "include/swarm.h"
+#include "gtest/gtest.h"
+
+/**
+ *  @brief checkpoint.c file test suite
+ *
+ */
+class checkpoint_suite : public ::testing::Test {
+ protected:
+  int out_dim; /**< The dimension of the spectrum */
+  int th_dim; /**< The dimension of the thumbnails */
+  int radius; /**< The radius of the extracted disks */
+  int jorga; /**< The number of thumbnails from the center to a side */
+  int delta; /**< The distance in pixel between two thumbnails */
+
+  /** Path of the checkpoint */
+  const char *name = "build/checkpoint_test.ckpt";
+
+  struct pool pool; /**< The pool in which everything is allocated */
+  fftw_complex *out; /**< A spectrum */
+  fftw_complex *copy; /**< Another spectrum */
+  double **thumbnails; /**< Random thumbnails */
+
+  /**
+   *  @brief setup function for checkpoint_suite tests
+   *
+   *  Allocate two spectrums and random thumbnails
+   *
+   */
+  virtual void SetUp() {
+    out_dim = 100;
+    th_dim = 30;
+    radius = 10;
+    jorga = 1;
+    delta = 15;
+
+    int nbr = (2*jorga+1)*(2*jorga+1);
+    ASSERT_EQ(0, pool_init(&pool,
+                           2*pool_round(out_dim*out_dim*sizeof(fftw_complex)) +
+                           pool_round(nbr*sizeof(double*)) +
+                           nbr*pool_round(th_dim*th_dim*sizeof(double)) +
+                           3*swarm_pool_size(th_dim, out_dim, radius)));
+    out = (fftw_complex*) pool_alloc(&pool,
+                                     out_dim*out_dim*sizeof(fftw_complex));
+    copy = (fftw_complex*) pool_alloc(&pool,
+                                      out_dim*out_dim*sizeof(fftw_complex));
+    thumbnails = (double**) pool_alloc(&pool, nbr*sizeof(double*));
+    for (int i = 0; i < nbr; i++) {
+      thumbnails[i] = (double*) pool_alloc(&pool,
+                                           th_dim*th_dim*sizeof(double));
+      for (int j = 0; j < th_dim*th_dim; j++)
+        thumbnails[i][j] = rand() % 256;  /* NOLINT(runtime/threadsafe_fn) */
+    }
+  }
+
+  /**
+   *  @brief teardown function for checkpoint_suite tests
+   *
+   */
+  virtual void TearDown() {
+    remove(name);
+    pool_destroy(&pool);
+  }
+};
+
+/**
+ *  @brief checkpoint_write and checkpoint_load functions test
+ *
+ *  Write a random spectrum, read it back (copy and mapping) and
+ *  compare it with the original one
+ *
+ */
+TEST_F(checkpoint_suite, write_load) {
+  struct checkpoint_header header;
+  memset(&header, 0, sizeof(header));
+  header.out_dim = out_dim;
+  header.lap = 3;
+  matrix_random(out_dim, out, 1000);
+  ASSERT_EQ(0, checkpoint_write(name, &header, out));
+
+  struct checkpoint_header read;
+  ASSERT_EQ(0, checkpoint_load(name, &read, copy));
+  EXPECT_EQ(3, read.lap);
+  EXPECT_EQ(0u, read.offset % CHECKPOINT_ALIGN);
+  EXPECT_EQ(0, memcmp(out, copy, out_dim*out_dim*sizeof(fftw_complex)));
+
+  fftw_complex *mapped = checkpoint_map(name, &read);
+  ASSERT_TRUE(mapped != NULL);
+  EXPECT_EQ(0, memcmp(out, mapped, out_dim*out_dim*sizeof(fftw_complex)));
+  checkpoint_unmap(mapped, &read);
+}
+
+/**
+ *  @brief checkpoint_read_header on invalid files
+ *
+ */
+TEST_F(checkpoint_suite, invalid) {
+  struct checkpoint_header header;
+  EXPECT_EQ(1, checkpoint_read_header("build/false.ckpt", &header));
+
+  FILE *file = fopen(name, "w");
+  ASSERT_TRUE(file != NULL);
+  fprintf(file, "not a checkpoint, not a checkpoint, not a checkpoint");
+  fclose(file);
+  EXPECT_EQ(1, checkpoint_read_header(name, &header));
+  EXPECT_TRUE(checkpoint_map(name, &header) == NULL);
+
+  /* cut in the spectrum, as by an interrupted copy: the header is valid */
+  memset(&header, 0, sizeof(header));
+  header.out_dim = out_dim;
+  matrix_random(out_dim, out, 1000);
+  ASSERT_EQ(0, checkpoint_write(name, &header, out));
+  ASSERT_EQ(0, truncate(name, header.offset +
+                        out_dim*out_dim*sizeof(fftw_complex) - 1));
+  EXPECT_EQ(0, checkpoint_read_header(name, &header));
+  EXPECT_EQ(1, checkpoint_load(name, &header, copy));
+  EXPECT_TRUE(checkpoint_map(name, &header) == NULL);
+}
+
+/**
+ *  @brief Resuming gives the same result as an uninterrupted run
+ *
+ *  Run 3 laps at once, then 1 lap with checkpoints followed by a
+ *  resume in a new context for the 2 remaining laps
+ *
+ */
+TEST_F(checkpoint_suite, swarm_resume) {
+  struct swarm_ctx ctx;
+
+  matrix_init(out_dim, out, 0);
+  ASSERT_EQ(0, swarm_init(&ctx, &pool, th_dim, out_dim, delta, radius, jorga));
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 3, out));
+
+  matrix_init(out_dim, copy, 0);
+  ctx.checkpoint = name;
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 1, copy));
+  swarm_destroy(&ctx);
+
+  /* a context with other parameters refuses the checkpoint */
+  ASSERT_EQ(0, swarm_init(&ctx, &pool, th_dim, out_dim, delta+1,
+                          radius, jorga));
+  EXPECT_EQ(1, swarm_resume(&ctx, name, copy));
+  swarm_destroy(&ctx);
+
+  ASSERT_EQ(0, swarm_init(&ctx, &pool, th_dim, out_dim, delta, radius, jorga));
+  matrix_init(out_dim, copy, 0);
+  ASSERT_EQ(0, swarm_resume(&ctx, name, copy));
+  EXPECT_EQ(1, ctx.first_lap);
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 3, copy));
+  EXPECT_EQ(0, ctx.first_lap);
+  swarm_destroy(&ctx);
+
+  for (int i = 0; i < out_dim*out_dim; i++) {
+    ASSERT_DOUBLE_EQ(out[i][0], copy[i][0]);
+    ASSERT_DOUBLE_EQ(out[i][1], copy[i][1]);
+  }
+}
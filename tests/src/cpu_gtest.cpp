@@ -0,0 +1,33 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Instruction set dispatch test file
+ *
+ */
+
+#include <string.h>
+#include "include/cpu.h"
+#include "gtest/gtest.h"
+
+/**
+ *  @brief cpu_isa function test
+ *
+ *  The reported variant is one of CPU_DISPATCH and is supported
+ *  by the processor.
+ *
+ */
+TEST(cpu_suite, cpu_isa) {
+  const char *isa = cpu_isa();
+  ASSERT_TRUE(strcmp(isa, "avx512f") == 0 || strcmp(isa, "avx2") == 0 ||
+              strcmp(isa, "default") == 0);
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (strcmp(isa, "avx512f") == 0) {
+    EXPECT_TRUE(__builtin_cpu_supports("avx512f"));
+  } else if (strcmp(isa, "avx2") == 0) {
+    EXPECT_TRUE(__builtin_cpu_supports("avx2"));
+    EXPECT_FALSE(__builtin_cpu_supports("avx512f"));
+  }
+#endif
+  printf("Kernels compiled for %s\n", isa);
+}
@@ -0,0 +1,282 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Thumbnail arrival test file
+ *
+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include "include/swarm.h"
+#include "gtest/gtest.h"
+
+/**
+ *  @brief An acquisition writing the thumbnails one after the other
+ *
+ */
+struct feed_test_acquisition {
+  struct feed *feed; /**< The feed to signal */
+  double **thumbnails; /**< The thumbnails to write */
+  double **source; /**< The thumbnails acquired */
+  int nbr; /**< The number of thumbnails to acquire */
+  int th_dim; /**< The dimension of each thumbnail */
+  const char *dir; /**< Where to write them, NULL to signal the feed */
+};
+
+/**
+ *  @brief Acquire the thumbnails in reverse order, 2 ms each
+ *
+ */
+static void *feed_test_acquire(void *arg) {
+  struct feed_test_acquisition *acq = (struct feed_test_acquisition*) arg;
+  int side = acq->feed->side;
+  char path[FILENAME_MAX];
+  char tmp[FILENAME_MAX];
+
+  for (int n = 0; n < acq->nbr; n++) {
+    int i = side*side-1-n;
+    usleep(2000);
+    if (acq->dir) {
+      snprintf(tmp, sizeof(tmp), "%s/tmp.tiff", acq->dir);
+      snprintf(path, sizeof(path), "%s/%.5d%.5d.tiff", acq->dir,
+               i/side, i%side);
+      tiff_frommatrix(tmp, acq->source[i], acq->th_dim, acq->th_dim);
+      rename(tmp, path);
+    } else {
+      memcpy(acq->thumbnails[i], acq->source[i],
+             acq->th_dim*acq->th_dim*sizeof(double));
+      feed_arrive(acq->feed, i);
+    }
+  }
+  return NULL;
+}
+
+/**
+ *  @brief feed.c file test suite
+ *
+ */
+class feed_suite : public ::testing::Test {
+ protected:
+  int out_dim; /**< The dimension of the output */
+  int th_dim; /**< The dimension of the thumbnails */
+  int radius; /**< The radius of the extracted disks */
+  int jorga; /**< The number of thumbnails from the center to a side */
+  int delta; /**< The distance in pixel between two thumbnails */
+  int nbr; /**< The number of thumbnails */
+
+  struct pool pool; /**< The pool in which everything is allocated */
+  struct swarm_ctx ctx; /**< The context of the reconstruction */
+  struct feed feed; /**< The arrival of the thumbnails */
+  fftw_complex *out; /**< The spectrum being retrieved */
+  fftw_complex *ref; /**< The spectrum retrieved without feed */
+  double **source; /**< The thumbnails, as acquired */
+  double **thumbnails; /**< The thumbnails given to swarm_run */
+
+  /**
+   *  @brief setup function for feed_suite tests
+   *
+   */
+  virtual void SetUp() {
+    out_dim = 100;
+    th_dim = 30;
+    radius = 10;
+    jorga = 1;
+    delta = 15;
+    nbr = (2*jorga+1)*(2*jorga+1);
+
+    size_t th_size = pool_round(th_dim*th_dim*sizeof(double));
+    ASSERT_EQ(0, pool_init(&pool,
+                           2*pool_round(out_dim*out_dim*sizeof(fftw_complex)) +
+                           2*pool_round(nbr*sizeof(double*)) +
+                           2*nbr*th_size + feed_pool_size(jorga) +
+                           swarm_pool_size(th_dim, out_dim, radius)));
+    out = (fftw_complex*) pool_alloc(&pool,
+                                     out_dim*out_dim*sizeof(fftw_complex));
+    ref = (fftw_complex*) pool_alloc(&pool,
+                                     out_dim*out_dim*sizeof(fftw_complex));
+    source = (double**) pool_alloc(&pool, nbr*sizeof(double*));
+    thumbnails = (double**) pool_alloc(&pool, nbr*sizeof(double*));
+    for (int i = 0; i < nbr; i++) {
+      source[i] = (double*) pool_alloc(&pool, th_dim*th_dim*sizeof(double));
+      thumbnails[i] = (double*) pool_alloc(&pool,
+                                           th_dim*th_dim*sizeof(double));
+      for (int j = 0; j < th_dim*th_dim; j++) {
+        source[i][j] = (i*31 + j*7) % 256;
+        thumbnails[i][j] = 0;
+      }
+    }
+    ASSERT_EQ(0, feed_init(&feed, &pool, jorga));
+    ASSERT_EQ(0, swarm_init(&ctx, &pool, th_dim, out_dim, delta, radius,
+                            jorga));
+
+    matrix_init(out_dim, ref, 0);
+    ASSERT_EQ(0, swarm_run(&ctx, source, 2, ref));
+    matrix_init(out_dim, out, 0);
+  }
+
+  /**
+   *  @brief teardown function for feed_suite tests
+   *
+   */
+  virtual void TearDown() {
+    swarm_destroy(&ctx);
+    feed_destroy(&feed);
+    pool_destroy(&pool);
+  }
+
+  /**
+   *  @brief Check that out is the spectrum retrieved without feed
+   *
+   */
+  void compare() {
+    for (int i = 0; i < out_dim*out_dim; i++) {
+      ASSERT_EQ((ref[i])[0], (out[i])[0]);
+      ASSERT_EQ((ref[i])[1], (out[i])[1]);
+    }
+  }
+};
+
+/**
+ *  @brief feed_wait returns when the thumbnail arrived or the feed closed
+ *
+ */
+TEST_F(feed_suite, arrive_wait) {
+  feed_arrive(&feed, 4);
+  feed_arrive(&feed, 4);
+  EXPECT_EQ(0, feed_wait(&feed, 4));
+  EXPECT_EQ(0, feed_complete(&feed));
+  EXPECT_EQ(1, feed_wait(&feed, nbr));
+
+  feed_close(&feed);
+  EXPECT_EQ(1, feed_wait(&feed, 0));
+  EXPECT_EQ(0, feed_wait(&feed, 4));
+
+  for (int i = 0; i < nbr; i++)
+    feed_arrive(&feed, i);
+  EXPECT_EQ(1, feed_complete(&feed));
+  EXPECT_EQ(0, feed_wait(&feed, 0));
+}
+
+/**
+ *  @brief The reconstruction during the acquisition is the same as after
+ *
+ */
+TEST_F(feed_suite, acquisition) {
+  struct feed_test_acquisition acq = {&feed, thumbnails, source, nbr, th_dim,
+                                      NULL};
+  pthread_t thread;
+  ctx.feed = &feed;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, feed_test_acquire, &acq));
+  EXPECT_EQ(0, swarm_run(&ctx, thumbnails, 2, out));
+  pthread_join(thread, NULL);
+  EXPECT_EQ(0, ctx.missing);
+  compare();
+}
+
+/**
+ *  @brief An aborted acquisition skips the missing leds
+ *
+ */
+TEST_F(feed_suite, aborted) {
+  struct feed_test_acquisition acq = {&feed, thumbnails, source, nbr-3,
+                                      th_dim, NULL};
+  pthread_t thread;
+  ctx.feed = &feed;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, feed_test_acquire, &acq));
+  pthread_join(thread, NULL);
+  feed_close(&feed);
+  EXPECT_EQ(4, swarm_run(&ctx, thumbnails, 2, out));
+  /* the first three thumbnails, at each lap */
+  EXPECT_EQ(6, ctx.missing);
+
+  /* the missing leds are not in the progress */
+  struct swarm_progress progress;
+  swarm_poll(&ctx, &progress);
+  EXPECT_EQ(1, progress.lap);
+  EXPECT_EQ(nbr-3, progress.led);
+}
+
+/**
+ *  @brief The thumbnails are read from a directory as they are written
+ *
+ *  The reference is made with the same thumbnails written and read in
+ *  tiff, since they are quantized.
+ *
+ */
+TEST_F(feed_suite, watch) {
+  const char *dir = "build/feed_test";
+  char path[FILENAME_MAX];
+  mkdir(dir, 0755);
+  for (int i = 0; i < nbr; i++) {
+    snprintf(path, sizeof(path), "%s/%.5d%.5d.tiff", dir,
+             i/(2*jorga+1), i%(2*jorga+1));
+    remove(path);
+  }
+
+  struct feed_test_acquisition acq = {&feed, thumbnails, source, nbr, th_dim,
+                                      dir};
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, feed_test_acquire, &acq));
+  ASSERT_EQ(0, feed_watch(&feed, dir, thumbnails, th_dim, 10000));
+  ctx.feed = &feed;
+  EXPECT_EQ(0, swarm_run(&ctx, thumbnails, 2, out));
+  feed_unwatch(&feed);
+  pthread_join(thread, NULL);
+  EXPECT_EQ(1, feed_complete(&feed));
+
+  ctx.feed = NULL;
+  for (int i = 0; i < nbr; i++) {
+    snprintf(path, sizeof(path), "%s/%.5d%.5d.tiff", dir,
+             i/(2*jorga+1), i%(2*jorga+1));
+    ASSERT_EQ(0, tiff_tomatrix(path, source[i], th_dim, th_dim));
+    remove(path);
+  }
+  rmdir(dir);
+  matrix_init(out_dim, ref, 0);
+  ASSERT_EQ(0, swarm_run(&ctx, source, 2, ref));
+  compare();
+}
+
+/**
+ *  @brief A watched directory without thumbnails closes the feed
+ *
+ */
+TEST_F(feed_suite, watch_timeout) {
+  ASSERT_EQ(0, feed_watch(&feed, "build/feed_none", thumbnails, th_dim, 50));
+  ctx.feed = &feed;
+  EXPECT_EQ(4, swarm_run(&ctx, thumbnails, 1, out));
+  EXPECT_EQ(nbr, ctx.missing);
+  feed_unwatch(&feed);
+}
+
+/**
+ *  @brief Cancel a reconstruction after 20 ms
+ *
+ */
+static void *feed_test_cancel(void *arg) {
+  usleep(20000);
+  swarm_cancel((struct swarm_ctx*) arg);
+  return NULL;
+}
+
+/**
+ *  @brief A cancel stops a wait for a thumbnail which never arrives
+ *
+ */
+TEST_F(feed_suite, cancel) {
+  int cancel = 1;
+  EXPECT_EQ(1, feed_wait_cancel(&feed, 4, &cancel));
+  feed_arrive(&feed, 4);
+  EXPECT_EQ(0, feed_wait_cancel(&feed, 4, &cancel));
+
+  /* the feed is never closed, only the cancel ends the run */
+  pthread_t thread;
+  ctx.feed = &feed;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, feed_test_cancel, &ctx));
+  EXPECT_EQ(5, swarm_run(&ctx, thumbnails, 2, out));
+  pthread_join(thread, NULL);
+  /* the center arrived, the led waiting is not missing */
+  EXPECT_EQ(0, ctx.missing);
+  EXPECT_EQ(1, ctx.leds);
+}
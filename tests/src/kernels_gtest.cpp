@@ -0,0 +1,149 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Per-led kernels test file
+ *
+ */
+
+#include "include/kernels.h"
+#include "gtest/gtest.h"
+
+/**
+ *  @brief kernels.c file test suite
+ *
+ *  Every kernel is compared to the function of matrix.c it replaces,
+ *  for each specialized dimension and for a generic one.
+ *
+ */
+class kernels_suite : public ::testing::TestWithParam<int> {
+ protected:
+  int dim; /**< The dimension of the thumbnails */
+  int big_dim; /**< The dimension of the big matrix */
+
+  fftw_complex *a; /**< A thumbnail */
+  fftw_complex *b; /**< Another thumbnail */
+  fftw_complex *big; /**< A big matrix */
+  fftw_complex *big_ref; /**< Another big matrix */
+  double *mod; /**< Some modules */
+
+  struct kernels kernels; /**< The kernels for dim */
+
+  /**
+   *  @brief setup function for kernels_suite tests
+   *
+   */
+  virtual void SetUp() {
+    dim = GetParam();
+    big_dim = 3*dim+1;
+    a = (fftw_complex*) fftw_malloc(dim*dim*sizeof(fftw_complex));
+    b = (fftw_complex*) fftw_malloc(dim*dim*sizeof(fftw_complex));
+    big = (fftw_complex*) fftw_malloc(big_dim*big_dim*sizeof(fftw_complex));
+    big_ref = (fftw_complex*) fftw_malloc(big_dim*big_dim*
+                                          sizeof(fftw_complex));
+    mod = (double*) malloc(dim*dim*sizeof(double));
+    for (int i = 0; i < dim*dim; i++) {
+      (a[i])[0] = (i % 7) - 3;
+      (a[i])[1] = (i % 5) - 2;
+      mod[i] = i % 11;
+    }
+    for (int i = 0; i < big_dim*big_dim; i++) {
+      (big[i])[0] = i;
+      (big[i])[1] = -i;
+    }
+    kernels_select(&kernels, dim);
+  }
+
+  /**
+   *  @brief teardown function for kernels_suite tests
+   *
+   */
+  virtual void TearDown() {
+    fftw_free(a);
+    fftw_free(b);
+    fftw_free(big);
+    fftw_free(big_ref);
+    free(mod);
+  }
+};
+
+/**
+ *  @brief The kernels are specialized only for the cameras dimensions
+ *
+ */
+TEST_P(kernels_suite, select) {
+  EXPECT_EQ(dim, kernels.dim);
+  EXPECT_EQ(dim == 64 || dim == 100 || dim == 128 || dim == 256,
+            kernels.specialized);
+}
+
+/**
+ *  @brief clear, normalize and project against matrix.c
+ *
+ */
+TEST_P(kernels_suite, elementwise) {
+  matrix_copy(a, b, dim);
+  kernels.clear(dim, b);
+  for (int i = 0; i < dim*dim; i++) {
+    ASSERT_EQ(0, (b[i])[0]);
+    ASSERT_EQ(0, (b[i])[1]);
+  }
+
+  div_dim(a, b, dim);
+  kernels.normalize(dim, a);
+  for (int i = 0; i < dim*dim; i++) {
+    ASSERT_EQ((b[i])[0], (a[i])[0]);
+    ASSERT_EQ((b[i])[1], (a[i])[1]);
+  }
+
+  matrix_project(dim, mod, b);
+  kernels.project(dim, mod, a);
+  for (int i = 0; i < dim*dim; i++) {
+    ASSERT_EQ((b[i])[0], (a[i])[0]);
+    ASSERT_EQ((b[i])[1], (a[i])[1]);
+  }
+}
+
+/**
+ *  @brief extract and writeback against copy_disk_ultimate
+ *
+ *  The centers are taken so that the disk folds in the big matrix.
+ *
+ */
+TEST_P(kernels_suite, disk) {
+  int radius = (dim-1)/2;
+  int centers[][2] = {{0, 0}, {big_dim-1, 2}, {big_dim/2, big_dim-3},
+                      {-5, 3*big_dim+1}};
+
+  for (int c = 0; c < 4; c++) {
+    int x = centers[c][0];
+    int y = centers[c][1];
+
+    matrix_init(dim, a, 0);
+    matrix_init(dim, b, 0);
+    ASSERT_EQ(0, copy_disk_ultimate(big, b, big_dim, dim, x, y, 0, 0,
+                                    radius));
+    ASSERT_EQ(0, kernels.extract(dim, big, big_dim, x, y, radius, a));
+    for (int i = 0; i < dim*dim; i++) {
+      ASSERT_EQ((b[i])[0], (a[i])[0]);
+      ASSERT_EQ((b[i])[1], (a[i])[1]);
+    }
+
+    for (int i = 0; i < dim*dim; i++)
+      (a[i])[0] = -(a[i])[0]-1;
+    memcpy(big_ref, big, big_dim*big_dim*sizeof(fftw_complex));
+    ASSERT_EQ(0, copy_disk_ultimate(a, big_ref, dim, big_dim, 0, 0, x, y,
+                                    radius));
+    ASSERT_EQ(0, kernels.writeback(dim, a, big, big_dim, x, y, radius));
+    for (int i = 0; i < big_dim*big_dim; i++) {
+      ASSERT_EQ((big_ref[i])[0], (big[i])[0]);
+      ASSERT_EQ((big_ref[i])[1], (big[i])[1]);
+    }
+  }
+
+  EXPECT_EQ(1, kernels.extract(dim, big, big_dim, 0, 0, radius+1, a));
+  EXPECT_EQ(1, kernels.writeback(dim, a, big, big_dim, 0, 0, 0));
+}
+
+INSTANTIATE_TEST_CASE_P(dims, kernels_suite,
+                        ::testing::Values(64, 100, 128, 256, 7, 30));
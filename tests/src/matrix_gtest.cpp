@@ -6,6 +6,7 @@
  *
  */
 
+#include <sys/mman.h>
 #include "include/matrix.h"
 #include "gtest/gtest.h"
 
@@ -239,3 +240,392 @@ TEST_F(matrix_suite, copy_disk_with_offset_test) {
   ASSERT_EQ(0, copy_disk_with_offset(a, b, dim, radius, centerX, centerY));
 }
 
+
+/**
+ *  @brief matrix_size function test
+ *
+ */
+TEST_F(matrix_suite, matrix_size) {
+  size_t size;
+
+  ASSERT_EQ(0, matrix_size(dim, dim, sizeof(fftw_complex), &size));
+  EXPECT_EQ(dim*dim*sizeof(fftw_complex), size);
+
+  /* more than an int can count */
+  ASSERT_EQ(0, matrix_size(50000, 50000, sizeof(double), &size));
+  EXPECT_EQ((size_t) 50000*50000*sizeof(double), size);
+
+  EXPECT_EQ(1, matrix_size(-1, dim, sizeof(double), &size));
+  EXPECT_EQ(1, matrix_size(dim, -1, sizeof(double), &size));
+  EXPECT_EQ(1, matrix_size(2147483647, 2147483647, SIZE_MAX/4, &size));
+}
+
+/**
+ *  @brief Test suite on a matrix whose number of elements overflows an int
+ *
+ *  The matrix is mapped without reserving memory, only the pages
+ *  touched by the tests are allocated.
+ *
+ */
+class matrix_large : public ::testing::Test {
+ protected:
+  int dim; /**< The dimension of the big matrix, above 46340 */
+  int small_dim; /**< The dimension of the small matrix */
+  size_t size; /**< The size of big in bytes */
+
+  fftw_complex *big; /**< The big matrix, mapped */
+  fftw_complex *small; /**< A small matrix */
+
+  /**
+   *  @brief setup function for matrix_large tests
+   *
+   */
+  virtual void SetUp() {
+    dim = 50000;
+    small_dim = 30;
+    ASSERT_EQ(0, matrix_size(dim, dim, sizeof(fftw_complex), &size));
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) {
+      big = NULL;
+      small = NULL;
+      GTEST_SKIP() << "Could not map " << size << " bytes";
+    }
+    big = (fftw_complex*) map;
+    small = (fftw_complex*) fftw_malloc(small_dim*small_dim*
+                                        sizeof(fftw_complex));
+    for (int i = 0; i < small_dim*small_dim; i++) {
+      small[i][0] = i+1;
+      small[i][1] = -i-1;
+    }
+  }
+
+  /**
+   *  @brief teardown function for matrix_large tests
+   *
+   */
+  virtual void TearDown() {
+    if (big)
+      munmap(big, size);
+    fftw_free(small);
+  }
+};
+
+/**
+ *  @brief matrix_extract function test beyond 2^31 elements
+ *
+ *  The extracted part is folded on the last lines and columns
+ *
+ */
+TEST_F(matrix_large, matrix_extract) {
+  int off = dim - small_dim/2;
+  for (int i = 0; i < small_dim; i++)
+    for (int j = 0; j < small_dim; j++) {
+      size_t X = matrix_cyclic(off+i, dim);
+      size_t Y = matrix_cyclic(off+j, dim);
+      big[X*dim+Y][0] = i*small_dim+j;
+      big[X*dim+Y][1] = 0;
+    }
+
+  ASSERT_EQ(0, matrix_extract(small_dim, dim, small, big, off, off));
+  for (int i = 0; i < small_dim*small_dim; i++) {
+    EXPECT_EQ(i, small[i][0]);
+    EXPECT_EQ(0, small[i][1]);
+  }
+}
+
+/**
+ *  @brief copy_disk_ultimate function test beyond 2^31 elements
+ *
+ *  The disk is written around the last element of the big matrix,
+ *  then read back
+ *
+ */
+TEST_F(matrix_large, copy_disk_ultimate) {
+  int radius = 10;
+  int center = dim-1;
+
+  ASSERT_EQ(0, copy_disk_ultimate(small, big, small_dim, dim,
+                                  0, 0, center, center, radius));
+  for (int dx = -(radius-1); dx <= radius-1; dx++)
+    for (int dy = -(radius-1-abs(dx)); dy <= radius-1-abs(dx); dy++) {
+      size_t X = matrix_cyclic(center+dx, dim);
+      size_t Y = matrix_cyclic(center+dy, dim);
+      int in = matrix_cyclic(dx, small_dim)*small_dim +
+        matrix_cyclic(dy, small_dim);
+      EXPECT_EQ(small[in][0], big[X*dim+Y][0]);
+      EXPECT_EQ(small[in][1], big[X*dim+Y][1]);
+    }
+
+  fftw_complex *copy = (fftw_complex*) fftw_malloc(small_dim*small_dim*
+                                                   sizeof(fftw_complex));
+  matrix_init(small_dim, copy, 0);
+  ASSERT_EQ(0, copy_disk_ultimate(big, copy, dim, small_dim,
+                                  center, center, 0, 0, radius));
+  EXPECT_EQ(small[0][0], copy[0][0]);
+  EXPECT_EQ(small[small_dim*small_dim-1][0],
+            copy[small_dim*small_dim-1][0]);
+  fftw_free(copy);
+}
+
+/**
+ *  @brief Split-range copies test
+ *
+ *  copy_disk_ultimate, von_neumann, matrix_extract and matrix_recenter
+ *  are compared with copies done element by element, folded with
+ *  matrix_cyclic
+ *
+ */
+TEST_F(matrix_suite, split_copies) {
+  int dimIn = 13, dimOut = 17;
+  fftw_complex *in = (fftw_complex*) fftw_malloc(dimIn*dimIn*
+                                                 sizeof(fftw_complex));
+  fftw_complex *out = (fftw_complex*) fftw_malloc(dimOut*dimOut*
+                                                  sizeof(fftw_complex));
+  fftw_complex *expected = (fftw_complex*) fftw_malloc(dimOut*dimOut*
+                                                       sizeof(fftw_complex));
+  for (int i = 0; i < dimIn*dimIn; i++) {
+    in[i][0] = i;
+    in[i][1] = -i;
+  }
+
+  /* disks folded in one, both or none of the matrices */
+  int centers[][4] = {{6, 6, 8, 8}, {0, 12, 16, 0}, {-3, 20, 5, -40},
+                      {12, 0, 0, 16}};
+  for (int c = 0; c < 4; c++) {
+    for (int radius = 1; radius <= (dimIn-1)/2; radius++) {
+      int inX = centers[c][0], inY = centers[c][1];
+      int outX = centers[c][2], outY = centers[c][3];
+
+      matrix_init(dimOut, out, 0);
+      matrix_init(dimOut, expected, 0);
+      for (int dx = -(radius-1); dx <= radius-1; dx++)
+        for (int dy = -(radius-1-abs(dx)); dy <= radius-1-abs(dx); dy++) {
+          int o = matrix_cyclic(outX+dx, dimOut)*dimOut +
+            matrix_cyclic(outY+dy, dimOut);
+          int i = matrix_cyclic(inX+dx, dimIn)*dimIn +
+            matrix_cyclic(inY+dy, dimIn);
+          expected[o][0] = in[i][0];
+          expected[o][1] = in[i][1];
+        }
+
+      ASSERT_EQ(0, copy_disk_ultimate(in, out, dimIn, dimOut,
+                                      inX, inY, outX, outY, radius));
+      for (int i = 0; i < dimOut*dimOut; i++) {
+        EXPECT_EQ(expected[i][0], out[i][0]);
+        EXPECT_EQ(expected[i][1], out[i][1]);
+      }
+    }
+  }
+  EXPECT_EQ(1, copy_disk_ultimate(in, out, dimIn, dimOut, 0, 0, 0, 0,
+                                  (dimIn-1)/2+1));
+
+  /* von_neumann: distance at most radius, same place */
+  matrix_init(dimIn, out, 0);
+  von_neumann(12, 1, 4, dimIn, in, out);
+  for (int x = 0; x < dimIn; x++)
+    for (int y = 0; y < dimIn; y++) {
+      int dx = abs(x-12) < dimIn-abs(x-12) ? abs(x-12) : dimIn-abs(x-12);
+      int dy = abs(y-1) < dimIn-abs(y-1) ? abs(y-1) : dimIn-abs(y-1);
+      EXPECT_EQ(dx+dy <= 4 ? in[x*dimIn+y][0] : 0, out[x*dimIn+y][0]);
+    }
+
+  /* matrix_extract folded on both sides */
+  int smallDim = 5;
+  ASSERT_EQ(0, matrix_extract(smallDim, dimIn, out, in, -3, 11));
+  for (int i = 0; i < smallDim; i++)
+    for (int j = 0; j < smallDim; j++) {
+      int X = matrix_cyclic(i-3, dimIn), Y = matrix_cyclic(j+11, dimIn);
+      EXPECT_EQ(in[X*dimIn+Y][0], out[i*smallDim+j][0]);
+      EXPECT_EQ(in[X*dimIn+Y][1], out[i*smallDim+j][1]);
+    }
+
+  /* matrix_recenter, then back */
+  matrix_recenter(in, out, dimIn, 7);
+  for (int i = 0; i < dimIn; i++)
+    for (int j = 0; j < dimIn; j++) {
+      int X = (i+7) % dimIn, Y = (j+7) % dimIn;
+      EXPECT_EQ(in[i*dimIn+j][0], out[X*dimIn+Y][0]);
+    }
+  matrix_recenter(out, expected, dimIn, -7);
+  for (int i = 0; i < dimIn*dimIn; i++)
+    EXPECT_EQ(in[i][0], expected[i][0]);
+
+  fftw_free(in);
+  fftw_free(out);
+  fftw_free(expected);
+}
+
+/**
+ *  @brief In-place shift test
+ *
+ *  matrix_shift must give the same matrix as the out-of-place
+ *  matrix_recenter, for even and odd dimensions (including a
+ *  dimension big enough to be parallel), and matrix_ifftshift must
+ *  undo matrix_fftshift
+ *
+ */
+TEST_F(matrix_suite, matrix_shift) {
+  int dims[] = {1, 2, 7, 10, MATRIX_PARALLEL_DIM+1};
+
+  for (int d = 0; d < 5; d++) {
+    int n = dims[d];
+    fftw_complex *in = (fftw_complex*) fftw_malloc(n*n*sizeof(fftw_complex));
+    fftw_complex *ref = (fftw_complex*) fftw_malloc(n*n*sizeof(fftw_complex));
+    fftw_complex *mat = (fftw_complex*) fftw_malloc(n*n*sizeof(fftw_complex));
+    for (int i = 0; i < n*n; i++) {
+      in[i][0] = i;
+      in[i][1] = -i;
+    }
+
+    int offsets[] = {0, 1, n/2, -(n/2), n-1, 3*n+2};
+    for (int o = 0; o < 6; o++) {
+      matrix_recenter(in, ref, n, offsets[o]);
+      matrix_copy(in, mat, n);
+      matrix_recenter(mat, mat, n, offsets[o]);
+      for (int i = 0; i < n*n; i++) {
+        ASSERT_EQ(ref[i][0], mat[i][0]);
+        ASSERT_EQ(ref[i][1], mat[i][1]);
+      }
+    }
+
+    /* the zero frequency goes to the center */
+    matrix_copy(in, mat, n);
+    matrix_fftshift(mat, n);
+    EXPECT_EQ(in[0][0], mat[(n/2)*n + n/2][0]);
+    matrix_ifftshift(mat, n);
+    for (int i = 0; i < n*n; i++)
+      ASSERT_EQ(in[i][0], mat[i][0]);
+
+    fftw_free(in);
+    fftw_free(ref);
+    fftw_free(mat);
+  }
+}
+
+/**
+ *  @brief elementwise kernels test, below and above the threshold
+ *
+ *  The extrema are put in the first column, which was once skipped.
+ *
+ */
+TEST_F(matrix_suite, parallel_kernels) {
+  int dims[] = {dim, MATRIX_PARALLEL_DIM+3};
+
+  for (int d = 0; d < 2; d++) {
+    int n = dims[d];
+    fftw_complex *in = (fftw_complex*) fftw_malloc(n*n*sizeof(fftw_complex));
+    fftw_complex *out = (fftw_complex*) fftw_malloc(n*n*sizeof(fftw_complex));
+    double *real = (double*) malloc(n*n*sizeof(double));
+    for (int i = 0; i < n*n; i++) {
+      in[i][0] = i % 17;
+      in[i][1] = -i;
+    }
+    in[(n-1)*n][0] = 100;
+    in[n][0] = -100;
+
+    matrix_copy(in, out, n);
+    div_dim(out, out, n);
+    matrix_realpart(n, out, real);
+    for (int i = 0; i < n*n; i++) {
+      ASSERT_DOUBLE_EQ(in[i][0]/n, real[i]);
+      ASSERT_DOUBLE_EQ(in[i][1]/n, out[i][1]);
+    }
+    EXPECT_DOUBLE_EQ(100./n, matrix_max(n, n, real));
+    EXPECT_DOUBLE_EQ(-100./n, matrix_min(n, n, real));
+
+    matrix_init(n, out, 2);
+    for (int i = 0; i < n*n; i++) {
+      ASSERT_EQ(2, out[i][0]);
+      ASSERT_EQ(2, out[i][1]);
+    }
+
+    fftw_free(in);
+    fftw_free(out);
+    free(real);
+  }
+}
+
+/**
+ *  @brief polar conversion kernels test
+ *
+ *  Compares the kernels to alg2exp and exp2alg on every quadrant,
+ *  and the fast ones to atan2, cos and sin.
+ *
+ */
+TEST_F(matrix_suite, polar_kernels) {
+  double *arg = (double*) malloc(dim * dim * sizeof(double));
+  double *fast = (double*) malloc(dim * dim * sizeof(double));
+  for (int i = 0; i < dim*dim; i++) {
+    (a[i])[0] = (i % 7) - 3;
+    (a[i])[1] = (i % 5) - 2;
+  }
+
+  matrix_magnitude(dim, a, mod);
+  matrix_phase(dim, a, arg);
+  matrix_phase_fast(dim, a, fast);
+  for (int i = 0; i < dim*dim; i++) {
+    alg2exp(a[i], c);
+    ASSERT_DOUBLE_EQ(c[0], mod[i]);
+    ASSERT_DOUBLE_EQ(c[1], arg[i]);
+    ASSERT_NEAR(atan2((a[i])[1], (a[i])[0]), fast[i], MATRIX_PHASE_ERROR);
+  }
+
+  /* the sign of the imaginary part is kept */
+  matrix_polar(dim, mod, arg, b);
+  for (int i = 0; i < dim*dim; i++) {
+    ASSERT_NEAR((a[i])[0], (b[i])[0], 1e-12);
+    ASSERT_NEAR((a[i])[1], (b[i])[1], 1e-12);
+  }
+
+  /* the fast conversion, on the whole range of the arguments */
+  for (int i = 0; i < dim*dim; i++) {
+    arg[i] = -M_PI + 2*M_PI*i/(dim*dim-1);
+    mod[i] = 1 + i % 3;
+  }
+  matrix_polar_fast(dim, mod, arg, b);
+  for (int i = 0; i < dim*dim; i++) {
+    ASSERT_NEAR(mod[i]*cos(arg[i]), (b[i])[0], mod[i]*MATRIX_POLAR_ERROR);
+    ASSERT_NEAR(mod[i]*sin(arg[i]), (b[i])[1], mod[i]*MATRIX_POLAR_ERROR);
+  }
+
+  /* new modules with the old arguments */
+  for (int i = 0; i < dim*dim; i++)
+    mod[i] = i;
+  matrix_copy(a, b, dim);
+  matrix_project(dim, mod, b);
+  for (int i = 0; i < dim*dim; i++) {
+    alg2exp(a[i], c);
+    c[0] = mod[i];
+    exp2alg(c, d);
+    ASSERT_NEAR(d[0], (b[i])[0], 1e-12);
+    ASSERT_NEAR(d[1], (b[i])[1], 1e-12);
+  }
+
+  free(arg);
+  free(fast);
+}
+
+/**
+ *  @brief The residual of matrix_residual is the one matrix_project removes
+ *
+ */
+TEST_F(matrix_suite, residual) {
+  double norm;
+  double error = 0;
+  double energy = 0;
+  for (int i = 0; i < dim*dim; i++) {
+    (a[i])[0] = (i % 7) - 3;
+    (a[i])[1] = (i % 5) - 2;
+    mod[i] = i % 11;
+    alg2exp(a[i], c);
+    error += (c[0]-mod[i])*(c[0]-mod[i]);
+    energy += mod[i]*mod[i];
+  }
+
+  EXPECT_NEAR(error, matrix_residual(dim, mod, a, &norm), 1e-9*error);
+  EXPECT_NEAR(energy, norm, 1e-9*energy);
+
+  matrix_project(dim, mod, a);
+  EXPECT_NEAR(0, matrix_residual(dim, mod, a, &norm), 1e-18*energy);
+}
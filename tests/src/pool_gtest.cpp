@@ -0,0 +1,242 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Buffer pool test file
+ *
+ */
+
+#include <inttypes.h>
+#include "include/pool.h"
+#include "include/matrix.h"
+#include "include/profile.h"
+#include "gtest/gtest.h"
+
+/** @cond DEV */
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nbr, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_fftw_malloc(size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nbr, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+void *__wrap_fftw_malloc(size_t size);
+}
+
+static uint64_t pool_test_allocs = 0;
+/** @endcond */
+
+/**
+ *  @brief Count the heap allocations of the sources and the tests
+ *
+ *  The tests are linked with --wrap for malloc, calloc, realloc and
+ *  fftw_malloc (see the makefile), so every call made by the code
+ *  under test comes here instead, with or without pool_heap_alloc.
+ *  The libraries (libc, fftw, OpenMP) are not counted.
+ *
+ */
+void *__wrap_malloc(size_t size) {
+  __atomic_fetch_add(&pool_test_allocs, 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+/** @brief See __wrap_malloc */
+void *__wrap_calloc(size_t nbr, size_t size) {
+  __atomic_fetch_add(&pool_test_allocs, 1, __ATOMIC_RELAXED);
+  return __real_calloc(nbr, size);
+}
+
+/** @brief See __wrap_malloc */
+void *__wrap_realloc(void *ptr, size_t size) {
+  __atomic_fetch_add(&pool_test_allocs, 1, __ATOMIC_RELAXED);
+  return __real_realloc(ptr, size);
+}
+
+/** @brief See __wrap_malloc */
+void *__wrap_fftw_malloc(size_t size) {
+  __atomic_fetch_add(&pool_test_allocs, 1, __ATOMIC_RELAXED);
+  return __real_fftw_malloc(size);
+}
+
+/**
+ *  @brief Get the number of heap allocations done so far by the code \
+ *         under test, see __wrap_malloc
+ *
+ */
+uint64_t pool_test_heap_count(void) {
+  return __atomic_load_n(&pool_test_allocs, __ATOMIC_RELAXED);
+}
+
+/**
+ *  @brief pool.c file test suite
+ *
+ */
+class pool_suite : public ::testing::Test {
+ protected:
+  struct pool pool; /**< The pool used in the tests */
+  size_t size; /**< The size of the pool */
+
+  /**
+   *  @brief setup function for pool_suite tests
+   *
+   *  Allocate the pool
+   *
+   */
+  virtual void SetUp() {
+    size = 1000;
+    ASSERT_EQ(0, pool_init(&pool, size));
+  }
+
+  /**
+   *  @brief teardown function for pool_suite tests
+   *
+   *  Free the pool
+   *
+   */
+  virtual void TearDown() {
+    pool_destroy(&pool);
+  }
+};
+
+/**
+ *  @brief pool_round function test
+ *
+ */
+TEST_F(pool_suite, pool_round) {
+  EXPECT_EQ(0u, pool_round(0));
+  EXPECT_EQ((size_t) POOL_ALIGN, pool_round(1));
+  EXPECT_EQ((size_t) POOL_ALIGN, pool_round(POOL_ALIGN));
+  EXPECT_EQ((size_t) 2*POOL_ALIGN, pool_round(POOL_ALIGN+1));
+}
+
+/**
+ *  @brief pool_alloc function test
+ *
+ *  Every block must be aligned, distinct, and the pool must
+ *  refuse to give more than its size
+ *
+ */
+TEST_F(pool_suite, pool_alloc) {
+  char *first = (char*) pool_alloc(&pool, 10);
+  char *second = (char*) pool_alloc(&pool, 100);
+  ASSERT_TRUE(first != NULL);
+  ASSERT_TRUE(second != NULL);
+  EXPECT_EQ(0u, (uintptr_t) first % POOL_ALIGN);
+  EXPECT_EQ(0u, (uintptr_t) second % POOL_ALIGN);
+  EXPECT_GE(second - first, 10);
+
+  EXPECT_TRUE(pool_alloc(&pool, size) == NULL);
+
+  pool_reset(&pool);
+  EXPECT_EQ(first, pool_alloc(&pool, size));
+  EXPECT_TRUE(pool_alloc(&pool, 1) == NULL);
+}
+
+/**
+ *  @brief pool_heap_count function test
+ *
+ *  Taking blocks from a pool must not allocate, creating a pool must
+ *
+ */
+TEST_F(pool_suite, pool_heap_count) {
+  uint64_t count = pool_heap_count();
+  uint64_t allocs = pool_test_heap_count();
+  for (int i = 0; i < 10; i++)
+    pool_alloc(&pool, 10);
+  pool_reset(&pool);
+  EXPECT_EQ(count, pool_heap_count());
+  EXPECT_EQ(allocs, pool_test_heap_count());
+
+  /* the wrappers see the allocations, else no test of them can fail */
+  struct pool other;
+  ASSERT_EQ(0, pool_init(&other, 10));
+  EXPECT_EQ(count+1, pool_heap_count());
+  EXPECT_EQ(allocs+1, pool_test_heap_count());
+  pool_destroy(&other);
+}
+
+/**
+ *  @brief pool_init_huge function test
+ *
+ *  The mapped pool behaves like the other one
+ *
+ */
+TEST_F(pool_suite, pool_init_huge) {
+  struct pool huge;
+  uint64_t count = pool_heap_count();
+  ASSERT_EQ(0, pool_init_huge(&huge, POOL_HUGE_PAGE + 1));
+  EXPECT_EQ(count+1, pool_heap_count());
+  EXPECT_EQ((size_t) 2*POOL_HUGE_PAGE, huge.size);
+
+  char *first = (char*) pool_alloc(&huge, 10);
+  ASSERT_TRUE(first != NULL);
+  EXPECT_EQ(0u, (uintptr_t) first % POOL_ALIGN);
+  memset(first, 1, 10);
+  EXPECT_TRUE(pool_alloc(&huge, 2*POOL_HUGE_PAGE) == NULL);
+
+  pool_destroy(&huge);
+  EXPECT_TRUE(huge.mem == NULL);
+  EXPECT_EQ(0u, huge.mapped);
+}
+
+/**
+ *  @brief Cost of the out_dim-sized stages depending on the placement
+ *
+ *  The spectrum is first touched by one thread or by all of them, in
+ *  normal or huge pages, then the stages after the reconstruction
+ *  (normalization, module, copy) are timed. Run it on a multi-socket
+ *  machine with OMP_PROC_BIND=spread to see the effect of the first
+ *  touch.
+ *
+ */
+TEST(pool_bench, out_stages) {
+  int dims[] = {1024, 2048};
+  const char *names[] = {"serial", "parallel", "huge"};
+
+  printf("%8s %10s %12s %12s %12s %12s\n", "out_dim", "placement",
+         "touch(us)", "div_dim(us)", "module(us)", "copy(us)");
+  for (int d = 0; d < 2; d++) {
+    int out_dim = dims[d];
+    size_t size = (size_t) out_dim*out_dim;
+    for (int placement = 0; placement < 3; placement++) {
+      struct pool pool;
+      size_t pool_size = 2*pool_round(size*sizeof(fftw_complex)) +
+        pool_round(size*sizeof(double));
+      ASSERT_EQ(0, placement == 2 ? pool_init_huge(&pool, pool_size) :
+                pool_init(&pool, pool_size));
+      fftw_complex *out = (fftw_complex*)
+        pool_alloc(&pool, size*sizeof(fftw_complex));
+      fftw_complex *copy = (fftw_complex*)
+        pool_alloc(&pool, size*sizeof(fftw_complex));
+      double *io = (double*) pool_alloc(&pool, size*sizeof(double));
+
+      uint64_t start = prof_now();
+      if (placement == 0) {
+        memset(out, 0, size*sizeof(fftw_complex));
+        memset(copy, 0, size*sizeof(fftw_complex));
+        memset(io, 0, size*sizeof(double));
+      } else {
+        matrix_init(out_dim, out, 0);
+        matrix_init(out_dim, copy, 0);
+        matrix_realpart(out_dim, out, io);
+      }
+      uint64_t touch = prof_now() - start;
+
+      start = prof_now();
+      div_dim(out, out, out_dim);
+      uint64_t div = prof_now() - start;
+      start = prof_now();
+      matrix_magnitude(out_dim, out, io);
+      uint64_t module = prof_now() - start;
+      start = prof_now();
+      matrix_copy(out, copy, out_dim);
+      uint64_t copied = prof_now() - start;
+
+      printf("%8d %10s %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64
+             "\n", out_dim, names[placement], touch/1000, div/1000,
+             module/1000, copied/1000);
+      pool_destroy(&pool);
+    }
+  }
+}
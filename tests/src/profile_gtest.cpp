@@ -0,0 +1,74 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Profile functions test file
+ *
+ */
+
+#include "include/profile.h"
+#include "gtest/gtest.h"
+
+/**
+ *  @brief profile.c file test suite
+ *
+ */
+class profile_suite : public ::testing::Test {
+ protected:
+  /**
+   *  @brief setup function for profile_suite tests
+   *
+   *  Clear the counters left by previous tests.
+   *
+   */
+  virtual void SetUp() {
+    prof_reset();
+  }
+
+  /**
+   *  @brief teardown function for profile_suite tests
+   *
+   */
+  virtual void TearDown() {
+    prof_reset();
+  }
+};
+
+/**
+ *  @brief prof_now function test
+ *
+ *  The timestamps must never go backward
+ *
+ */
+TEST_F(profile_suite, prof_now_monotonic) {
+  uint64_t first = prof_now();
+  uint64_t second = prof_now();
+  ASSERT_LE(first, second);
+}
+
+/**
+ *  @brief prof_add function test
+ *
+ *  Account some executions and check the counts and totals,
+ *  then check that prof_reset clears them
+ *
+ */
+TEST_F(profile_suite, prof_add) {
+  prof_add(PROF_EXTRACT, 10);
+  prof_add(PROF_EXTRACT, 32);
+  prof_add(PROF_LAP, 5);
+
+  EXPECT_EQ(2u, prof_count(PROF_EXTRACT));
+  EXPECT_EQ(42u, prof_total(PROF_EXTRACT));
+  EXPECT_EQ(1u, prof_count(PROF_LAP));
+  EXPECT_EQ(0u, prof_count(PROF_FORWARD));
+
+  /* out of range stages are ignored */
+  prof_add(PROF_STAGES, 1);
+  prof_add(-1, 1);
+  EXPECT_EQ(0u, prof_count(PROF_STAGES));
+
+  prof_reset();
+  EXPECT_EQ(0u, prof_count(PROF_EXTRACT));
+  EXPECT_EQ(0u, prof_total(PROF_EXTRACT));
+}
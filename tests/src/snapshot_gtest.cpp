@@ -0,0 +1,156 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Snapshot writer test file
+ *
+ */
+
+#include "include/snapshot.h"
+#include "gtest/gtest.h"
+
+/**
+ *  @brief snapshot.c file test suite
+ *
+ */
+class snapshot_suite : public ::testing::Test {
+ protected:
+  int out_dim; /**< The dimension of the spectrum */
+  int th_dim; /**< The dimension of a thumbnail */
+  int slot_nbr; /**< The number of slots of the ring */
+  struct pool pool; /**< The pool of the writer */
+  struct snapshot snap; /**< The writer */
+  fftw_complex *out; /**< A spectrum */
+  fftw_complex *freq; /**< A disk */
+
+  /**
+   *  @brief setup function for snapshot_suite tests
+   *
+   *  Allocate the pool and random matrices
+   *
+   */
+  virtual void SetUp() {
+    out_dim = 20;
+    th_dim = 10;
+    slot_nbr = 2;
+    ASSERT_EQ(0, pool_init(&pool,
+                           snapshot_pool_size(out_dim, th_dim, slot_nbr) +
+                           snapshot_pool_size(out_dim/2, 0, slot_nbr) +
+                           pool_round(out_dim*out_dim*sizeof(fftw_complex)) +
+                           pool_round(th_dim*th_dim*sizeof(fftw_complex))));
+    out = (fftw_complex*) pool_alloc(&pool,
+                                     out_dim*out_dim*sizeof(fftw_complex));
+    freq = (fftw_complex*) pool_alloc(&pool,
+                                      th_dim*th_dim*sizeof(fftw_complex));
+    matrix_random(out_dim, out, 100);
+    matrix_random(th_dim, freq, 100);
+  }
+
+  /**
+   *  @brief teardown function for snapshot_suite tests
+   *
+   */
+  virtual void TearDown() {
+    pool_destroy(&pool);
+  }
+};
+
+/**
+ *  @brief Decimation of the snapshots
+ *
+ *  With a snapshot every 2 leds and every 3 laps, 5 leds and 3 laps
+ *  give 3 snapshots, which must all be written once the writer
+ *  is destroyed
+ *
+ */
+TEST_F(snapshot_suite, decimation) {
+  ASSERT_EQ(0, snapshot_init(&snap, &pool, out_dim, th_dim, slot_nbr, 2, 3));
+  int dropped = 0;
+  for (int i = 0; i < 5; i++)
+    dropped += snapshot_led(&snap, out, freq);
+  for (int i = 0; i < 3; i++)
+    dropped += snapshot_lap(&snap, out);
+  snapshot_destroy(&snap);
+
+  EXPECT_EQ(dropped, snap.dropped);
+  EXPECT_EQ(3, snap.written + snap.dropped);
+  EXPECT_EQ(0, snap.count);
+}
+
+/**
+ *  @brief No snapshot is taken when the decimation is 0
+ *
+ */
+TEST_F(snapshot_suite, disabled) {
+  ASSERT_EQ(0, snapshot_init(&snap, &pool, out_dim, th_dim, slot_nbr, 0, 0));
+  for (int i = 0; i < 5; i++) {
+    snapshot_led(&snap, out, freq);
+    snapshot_lap(&snap, out);
+  }
+  snapshot_destroy(&snap);
+  EXPECT_EQ(0, snap.written + snap.dropped);
+}
+
+/**
+ *  @brief A preview is the image decimated, when the spectrum fits in it
+ *
+ *  Without frequency beyond the crop, the preview at out_dim/2 is one
+ *  pixel out of two of the image at out_dim. The tiff images are
+ *  compared, give or take one gray level.
+ *
+ */
+TEST_F(snapshot_suite, preview) {
+  int dim = out_dim/2;
+  for (int i = 0; i < out_dim; i++)
+    for (int j = 0; j < out_dim; j++) {
+      int x = i < out_dim/2 ? i : i-out_dim;
+      int y = j < out_dim/2 ? j : j-out_dim;
+      if (abs(x) >= dim/2 || abs(y) >= dim/2) {
+        (out[i*out_dim+j])[0] = 0;
+        (out[i*out_dim+j])[1] = 0;
+      }
+    }
+
+  ASSERT_EQ(0, snapshot_init(&snap, &pool, dim, 0, slot_nbr, 0, 0));
+  ASSERT_EQ(0, snapshot_preview(&snap));
+  EXPECT_EQ(1, snapshot_crop(&snap, out, dim-1));
+  ASSERT_EQ(0, snapshot_crop(&snap, out, out_dim));
+  snapshot_destroy(&snap);
+  EXPECT_EQ(1, snap.written);
+
+  fftw_complex *image = (fftw_complex*) fftw_malloc(out_dim*out_dim*
+                                                    sizeof(fftw_complex));
+  double *io = (double*) malloc(dim*dim*sizeof(double));
+  double *read = (double*) malloc(dim*dim*sizeof(double));
+  fftw_plan backward = fftw_plan_dft_2d(out_dim, out_dim, out, image,
+                                        FFTW_BACKWARD, FFTW_ESTIMATE);
+  fftw_execute(backward);
+  fftw_destroy_plan(backward);
+  for (int i = 0; i < dim; i++)
+    for (int j = 0; j < dim; j++) {
+      fftw_complex *pixel = &image[2*i*out_dim + 2*j];
+      io[i*dim+j] = sqrt((*pixel)[0]*(*pixel)[0] + (*pixel)[1]*(*pixel)[1]);
+    }
+  ASSERT_EQ(0, tiff_frommatrix("build/preview_ref.tiff", io, dim, dim));
+  ASSERT_EQ(0, tiff_tomatrix("build/preview_ref.tiff", io, dim, dim));
+  ASSERT_EQ(0, tiff_tomatrix("build/preview_0000.tiff", read, dim, dim));
+  for (int i = 0; i < dim*dim; i++)
+    EXPECT_NEAR(io[i], read[i], 1) << "pixel " << i;
+  remove("build/preview_ref.tiff");
+  remove("build/preview_0000.tiff");
+
+  free(read);
+  free(io);
+  fftw_free(image);
+}
+
+/**
+ *  @brief snapshot_init with a too small pool
+ *
+ */
+TEST_F(snapshot_suite, init_error) {
+  struct pool small;
+  ASSERT_EQ(0, pool_init(&small, 10));
+  EXPECT_EQ(1, snapshot_init(&snap, &small, out_dim, th_dim, slot_nbr, 1, 1));
+  pool_destroy(&small);
+}
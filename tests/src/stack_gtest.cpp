@@ -0,0 +1,188 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Thumbnail stack test file
+ *
+ */
+
+#include <unistd.h>
+#include <stddef.h>
+#include "include/stack.h"
+#include "gtest/gtest.h"
+
+/**
+ *  @brief stack.c file test suite
+ *
+ */
+class stack_suite : public ::testing::Test {
+ protected:
+  int jorga; /**< The number of leds from the center to a side */
+  int nbr; /**< The number of thumbnails */
+  int diml; /**< Number of lines of a thumbnail */
+  int dimw; /**< Number of columns of a thumbnail */
+  double **thumbnails; /**< The thumbnails */
+
+  /** Path of the stack */
+  const char *name = "build/stack_test.stack";
+
+  /**
+   *  @brief setup function for stack_suite tests
+   *
+   *  Create thumbnails whose values range from 0 to 255
+   *
+   */
+  virtual void SetUp() {
+    jorga = 1;
+    nbr = (2*jorga+1)*(2*jorga+1);
+    diml = 12;
+    dimw = 10;
+    thumbnails = (double**) malloc(nbr*sizeof(double*));
+    for (int i = 0; i < nbr; i++) {
+      thumbnails[i] = (double*) malloc(diml*dimw*sizeof(double));
+      for (int j = 0; j < diml*dimw; j++)
+        thumbnails[i][j] = (i*7+j*13) % 256;
+      thumbnails[i][0] = 0;
+      thumbnails[i][1] = 255;
+    }
+  }
+
+  /**
+   *  @brief teardown function for stack_suite tests
+   *
+   */
+  virtual void TearDown() {
+    for (int i = 0; i < nbr; i++)
+      free(thumbnails[i]);
+    free(thumbnails);
+    remove(name);
+  }
+
+  /**
+   *  @brief Check that a mapped stack holds the thumbnails
+   *
+   */
+  void check(struct stack *stack) {
+    ASSERT_EQ(diml, stack->header.diml);
+    ASSERT_EQ(dimw, stack->header.dimw);
+    ASSERT_EQ(jorga, stack->header.jorga);
+    ASSERT_EQ(nbr, stack->header.nbr);
+    for (int i = 0; i < nbr; i++) {
+      EXPECT_EQ(0u, (uintptr_t) stack->planes[i] % STACK_PLANE_ALIGN);
+      for (int j = 0; j < diml*dimw; j++)
+        ASSERT_DOUBLE_EQ(thumbnails[i][j], stack->planes[i][j]);
+    }
+    /* the center led is at the coordinates [0;0] */
+    EXPECT_EQ(0, stack->entries[nbr/2].x);
+    EXPECT_EQ(0, stack->entries[nbr/2].y);
+  }
+};
+
+/**
+ *  @brief stack_write and stack_map functions test
+ *
+ */
+TEST_F(stack_suite, write_map) {
+  struct stack stack;
+  ASSERT_EQ(0, stack_write(name, thumbnails, jorga, diml, dimw, 8));
+  ASSERT_EQ(0, stack_map(name, &stack));
+  check(&stack);
+  EXPECT_EQ(0u, (uintptr_t) stack.planes[0] % STACK_ALIGN);
+  stack_unmap(&stack);
+}
+
+/**
+ *  @brief stack_fromtiff function test
+ *
+ *  Write the thumbnails as tiff images, convert them in a stack
+ *  and compare
+ *
+ */
+TEST_F(stack_suite, fromtiff) {
+  char path[60];
+  for (int x = 0; x < 2*jorga+1; x++)
+    for (int y = 0; y < 2*jorga+1; y++)
+      ASSERT_EQ(0, tiff_frommatrix(tiff_getname(x, y, path),
+                                   thumbnails[x*(2*jorga+1)+y], diml, dimw));
+
+  struct stack stack;
+  ASSERT_EQ(0, stack_fromtiff("build", jorga, name));
+  ASSERT_EQ(0, stack_map(name, &stack));
+  check(&stack);
+  stack_unmap(&stack);
+}
+
+/**
+ *  @brief Write the stack of stack_suite then change one field of its header
+ *  @param[in] name The path of the stack
+ *  @param[in] thumbnails The 9 thumbnails of 12x10 of stack_suite
+ *  @param[in] offset The offset of the field in the header
+ *  @param[in] value The new value of the field
+ *  @param[in] size The size of the field
+ *
+ */
+static void stack_test_corrupt(const char *name, double **thumbnails,
+                               size_t offset, const void *value,
+                               size_t size) {
+  ASSERT_EQ(0, stack_write(name, thumbnails, 1, 12, 10, 8));
+  FILE *file = fopen(name, "r+b");
+  ASSERT_TRUE(file != NULL);
+  ASSERT_EQ(0, fseek(file, offset, SEEK_SET));
+  ASSERT_EQ(size, fwrite(value, 1, size, file));
+  fclose(file);
+}
+
+/**
+ *  @brief stack_map on invalid files
+ *
+ *  Including truncated files and headers whose sizes overflow
+ *
+ */
+TEST_F(stack_suite, invalid) {
+  struct stack stack;
+  EXPECT_EQ(1, stack_map("build/false.stack", &stack));
+
+  FILE *file = fopen(name, "w");
+  ASSERT_TRUE(file != NULL);
+  fprintf(file, "not a stack, not a stack, not a stack, not a stack");
+  fclose(file);
+  EXPECT_EQ(1, stack_map(name, &stack));
+
+  /* headers pointing outside the file */
+  uint64_t zero = 0;
+  uint64_t overlap = 8;
+  uint64_t past = 1ull << 40;
+  uint64_t huge = 1ull << 62;
+  int32_t jorga_big = 1073741823;
+  int32_t jorga_over = 1073741824;
+
+  stack_test_corrupt(name, thumbnails, offsetof(struct stack_header,
+                                                plane_size),
+                     &zero, sizeof(zero));
+  EXPECT_EQ(1, stack_map(name, &stack));
+  stack_test_corrupt(name, thumbnails, offsetof(struct stack_header,
+                                                plane_size),
+                     &huge, sizeof(huge));
+  EXPECT_EQ(1, stack_map(name, &stack));
+  stack_test_corrupt(name, thumbnails, offsetof(struct stack_header, data),
+                     &overlap, sizeof(overlap));
+  EXPECT_EQ(1, stack_map(name, &stack));
+  stack_test_corrupt(name, thumbnails, offsetof(struct stack_header, data),
+                     &past, sizeof(past));
+  EXPECT_EQ(1, stack_map(name, &stack));
+  stack_test_corrupt(name, thumbnails, offsetof(struct stack_header, jorga),
+                     &jorga_big, sizeof(jorga_big));
+  EXPECT_EQ(1, stack_map(name, &stack));
+  stack_test_corrupt(name, thumbnails, offsetof(struct stack_header, jorga),
+                     &jorga_over, sizeof(jorga_over));
+  EXPECT_EQ(1, stack_map(name, &stack));
+
+  /* the last plane is cut */
+  ASSERT_EQ(0, stack_write(name, thumbnails, jorga, diml, dimw, 8));
+  ASSERT_EQ(0, stack_map(name, &stack));
+  size_t length = stack.length;
+  stack_unmap(&stack);
+  ASSERT_EQ(0, truncate(name, length - sizeof(double)));
+  EXPECT_EQ(1, stack_map(name, &stack));
+}
+
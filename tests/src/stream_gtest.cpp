@@ -0,0 +1,248 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Frame pipeline test file
+ *
+ */
+
+#include "include/stream.h"
+#include "gtest/gtest.h"
+
+/**
+ *  @brief Synthetic frames: the thumbnails change a little at each frame
+ *  @param[in] arg Points to the number of frames available
+ *
+ */
+static int stream_test_load(void *arg, int frame, int th_dim,
+                            double **thumbnails) {
+  int frames = *(int*) arg;
+  if (frame >= frames)
+    return 1;
+  for (int i = 0; i < 9; i++)
+    for (int j = 0; j < th_dim*th_dim; j++)
+      thumbnails[i][j] = (i*31 + j*7 + frame*3) % 256;
+  return 0;
+}
+
+/**
+ *  @brief The frames of stream_test_cancel_load
+ *
+ */
+struct stream_test_cancel {
+  int frames; /**< The number of frames available */
+  int at; /**< The frame whose loading cancels the reconstruction */
+  struct swarm_ctx *ctx; /**< The context to cancel */
+};
+
+/**
+ *  @brief Synthetic frames, cancelling the reconstruction at one of them
+ *
+ */
+static int stream_test_cancel_load(void *arg, int frame, int th_dim,
+                                   double **thumbnails) {
+  struct stream_test_cancel *test = (struct stream_test_cancel*) arg;
+  if (frame == test->at)
+    swarm_cancel(test->ctx);
+  return stream_test_load(&test->frames, frame, th_dim, thumbnails);
+}
+
+/**
+ *  @brief stream.c file test suite
+ *
+ */
+class stream_suite : public ::testing::Test {
+ protected:
+  int out_dim; /**< The dimension of the images */
+  int th_dim; /**< The dimension of the thumbnails */
+  int radius; /**< The radius of the extracted disks */
+  int jorga; /**< The number of thumbnails from the center to a side */
+  int delta; /**< The distance in pixel between two thumbnails */
+  int lap_nbr; /**< The number of laps of each frame */
+
+  struct pool pool; /**< The pool of the context and of a few pipelines */
+  struct swarm_ctx ctx; /**< The context of the reconstructions */
+
+  /**
+   *  @brief setup function for stream_suite tests
+   *
+   */
+  virtual void SetUp() {
+    out_dim = 100;
+    th_dim = 30;
+    radius = 10;
+    jorga = 1;
+    delta = 15;
+    lap_nbr = 2;
+    ASSERT_EQ(0, pool_init(&pool,
+                           swarm_pool_size(th_dim, out_dim, radius) +
+                           3*stream_pool_size(th_dim, out_dim, jorga,
+                                              STREAM_SLOTS_MAX)));
+    ASSERT_EQ(0, swarm_init(&ctx, &pool, th_dim, out_dim, delta, radius,
+                            jorga));
+  }
+
+  /**
+   *  @brief teardown function for stream_suite tests
+   *
+   */
+  virtual void TearDown() {
+    swarm_destroy(&ctx);
+    pool_destroy(&pool);
+  }
+
+  /**
+   *  @brief Reconstruct the frames one after the other and compare
+   *  @param[in] frames The number of frames
+   *  @param[in] warm Non-zero if each frame starts from the previous one
+   *
+   *  The images written by the pipeline must be the ones of swarm.
+   *
+   */
+  void compare(int frames, int warm) {
+    double **thumbnails = (double**) malloc(9*sizeof(double*));
+    for (int i = 0; i < 9; i++)
+      thumbnails[i] = (double*) malloc(th_dim*th_dim*sizeof(double));
+    fftw_complex *ref = (fftw_complex*) fftw_malloc(out_dim*out_dim*
+                                                    sizeof(fftw_complex));
+    fftw_complex *image = (fftw_complex*) fftw_malloc(out_dim*out_dim*
+                                                      sizeof(fftw_complex));
+    double *io = (double*) malloc(out_dim*out_dim*sizeof(double));
+    double *read = (double*) malloc(out_dim*out_dim*sizeof(double));
+    fftw_plan backward = fftw_plan_dft_2d(out_dim, out_dim, ref, image,
+                                          FFTW_BACKWARD, FFTW_ESTIMATE);
+    char name[40];
+
+    matrix_init(out_dim, ref, 0);
+    for (int f = 0; f < frames; f++) {
+      ASSERT_EQ(0, stream_test_load(&frames, f, th_dim, thumbnails));
+      if (!warm)
+        matrix_init(out_dim, ref, 0);
+      ASSERT_EQ(0, swarm(thumbnails, th_dim, out_dim, delta, lap_nbr,
+                         radius, jorga, ref));
+      fftw_execute(backward);
+      div_dim(image, image, out_dim);
+      matrix_magnitude(out_dim, image, io);
+      ASSERT_EQ(0, tiff_frommatrix("build/stream_ref.tiff", io,
+                                   out_dim, out_dim));
+      ASSERT_EQ(0, tiff_tomatrix("build/stream_ref.tiff", io,
+                                 out_dim, out_dim));
+
+      snprintf(name, sizeof(name), "build/stream_%.2d.tiff", f);
+      ASSERT_EQ(0, tiff_tomatrix(name, read, out_dim, out_dim));
+      for (int i = 0; i < out_dim*out_dim; i++)
+        ASSERT_EQ(io[i], read[i]) << "frame " << f << " pixel " << i;
+      remove(name);
+    }
+    remove("build/stream_ref.tiff");
+
+    fftw_destroy_plan(backward);
+    for (int i = 0; i < 9; i++)
+      free(thumbnails[i]);
+    free(thumbnails);
+    free(read);
+    free(io);
+    fftw_free(image);
+    fftw_free(ref);
+  }
+};
+
+/**
+ *  @brief Every frame gives the image of swarm, whatever the depth
+ *
+ */
+TEST_F(stream_suite, frames) {
+  struct stream stream;
+  int frames = 5;
+  for (int slots = 1; slots <= 3; slots++) {
+    SCOPED_TRACE(slots);
+    ASSERT_EQ(0, stream_init(&stream, &pool, &ctx, slots, lap_nbr,
+                             stream_test_load, &frames,
+                             "build/stream_%.2d.tiff"));
+    ASSERT_EQ(0, stream_run(&stream, frames));
+    EXPECT_EQ(frames, stream.written);
+    EXPECT_GT(stream_fps(&stream), 0);
+    stream_destroy(&stream);
+    compare(frames, 0);
+  }
+}
+
+/**
+ *  @brief Each frame starts from the spectrum of the previous one
+ *
+ *  Even when the slot of the previous frame was loaded again.
+ *
+ */
+TEST_F(stream_suite, warm) {
+  struct stream stream;
+  int frames = 5;
+  for (int slots = 1; slots <= 3; slots++) {
+    SCOPED_TRACE(slots);
+    ASSERT_EQ(0, stream_init(&stream, &pool, &ctx, slots, lap_nbr,
+                             stream_test_load, &frames,
+                             "build/stream_%.2d.tiff"));
+    stream.warm = 1;
+    ASSERT_EQ(0, stream_run(&stream, frames));
+    EXPECT_EQ(frames, stream.written);
+    stream_destroy(&stream);
+    compare(frames, 1);
+  }
+}
+
+/**
+ *  @brief The end of the stream, expected or not
+ *
+ */
+TEST_F(stream_suite, end) {
+  struct stream stream;
+  int frames = 3;
+  ASSERT_EQ(0, stream_init(&stream, &pool, &ctx, 2, 1, stream_test_load,
+                           &frames, "build/stream_%.2d.tiff"));
+  EXPECT_EQ(0, stream_run(&stream, 0));
+  EXPECT_EQ(3, stream.written);
+  EXPECT_EQ(1, stream_run(&stream, 5));
+  EXPECT_EQ(3, stream.written);
+  stream_report(&stream, stdout);
+  stream_destroy(&stream);
+  for (int f = 0; f < frames; f++) {
+    char name[40];
+    snprintf(name, sizeof(name), "build/stream_%.2d.tiff", f);
+    remove(name);
+  }
+
+  EXPECT_EQ(1, stream_init(&stream, &pool, &ctx, 0, 1, stream_test_load,
+                           &frames, "build/stream_%.2d.tiff"));
+  EXPECT_EQ(1, stream_init(&stream, &pool, &ctx, STREAM_SLOTS_MAX+1, 1,
+                           stream_test_load, &frames,
+                           "build/stream_%.2d.tiff"));
+}
+
+/**
+ *  @brief A cancelled reconstruction stops the pipeline
+ *
+ */
+TEST_F(stream_suite, cancel) {
+  struct stream stream;
+  struct stream_test_cancel test = {20, 2, &ctx};
+  ASSERT_EQ(0, stream_init(&stream, &pool, &ctx, 2, lap_nbr,
+                           stream_test_cancel_load, &test,
+                           "build/stream_%.2d.tiff"));
+  EXPECT_EQ(2, stream_run(&stream, 0));
+  EXPECT_EQ(1, stream.cancelled);
+  /* the frame cancelled is written, and none loaded after it */
+  EXPECT_GE(stream.written, 1);
+  EXPECT_LE(stream.written, test.at+1);
+
+  /* the next run starts again */
+  test.at = -1;
+  test.frames = 3;
+  EXPECT_EQ(0, stream_run(&stream, 0));
+  EXPECT_EQ(0, stream.cancelled);
+  EXPECT_EQ(3, stream.written);
+  stream_destroy(&stream);
+  for (int f = 0; f < 20; f++) {
+    char name[40];
+    snprintf(name, sizeof(name), "build/stream_%.2d.tiff", f);
+    remove(name);
+  }
+}
@@ -7,6 +7,7 @@
  */
 
 #include "include/swarm.h"
+#include "include/trace.h"
 #include <tuple>
 #include "gtest/gtest.h"
 
@@ -367,3 +368,339 @@ INSTANTIATE_TEST_CASE_P(full, swarm_unit,
                                            ::testing::Values(30, 35, 40,
                                                              45, 50),
                                            ::testing::Values(2, 5, 10)));
+
+/**
+ *  @brief For tests on a swarm context with synthetic thumbnails
+ *
+ */
+class swarm_ctx_units : public ::testing::Test {
+ protected:
+  int out_dim; /**< The dimension of the output */
+  int th_dim; /**< The dimension of the thumbnails */
+  int radius; /**< The radius of the extracted disks */
+  int jorga; /**< The number of thumbnails from the center to a side */
+  int delta; /**< The distance in pixel between two thumbnails */
+
+  struct pool pool; /**< The pool in which everything is allocated */
+  struct swarm_ctx ctx; /**< The context of the reconstruction */
+  fftw_complex *out; /**< The spectrum being retrieved */
+  double **thumbnails; /**< The random thumbnails */
+
+  virtual void SetUp() {
+    out_dim = 200;
+    th_dim = 50;
+    radius = 15;
+    jorga = 2;
+    delta = 20;
+
+    int nbr = (2*jorga+1)*(2*jorga+1);
+    ASSERT_EQ(0, pool_init(&pool,
+                           pool_round(out_dim*out_dim*sizeof(fftw_complex)) +
+                           pool_round(nbr*sizeof(double*)) +
+                           nbr*pool_round(th_dim*th_dim*sizeof(double)) +
+                           swarm_pool_size(th_dim, out_dim, radius)));
+    out = (fftw_complex*) pool_alloc(&pool,
+                                     out_dim*out_dim*sizeof(fftw_complex));
+    thumbnails = (double**) pool_alloc(&pool, nbr*sizeof(double*));
+    for (int i = 0; i < nbr; i++) {
+      thumbnails[i] = (double*) pool_alloc(&pool,
+                                           th_dim*th_dim*sizeof(double));
+      for (int j = 0; j < th_dim*th_dim; j++)
+        thumbnails[i][j] = rand() % 256;  /* NOLINT(runtime/threadsafe_fn) */
+    }
+    matrix_init(out_dim, out, 0);
+
+    ASSERT_EQ(0, swarm_init(&ctx, &pool, th_dim, out_dim,
+                            delta, radius, jorga));
+  }
+
+  virtual void TearDown() {
+    swarm_destroy(&ctx);
+    pool_destroy(&pool);
+  }
+};
+
+/**
+ *  @brief Get the number of heap allocations of the code under test
+ *
+ *  Defined in pool_gtest.cpp.
+ *
+ */
+uint64_t pool_test_heap_count(void);
+
+/**
+ *  @brief Steady state without allocation
+ *
+ *  Once the context is set up, swarm_run must not allocate anything
+ *  on the heap, not even to record its trace
+ *
+ */
+TEST_F(swarm_ctx_units, no_allocation) {
+  ASSERT_EQ(0, trace_start(16, omp_get_max_threads()));
+  uint64_t count = pool_test_heap_count();
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 2, out));
+  EXPECT_EQ(count, pool_test_heap_count());
+  EXPECT_LT(0u, trace_count());
+  trace_free();
+}
+
+/**
+ *  @brief swarm_init with a too small pool or too big parameters
+ *
+ */
+TEST_F(swarm_ctx_units, init_errors) {
+  struct swarm_ctx other;
+  struct pool small;
+  ASSERT_EQ(0, pool_init(&small, 10));
+  EXPECT_EQ(1, swarm_init(&other, &small, th_dim, out_dim,
+                          delta, radius, jorga));
+  pool_destroy(&small);
+
+  EXPECT_EQ(1, swarm_init(&other, &pool, th_dim, out_dim,
+                          out_dim, radius, jorga));
+}
+
+/**
+ *  @brief swarm_replan gives the same reconstruction
+ *
+ */
+TEST_F(swarm_ctx_units, replan) {
+  fftw_complex *ref = (fftw_complex*) fftw_malloc(out_dim*out_dim*
+                                                  sizeof(fftw_complex));
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 2, out));
+  matrix_copy(out, ref, out_dim);
+
+  unsigned flags[2] = {FFTW_ESTIMATE, FFTW_MEASURE};
+  for (int f = 0; f < 2; f++) {
+    fftw_plan_with_nthreads(1);
+    ASSERT_EQ(0, swarm_replan(&ctx, flags[f]));
+    matrix_init(out_dim, out, 0);
+    ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 2, out));
+    for (int i = 0; i < out_dim*out_dim; i++) {
+      ASSERT_NEAR((ref[i])[0], (out[i])[0], 1e-6*(1+fabs((ref[i])[0])));
+      ASSERT_NEAR((ref[i])[1], (out[i])[1], 1e-6*(1+fabs((ref[i])[1])));
+    }
+  }
+  fftw_free(ref);
+}
+
+/**
+ *  @brief swarm_channels gives the image of swarm for each channel
+ *
+ *  The first two channels share their plans, the third one has
+ *  smaller thumbnails cropped from the same ones.
+ *
+ */
+TEST_F(swarm_ctx_units, channels) {
+  const int nbr = 3;
+  const int small_dim = 40;
+  int side = 2*jorga+1;
+  struct swarm_channel channels[nbr];
+  fftw_complex *ref = (fftw_complex*) fftw_malloc(out_dim*out_dim*
+                                                  sizeof(fftw_complex));
+  double **small = (double**) malloc(side*side*sizeof(double*));
+  for (int i = 0; i < side*side; i++) {
+    small[i] = (double*) malloc(small_dim*small_dim*sizeof(double));
+    for (int x = 0; x < small_dim; x++)
+      for (int y = 0; y < small_dim; y++)
+        small[i][x*small_dim+y] = thumbnails[i][x*th_dim+y];
+  }
+
+  for (int c = 0; c < nbr; c++) {
+    channels[c].thumbnails = (c == 2) ? small : thumbnails;
+    channels[c].th_dim = (c == 2) ? small_dim : th_dim;
+    channels[c].delta = delta - 2*c;
+    channels[c].radius = radius - c;
+    channels[c].out = (fftw_complex*) fftw_malloc(out_dim*out_dim*
+                                                  sizeof(fftw_complex));
+    matrix_init(out_dim, channels[c].out, 0);
+  }
+  ASSERT_EQ(0, swarm_channels(channels, nbr, out_dim, 2, jorga));
+
+  for (int c = 0; c < nbr; c++) {
+    EXPECT_EQ(0, channels[c].error);
+    matrix_init(out_dim, ref, 0);
+    ASSERT_EQ(0, swarm(channels[c].thumbnails, channels[c].th_dim, out_dim,
+                       channels[c].delta, 2, channels[c].radius, jorga, ref));
+    for (int i = 0; i < out_dim*out_dim; i++) {
+      ASSERT_EQ((ref[i])[0], (channels[c].out[i])[0]);
+      ASSERT_EQ((ref[i])[1], (channels[c].out[i])[1]);
+    }
+  }
+
+  /* a failed channel does not stop the others */
+  channels[1].radius = th_dim;
+  EXPECT_EQ(2, swarm_channels(channels, nbr, out_dim, 1, jorga));
+  EXPECT_EQ(0, channels[0].error);
+  EXPECT_EQ(2, channels[1].error);
+  EXPECT_EQ(0, channels[2].error);
+  for (int c = 0; c < nbr; c++)
+    fftw_free(channels[c].out);
+
+  EXPECT_EQ(1, swarm_channels(channels, 0, out_dim, 2, jorga));
+  channels[0].delta = out_dim;
+  EXPECT_EQ(1, swarm_channels(channels, 1, out_dim, 2, jorga));
+
+  for (int i = 0; i < side*side; i++)
+    free(small[i]);
+  free(small);
+  fftw_free(ref);
+}
+
+/**
+ *  @brief A warm start from a previous result converges in fewer laps
+ *
+ *  The residual of a lap decreases with the laps, the previous result
+ *  goes through a checkpoint as between two frames.
+ *
+ */
+TEST_F(swarm_ctx_units, warm_start) {
+  const char *name = "build/swarm_warm_test.ckpt";
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 2, out));
+  EXPECT_EQ(2, ctx.laps);
+  EXPECT_EQ(-1, ctx.residual);
+
+  /* the cold start */
+  matrix_init(out_dim, out, 0);
+  ctx.tolerance = 1e-12;
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 3, out));
+  EXPECT_EQ(3, ctx.laps);
+  double tolerance = ctx.residual*1.001;
+
+  matrix_init(out_dim, out, 0);
+  ctx.tolerance = tolerance;
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 20, out));
+  int cold = ctx.laps;
+  EXPECT_EQ(3, cold);
+  EXPECT_LT(ctx.residual, tolerance);
+  ctx.checkpoint = name;
+  ASSERT_EQ(0, swarm_checkpoint(&ctx, out, cold));
+  ctx.checkpoint = NULL;
+
+  /* the next frame starts from the result of the previous one */
+  matrix_init(out_dim, out, 0);
+  ASSERT_EQ(0, swarm_warm(&ctx, name, out));
+  EXPECT_EQ(0, ctx.first_lap);
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 20, out));
+  EXPECT_LT(ctx.laps, cold);
+  EXPECT_LT(ctx.residual, tolerance);
+
+  int laps = 0;
+  matrix_init(out_dim, out, 0);
+  ASSERT_EQ(0, swarm_until(thumbnails, th_dim, out_dim, delta, 20, radius,
+                           jorga, tolerance, &laps, out));
+  EXPECT_EQ(cold, laps);
+
+  EXPECT_EQ(1, swarm_warm(&ctx, "build/false.ckpt", out));
+  remove(name);
+}
+
+/**
+ *  @brief A disk which cannot be copied stops the laps with its error
+ *
+ */
+TEST_F(swarm_ctx_units, led_error) {
+  ctx.radius = th_dim;
+  EXPECT_EQ(2, swarm_run(&ctx, thumbnails, 3, out));
+  EXPECT_EQ(0, ctx.laps);
+}
+
+/**
+ *  @brief A clock where each led update takes 1 ms
+ *
+ */
+static uint64_t swarm_test_clock(struct swarm_ctx *ctx) {
+  return (uint64_t) ctx->leds*1000000;
+}
+
+/**
+ *  @brief The laps stop at the budget, cut or not started
+ *
+ *  On swarm_test_clock, a budget of one lap and a half ends after the
+ *  first lap, since the second one is not expected to fit, and a budget
+ *  of 10 leds cuts the first lap after 10 leds.
+ *
+ */
+TEST_F(swarm_ctx_units, budget) {
+  int nbr = (2*jorga+1)*(2*jorga+1);
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 2, out));
+  EXPECT_EQ(2, ctx.laps);
+  EXPECT_EQ(2*nbr, ctx.leds);
+  EXPECT_EQ(0, ctx.expired);
+  ASSERT_GT(ctx.led_ms, 0);
+
+  ctx.clock = swarm_test_clock;
+  ctx.led_ms = 0;
+  ctx.budget_ms = 1.5*nbr;
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 5, out));
+  EXPECT_EQ(1, ctx.expired);
+  EXPECT_EQ(1, ctx.laps);
+  EXPECT_EQ(nbr, ctx.leds);
+  EXPECT_EQ(1, ctx.led_ms);
+
+  ASSERT_LT(10, nbr);
+  ctx.budget_ms = 10;
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 5, out));
+  EXPECT_EQ(1, ctx.expired);
+  EXPECT_EQ(0, ctx.laps);
+  EXPECT_EQ(10, ctx.leds);
+  EXPECT_EQ(0, ctx.missing);
+  ctx.clock = NULL;
+
+  ctx.budget_ms = 1e9;
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 2, out));
+  EXPECT_EQ(2, ctx.laps);
+  EXPECT_EQ(2*nbr, ctx.leds);
+  EXPECT_EQ(0, ctx.expired);
+
+  int laps = -1, leds = -1;
+  ASSERT_EQ(0, swarm_within(thumbnails, th_dim, out_dim, delta, 5, radius,
+                            jorga, 1e-6, &laps, &leds, out));
+  EXPECT_EQ(0, laps);
+  EXPECT_EQ(1, leds);
+}
+
+/**
+ *  @brief Cancel a reconstruction once its progress shows the second lap
+ *
+ */
+static void *swarm_test_cancel(void *arg) {
+  struct swarm_ctx *ctx = (struct swarm_ctx*) arg;
+  struct swarm_progress progress;
+  do {
+    swarm_poll(ctx, &progress);
+  } while (progress.lap < 1 || progress.led < 3);
+  swarm_cancel(ctx);
+  return NULL;
+}
+
+/**
+ *  @brief Progress and cancellation from another thread
+ *
+ */
+TEST_F(swarm_ctx_units, cancel) {
+  int nbr = (2*jorga+1)*(2*jorga+1);
+  pthread_t thread;
+  struct swarm_progress progress;
+
+  ctx.tolerance = 1e-12;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, swarm_test_cancel, &ctx));
+  EXPECT_EQ(5, swarm_run(&ctx, thumbnails, 100, out));
+  pthread_join(thread, NULL);
+  swarm_poll(&ctx, &progress);
+  EXPECT_EQ(1, ctx.laps);
+  EXPECT_EQ(1, progress.lap);
+  EXPECT_GE(progress.led, 3);
+  EXPECT_LT(progress.led, nbr);
+  EXPECT_EQ(nbr + progress.led, ctx.leds);
+  EXPECT_EQ(ctx.residual, progress.residual);
+  EXPECT_GT(progress.residual, 0);
+
+  /* the cancel is consumed by the run, or stops the next one at once */
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 1, out));
+  EXPECT_EQ(1, ctx.laps);
+  swarm_cancel(&ctx);
+  EXPECT_EQ(5, swarm_run(&ctx, thumbnails, 1, out));
+  EXPECT_EQ(0, ctx.leds);
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 1, out));
+}
@@ -135,3 +135,22 @@ TEST_F(existing_input_units, tiff_frommatrix) {
 
   tiff_frommatrix(output, matrix, diml, dimw);
 }
+
+/**
+ *  @brief tiff_quantize function test
+ *
+ *  Whatever variant runs, each sample is the one of tiff_fullscale.
+ *
+ */
+TEST_F(tiffio_suite, tiff_quantize) {
+  double line[67];
+  unsigned char data[67];
+  for (int i = 0; i < 67; i++)
+    line[i] = -3.25 + 0.37*i;
+
+  tiff_quantize(-3.25, -3.25 + 0.37*66, line, data, 67);
+  for (int i = 0; i < 67; i++)
+    ASSERT_EQ((unsigned char) tiff_fullscale(-3.25, -3.25 + 0.37*66, line[i]),
+              data[i]);
+  EXPECT_EQ(0, data[0]);
+}
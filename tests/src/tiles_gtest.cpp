@@ -0,0 +1,404 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Tiled spectrum functions test file
+ *
+ */
+
+#include "include/swarm.h"
+#include "include/profile.h"
+#include "gtest/gtest.h"
+
+/**
+ *  @brief tiles.c file test suite
+ *
+ */
+class tiles_suite : public ::testing::Test {
+ protected:
+  int out_dim; /**< The dimension of the spectrum */
+  int th_dim; /**< The dimension of the thumbnails */
+  int radius; /**< The radius of the extracted disks */
+  int jorga; /**< The number of thumbnails from the center to a side */
+  int delta; /**< The distance in pixel between two thumbnails */
+  int side; /**< The side of a tile, not dividing out_dim */
+  int resident; /**< Few resident tiles to force evictions */
+
+  /** Path of the backing file */
+  const char *name = "build/tiles_test.bin";
+
+  struct pool pool; /**< The pool in which everything is allocated */
+  struct tiles tiles; /**< The tiled spectrum */
+  fftw_complex *out; /**< A spectrum in memory */
+  fftw_complex *copy; /**< Another spectrum in memory */
+  fftw_complex *small; /**< A th_dim*th_dim matrix */
+  double **thumbnails; /**< Random thumbnails */
+
+  /**
+   *  @brief setup function for tiles_suite tests
+   *
+   *  Create the tiles, a random spectrum and random thumbnails
+   *
+   */
+  virtual void SetUp() {
+    out_dim = 100;
+    th_dim = 30;
+    radius = 10;
+    jorga = 1;
+    delta = 15;
+    side = 16;
+    resident = 4;
+
+    int nbr = (2*jorga+1)*(2*jorga+1);
+    ASSERT_EQ(0, pool_init(&pool,
+                           tiles_pool_size(out_dim, side, resident) +
+                           2*pool_round(out_dim*out_dim*sizeof(fftw_complex)) +
+                           pool_round(th_dim*th_dim*sizeof(fftw_complex)) +
+                           pool_round(nbr*sizeof(double*)) +
+                           nbr*pool_round(th_dim*th_dim*sizeof(double)) +
+                           swarm_pool_size(th_dim, out_dim, radius)));
+    ASSERT_EQ(0, tiles_open(&tiles, &pool, name, out_dim, side, resident));
+    out = (fftw_complex*) pool_alloc(&pool,
+                                     out_dim*out_dim*sizeof(fftw_complex));
+    copy = (fftw_complex*) pool_alloc(&pool,
+                                      out_dim*out_dim*sizeof(fftw_complex));
+    small = (fftw_complex*) pool_alloc(&pool,
+                                       th_dim*th_dim*sizeof(fftw_complex));
+    thumbnails = (double**) pool_alloc(&pool, nbr*sizeof(double*));
+    for (int i = 0; i < nbr; i++) {
+      thumbnails[i] = (double*) pool_alloc(&pool,
+                                           th_dim*th_dim*sizeof(double));
+      for (int j = 0; j < th_dim*th_dim; j++)
+        thumbnails[i][j] = rand() % 256;  /* NOLINT(runtime/threadsafe_fn) */
+    }
+    matrix_random(out_dim, out, 100);
+    ASSERT_EQ(0, tiles_write_rows(&tiles, 0, out_dim, out));
+  }
+
+  /**
+   *  @brief teardown function for tiles_suite tests
+   *
+   */
+  virtual void TearDown() {
+    tiles_close(&tiles);
+    remove(name);
+    pool_destroy(&pool);
+  }
+
+  /**
+   *  @brief Check that the tiles hold the spectrum expected
+   *
+   */
+  void expect_tiles(fftw_complex *expected) {
+    ASSERT_EQ(0, tiles_read_rows(&tiles, 0, out_dim, copy));
+    for (int i = 0; i < out_dim*out_dim; i++) {
+      EXPECT_EQ(expected[i][0], copy[i][0]);
+      EXPECT_EQ(expected[i][1], copy[i][1]);
+    }
+  }
+};
+
+/**
+ *  @brief tiles_write_rows and tiles_read_rows functions test
+ *
+ *  The spectrum written must be read back after evictions and
+ *  after being flushed
+ *
+ */
+TEST_F(tiles_suite, rows) {
+  expect_tiles(out);
+  EXPECT_GT(tiles.stores, (uint64_t) 0);
+  EXPECT_GT(tiles.loads, (uint64_t) 0);
+
+  ASSERT_EQ(0, tiles_flush(&tiles));
+  expect_tiles(out);
+}
+
+/**
+ *  @brief Whole lines get each tile once, though a row of tiles does
+ *         not fit in the cache
+ *
+ */
+TEST_F(tiles_suite, rows_loads) {
+  int nbr = tiles.nbr;
+  ASSERT_GT(nbr, resident);
+
+  uint64_t loads = tiles.loads;
+  ASSERT_EQ(0, tiles_read_rows(&tiles, 2*side, side, copy));
+  EXPECT_EQ((uint64_t) nbr, tiles.loads - loads);
+
+  /* a band across two rows of tiles */
+  loads = tiles.loads;
+  ASSERT_EQ(0, tiles_read_rows(&tiles, side/2, side, copy));
+  EXPECT_EQ((uint64_t) 2*nbr, tiles.loads - loads);
+
+  loads = tiles.loads;
+  uint64_t stores = tiles.stores;
+  ASSERT_EQ(0, tiles_write_rows(&tiles, 0, out_dim, out));
+  EXPECT_LE(tiles.loads - loads, (uint64_t) nbr*nbr);
+  EXPECT_LE(tiles.stores - stores, (uint64_t) nbr*nbr);
+  expect_tiles(out);
+}
+
+/**
+ *  @brief tiles_copy_disk function test
+ *
+ *  Compare with copy_disk_ultimate, for disks folded on the sides
+ *  of both matrices
+ *
+ */
+TEST_F(tiles_suite, copy_disk) {
+  int centers[][2] = {{0, 0}, {50, 37}, {95, 3}, {17, 99}};
+
+  for (int c = 0; c < 4; c++) {
+    int x = centers[c][0];
+    int y = centers[c][1];
+
+    /* extraction */
+    matrix_init(th_dim, small, 0);
+    ASSERT_EQ(0, tiles_copy_disk(&tiles, small, th_dim, x, y, radius, 0));
+    matrix_init(out_dim, copy, 0);
+    ASSERT_EQ(0, copy_disk_ultimate(out, copy, out_dim, th_dim,
+                                    x, y, 0, 0, radius));
+    for (int i = 0; i < th_dim*th_dim; i++) {
+      EXPECT_EQ(copy[i][0], small[i][0]);
+      EXPECT_EQ(copy[i][1], small[i][1]);
+    }
+
+    /* write back */
+    matrix_random(th_dim, small, 100);
+    ASSERT_EQ(0, tiles_copy_disk(&tiles, small, th_dim, x, y, radius, 1));
+    ASSERT_EQ(0, copy_disk_ultimate(small, out, th_dim, out_dim,
+                                    0, 0, x, y, radius));
+    expect_tiles(out);
+  }
+
+  EXPECT_EQ(1, tiles_copy_disk(&tiles, small, th_dim, 0, 0, th_dim, 0));
+  EXPECT_EQ(1, tiles_copy_disk(&tiles, small, th_dim, 0, 0, 0, 0));
+}
+
+/**
+ *  @brief swarm_run function test with tiles
+ *
+ *  The spectrum retrieved in tiles must be the one retrieved in memory
+ *
+ */
+TEST_F(tiles_suite, swarm_run) {
+  struct swarm_ctx ctx;
+
+  ASSERT_EQ(0, swarm_init(&ctx, &pool, th_dim, out_dim, delta, radius, jorga));
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 2, out));
+
+  ctx.tiles = &tiles;
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 2, NULL));
+  swarm_destroy(&ctx);
+
+  expect_tiles(out);
+}
+
+/**
+ *  @brief tiles_fft function test
+ *
+ *  Compare with a transform of the whole spectrum in memory
+ *
+ */
+TEST_F(tiles_suite, fft) {
+  fftw_plan backward = fftw_plan_dft_2d(out_dim, out_dim, out, out,
+                                        FFTW_BACKWARD, FFTW_ESTIMATE);
+  fftw_execute(backward);
+  fftw_destroy_plan(backward);
+  div_dim(out, out, out_dim);
+
+  ASSERT_EQ(0, tiles_fft(&tiles, FFTW_BACKWARD));
+  ASSERT_EQ(0, tiles_read_rows(&tiles, 0, out_dim, copy));
+  for (int i = 0; i < out_dim*out_dim; i++) {
+    EXPECT_NEAR(out[i][0], copy[i][0], 1e-9);
+    EXPECT_NEAR(out[i][1], copy[i][1], 1e-9);
+  }
+}
+
+/**
+ *  @brief tiles_tiff function test
+ *
+ */
+TEST_F(tiles_suite, tiff) {
+  const char *image = "build/tiles_test.tiff";
+  uint32 diml, dimw;
+
+  uint64_t loads = tiles.loads;
+  ASSERT_EQ(0, tiles_tiff(&tiles, image));
+  EXPECT_LE(tiles.loads - loads, (uint64_t) 2*tiles.nbr*tiles.nbr);
+  ASSERT_EQ(0, tiff_getsize(image, &diml, &dimw));
+  EXPECT_EQ((uint32) out_dim, diml);
+  EXPECT_EQ((uint32) out_dim, dimw);
+
+  /* the same image as the modulus of the spectrum in memory */
+  const char *ref = "build/tiles_test_ref.tiff";
+  double *io = (double*) malloc(out_dim*out_dim*sizeof(double));
+  double *read = (double*) malloc(out_dim*out_dim*sizeof(double));
+  matrix_magnitude(out_dim, out, io);
+  ASSERT_EQ(0, tiff_frommatrix(ref, io, out_dim, out_dim));
+  ASSERT_EQ(0, tiff_tomatrix(ref, io, out_dim, out_dim));
+  ASSERT_EQ(0, tiff_tomatrix(image, read, out_dim, out_dim));
+  for (int i = 0; i < out_dim*out_dim; i++)
+    ASSERT_EQ(io[i], read[i]) << "pixel " << i;
+  free(read);
+  free(io);
+  remove(ref);
+  remove(image);
+}
+
+/**
+ *  @brief tiles_open function test with invalid parameters
+ *
+ */
+TEST_F(tiles_suite, invalid) {
+  struct tiles other;
+
+  EXPECT_EQ(1, tiles_open(&other, &pool, "build/tiles_other.bin",
+                          out_dim, 1, resident));
+  EXPECT_EQ(1, tiles_open(&other, &pool, "build/tiles_other.bin",
+                          out_dim, side, 0));
+  EXPECT_EQ(1, tiles_open(&other, &pool, "no_such_dir/tiles.bin",
+                          out_dim, side, resident));
+}
+
+/**
+ *  @brief tiles_sparse function test
+ *
+ *  The spectrum retrieved in sparse tiles must be the one retrieved in
+ *  memory, with only the tiles under the disks allocated
+ *
+ */
+TEST_F(tiles_suite, sparse) {
+  struct pool sparse_pool;
+  struct tiles sparse;
+  struct swarm_ctx ctx;
+
+  int nbr = tiles_sparse_count(out_dim, side, delta, radius, jorga);
+  ASSERT_GT(nbr, 0);
+  EXPECT_LT(nbr, tiles.nbr*tiles.nbr);
+  ASSERT_EQ(0, pool_init(&sparse_pool,
+                         tiles_sparse_pool_size(out_dim, side, nbr)));
+  ASSERT_EQ(0, tiles_sparse(&sparse, &sparse_pool, out_dim, side, nbr));
+
+  matrix_init(out_dim, out, 0);
+  ASSERT_EQ(0, swarm_init(&ctx, &pool, th_dim, out_dim, delta, radius, jorga));
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 2, out));
+
+  ctx.tiles = &sparse;
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 2, NULL));
+  swarm_destroy(&ctx);
+  EXPECT_EQ(nbr, sparse.resident);
+
+  ASSERT_EQ(0, tiles_densify(&sparse, copy));
+  for (int i = 0; i < out_dim*out_dim; i++) {
+    EXPECT_EQ(out[i][0], copy[i][0]);
+    EXPECT_EQ(out[i][1], copy[i][1]);
+  }
+
+  /* the tile in the middle is far from every disk */
+  int middle = (sparse.nbr/2)*sparse.nbr + sparse.nbr/2;
+  EXPECT_EQ(sparse.zero, tiles_get(&sparse, middle, 0));
+  EXPECT_EQ(NULL, tiles_get(&sparse, middle, 1));
+  EXPECT_EQ(1, tiles_fft(&sparse, FFTW_BACKWARD));
+
+  tiles_close(&sparse);
+  pool_destroy(&sparse_pool);
+}
+
+/**
+ *  @brief tiles_blocked function test
+ *
+ *  The conversions must keep the spectrum and the spectrum retrieved
+ *  in blocked tiles must be the one retrieved in memory
+ *
+ */
+TEST_F(tiles_suite, blocked) {
+  struct pool blocked_pool;
+  struct tiles blocked;
+  struct swarm_ctx ctx;
+
+  ASSERT_EQ(0, pool_init(&blocked_pool,
+                         tiles_blocked_pool_size(out_dim, side)));
+  ASSERT_EQ(0, tiles_blocked(&blocked, &blocked_pool, out_dim, side));
+
+  ASSERT_EQ(0, tiles_from_matrix(&blocked, out));
+  ASSERT_EQ(0, tiles_densify(&blocked, copy));
+  for (int i = 0; i < out_dim*out_dim; i++) {
+    EXPECT_EQ(out[i][0], copy[i][0]);
+    EXPECT_EQ(out[i][1], copy[i][1]);
+  }
+
+  ASSERT_EQ(0, swarm_init(&ctx, &pool, th_dim, out_dim, delta, radius, jorga));
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 2, out));
+
+  ctx.tiles = &blocked;
+  ASSERT_EQ(0, swarm_run(&ctx, thumbnails, 2, NULL));
+  swarm_destroy(&ctx);
+
+  ASSERT_EQ(0, tiles_densify(&blocked, copy));
+  for (int i = 0; i < out_dim*out_dim; i++) {
+    EXPECT_EQ(out[i][0], copy[i][0]);
+    EXPECT_EQ(out[i][1], copy[i][1]);
+  }
+
+  tiles_close(&blocked);
+  pool_destroy(&blocked_pool);
+}
+
+/**
+ *  @brief Cost of update_led against out_dim, row-major and blocked
+ *
+ *  The leds are spread over the whole spectrum so that the caches do
+ *  not hide the distance between the lines of a disk.
+ *
+ */
+TEST(tiles_bench, update_led) {
+  int th_dim = 64;
+  int radius = 20;
+  int led_nbr = 50;
+  int dims[] = {256, 1024, 2048};
+
+  printf("%8s %14s %14s\n", "out_dim", "row-major(ns)", "blocked(ns)");
+  for (int d = 0; d < 3; d++) {
+    int out_dim = dims[d];
+    struct pool pool;
+    struct swarm_ctx ctx;
+    struct tiles blocked;
+
+    ASSERT_EQ(0, pool_init(&pool,
+                           pool_round((size_t) out_dim*out_dim*
+                                      sizeof(fftw_complex)) +
+                           pool_round(th_dim*th_dim*sizeof(double)) +
+                           tiles_blocked_pool_size(out_dim, TILES_SIDE) +
+                           swarm_pool_size(th_dim, out_dim, radius)));
+    fftw_complex *out = (fftw_complex*)
+      pool_alloc(&pool, (size_t) out_dim*out_dim*sizeof(fftw_complex));
+    double *thumb = (double*) pool_alloc(&pool, th_dim*th_dim*sizeof(double));
+    ASSERT_EQ(0, tiles_blocked(&blocked, &pool, out_dim, TILES_SIDE));
+    ASSERT_EQ(0, swarm_init(&ctx, &pool, th_dim, out_dim, 0, radius, 0));
+
+    matrix_random(out_dim, out, 100);
+    ASSERT_EQ(0, tiles_from_matrix(&blocked, out));
+    for (int i = 0; i < th_dim*th_dim; i++)
+      thumb[i] = rand() % 256;  /* NOLINT(runtime/threadsafe_fn) */
+
+    uint64_t cost[2];
+    for (int layout = 0; layout < 2; layout++) {
+      ctx.tiles = layout ? &blocked : NULL;
+      srand(d);
+      uint64_t start = prof_now();
+      for (int led = 0; led < led_nbr; led++)
+        ASSERT_EQ(0, update_led(&ctx, thumb, layout ? NULL : out,
+                                rand() % out_dim,  /* NOLINT */
+                                rand() % out_dim));  /* NOLINT */
+      cost[layout] = (prof_now() - start)/led_nbr;
+    }
+    printf("%8d %14" PRIu64 " %14" PRIu64 "\n", out_dim, cost[0], cost[1]);
+
+    swarm_destroy(&ctx);
+    tiles_close(&blocked);
+    pool_destroy(&pool);
+  }
+}
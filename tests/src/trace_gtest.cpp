@@ -0,0 +1,134 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  Trace recorder test file
+ *
+ */
+
+#include <omp.h>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include "include/trace.h"
+#include "gtest/gtest.h"
+
+/**
+ *  @brief trace.c file test suite
+ *
+ */
+class trace_suite : public ::testing::Test {
+ protected:
+  /** Output of the exported trace */
+  const char *output = "build/trace_test.json";
+
+  /**
+   *  @brief teardown function for trace_suite tests
+   *
+   *  Free the rings allocated during the test
+   *
+   */
+  virtual void TearDown() {
+    trace_free();
+  }
+
+  /**
+   *  @brief Count the occurrences of pattern in the exported trace
+   *
+   */
+  int count_in_output(const std::string &pattern) {
+    std::ifstream file(output);
+    std::stringstream content;
+    content << file.rdbuf();
+    std::string text = content.str();
+    int count = 0;
+    for (size_t pos = text.find(pattern); pos != std::string::npos;
+         pos = text.find(pattern, pos+1))
+      count++;
+    return count;
+  }
+};
+
+/**
+ *  @brief Events are only recorded between trace_start and trace_stop
+ *
+ */
+TEST_F(trace_suite, start_stop) {
+  TRACE_BEGIN("ignored");
+  EXPECT_EQ(0u, trace_count());
+
+  ASSERT_EQ(1, trace_start(0, 1));
+  ASSERT_EQ(1, trace_start(16, 0));
+  ASSERT_EQ(0, trace_start(16, 1));
+  TRACE_BEGIN("kept");
+  TRACE_END("kept");
+  trace_stop();
+  TRACE_BEGIN("ignored");
+  EXPECT_EQ(2u, trace_count());
+}
+
+/**
+ *  @brief Each thread records in its own ring
+ *
+ *  Record from several OpenMP threads, export and check that every
+ *  event is found in the JSON file
+ *
+ */
+TEST_F(trace_suite, threads_dump) {
+  ASSERT_EQ(0, trace_start(64, 4));
+
+  int threads = 0;
+  #pragma omp parallel num_threads(4)
+  {
+    #pragma omp single
+    threads = omp_get_num_threads();
+    for (int i = 0; i < 5; i++) {
+      TRACE_BEGIN("work");
+      TRACE_END("work");
+    }
+  }
+  trace_stop();
+
+  ASSERT_EQ((size_t) threads*10, trace_count());
+  ASSERT_EQ(0, trace_dump(output));
+  EXPECT_EQ(1, count_in_output("\"traceEvents\""));
+  EXPECT_EQ(threads*5, count_in_output("\"ph\":\"B\""));
+  EXPECT_EQ(threads*5, count_in_output("\"ph\":\"E\""));
+}
+
+/**
+ *  @brief A full ring keeps only the newest events
+ *
+ */
+TEST_F(trace_suite, ring_overwrite) {
+  ASSERT_EQ(0, trace_start(8, 1));
+  for (int i = 0; i < 10; i++) {
+    TRACE_BEGIN("old");
+    TRACE_END("old");
+  }
+  for (int i = 0; i < 2; i++) {
+    TRACE_BEGIN("new");
+    TRACE_END("new");
+  }
+  trace_stop();
+
+  ASSERT_EQ(8u, trace_count());
+  ASSERT_EQ(0, trace_dump(output));
+  EXPECT_EQ(4, count_in_output("\"new\""));
+  EXPECT_EQ(4, count_in_output("\"old\""));
+}
+
+/**
+ *  @brief The threads coming after the last ring record nothing
+ *
+ */
+TEST_F(trace_suite, rings_full) {
+  ASSERT_EQ(0, trace_start(8, 1));
+  #pragma omp parallel num_threads(2)
+  {
+    TRACE_BEGIN("work");
+    TRACE_END("work");
+  }
+  trace_stop();
+  EXPECT_EQ(2u, trace_count());
+}
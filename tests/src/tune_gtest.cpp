@@ -0,0 +1,100 @@
+/* Copyright [2016] <Alexis Lescouet, Benoit Bazard> */
+/**
+ *  @file
+ *
+ *  FFT autotuning test file
+ *
+ */
+
+#include <omp.h>
+#include "include/tune.h"
+#include "gtest/gtest.h"
+
+/**
+ *  @brief tune.c file test suite
+ *
+ */
+class tune_suite : public ::testing::Test {
+ protected:
+  struct tune tune; /**< The profile used in the tests */
+  /** Path of the wisdom, the profile is next to it */
+  const char *wisdom = "build/test_wisdom";
+
+  virtual void SetUp() {
+    tune_init(&tune);
+    remove(wisdom);
+    remove("build/test_wisdom" TUNE_SUFFIX);
+  }
+
+  virtual void TearDown() {
+    remove(wisdom);
+    remove("build/test_wisdom" TUNE_SUFFIX);
+  }
+};
+
+/**
+ *  @brief The measured settings are among the tried ones
+ *
+ */
+TEST_F(tune_suite, measure) {
+  int max_threads = omp_get_max_threads();
+
+  EXPECT_EQ(FFTW_ESTIMATE, tune_plan(&tune, 16));
+  ASSERT_EQ(0, tune_measure(&tune, 16, max_threads));
+  ASSERT_EQ(1, tune.nbr);
+
+  struct tune_entry *entry = tune_find(&tune, 16);
+  ASSERT_TRUE(entry != NULL);
+  EXPECT_EQ(16, entry->dim);
+  EXPECT_GE(entry->threads, 1);
+  EXPECT_LE(entry->threads, max_threads);
+  EXPECT_TRUE(entry->flags == FFTW_ESTIMATE || entry->flags == FFTW_MEASURE);
+  EXPECT_GT(entry->ns, 0);
+  EXPECT_EQ(entry->flags, tune_plan(&tune, 16));
+
+  /* measuring again replaces the settings */
+  ASSERT_EQ(0, tune_measure(&tune, 16, 1));
+  EXPECT_EQ(1, tune.nbr);
+  EXPECT_EQ(1, tune_find(&tune, 16)->threads);
+  EXPECT_TRUE(tune_find(&tune, 17) == NULL);
+
+  EXPECT_EQ(1, tune_measure(&tune, 0, max_threads));
+  EXPECT_EQ(1, tune_measure(&tune, 16, 0));
+}
+
+/**
+ *  @brief A saved profile is loaded as it was
+ *
+ */
+TEST_F(tune_suite, save_load) {
+  struct tune loaded;
+
+  EXPECT_EQ(1, tune_load(&loaded, wisdom));
+  EXPECT_EQ(0, loaded.nbr);
+
+  for (int i = 0; i < 3; i++) {
+    tune.entries[i].dim = 10*(i+1);
+    tune.entries[i].threads = i+1;
+    tune.entries[i].flags = i ? FFTW_MEASURE : FFTW_ESTIMATE;
+    tune.entries[i].ns = 1000.5*i;
+  }
+  tune.nbr = 3;
+  ASSERT_EQ(0, tune_save(&tune, wisdom));
+
+  ASSERT_EQ(0, tune_load(&loaded, wisdom));
+  ASSERT_EQ(3, loaded.nbr);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(tune.entries[i].dim, loaded.entries[i].dim);
+    EXPECT_EQ(tune.entries[i].threads, loaded.entries[i].threads);
+    EXPECT_EQ(tune.entries[i].flags, loaded.entries[i].flags);
+    EXPECT_DOUBLE_EQ(tune.entries[i].ns, loaded.entries[i].ns);
+  }
+
+  /* a broken profile is ignored */
+  FILE *file = fopen("build/test_wisdom" TUNE_SUFFIX, "a");
+  ASSERT_TRUE(file != NULL);
+  fprintf(file, "12 x\n");
+  fclose(file);
+  EXPECT_EQ(1, tune_load(&loaded, wisdom));
+  EXPECT_EQ(0, loaded.nbr);
+}